@@ -1,11 +1,14 @@
 //vertex
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 lightSpaceMatrix;
 uniform mat4 modelMatrix;
 
+#include "instances.glsl"
+
 void main()
 {
-    gl_Position = lightSpaceMatrix * modelMatrix * vec4(aPos, 1.0);
+    mat4 model = instanced ? instances[instanceIndex].modelMatrix : modelMatrix;
+    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
 }  
\ No newline at end of file
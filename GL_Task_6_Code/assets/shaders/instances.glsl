@@ -0,0 +1,18 @@
+// Per-instance data of instanced draws, RenderQueue and StaticGeometry fill it through InstanceBuffer.
+// std430, keep in sync with InstanceBuffer::Instance in src/InstanceBuffer.h
+
+struct Instance {
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+	vec4 parameters;
+};
+
+layout (std430) readonly buffer Instances {
+	Instance instances[];
+};
+
+// base instance + gl_InstanceID, see InstanceBuffer::setupIndexAttribute
+layout (location = 7) in uint instanceIndex;
+
+// false for draws that set their model matrix as a uniform
+uniform bool instanced = false;
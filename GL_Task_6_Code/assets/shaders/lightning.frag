@@ -6,6 +6,7 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    vec3 Tint;
 } fs_in;
 
 uniform vec3 lightColor;
@@ -14,11 +15,13 @@ uniform bool tex;
 
 void main()
 {           
+    // instances can glow in a different shade of the material's color
+    vec3 glow = lightColor * fs_in.Tint;
     if(tex){
         vec3 color = texture(texture_diffuse, fs_in.TexCoords).rgb;
-        FragColor = vec4(color * lightColor, 1.0);
+        FragColor = vec4(color * glow, 1.0);
     } else {
-        FragColor = vec4(lightColor, 1.0);
+        FragColor = vec4(glow, 1.0);
     }
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     if(brightness > 1.0)
@@ -1,4 +1,4 @@
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -7,18 +7,32 @@ out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
+    vec3 Tint;
 } vs_out;
 
-uniform mat4 viewProjMatrix;
+#include "perFrame.glsl"
+
 uniform mat4 model;
 
+#include "instances.glsl"
+
 void main()
 {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));   
+    mat4 modelMatrix = model;
+    mat3 normalMatrix;
+    vs_out.Tint = vec3(1.0);
+    if (instanced) {
+        Instance instance = instances[instanceIndex];
+        modelMatrix = instance.modelMatrix;
+        normalMatrix = mat3(instance.normalMatrix);
+        vs_out.Tint = instance.parameters.rgb;
+    } else {
+        normalMatrix = transpose(inverse(mat3(model)));
+    }
+
+    vs_out.FragPos = vec3(modelMatrix * vec4(aPos, 1.0));   
     vs_out.TexCoords = aTexCoords;
-        
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
     vs_out.Normal = normalize(normalMatrix * aNormal);
     
-    gl_Position = viewProjMatrix * model * vec4(aPos, 1.0);
+    gl_Position = viewProjMatrix * modelMatrix * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -9,7 +9,7 @@ in vec4 FragPosLightSpace;
 layout (location = 0) out vec4 color;
 layout (location = 1) out vec4 BrightColor;
 
-uniform vec3 camera_world;
+#include "perFrame.glsl"
 
 uniform sampler2D texture_diffuse;
 uniform sampler2D shadowMap;
@@ -19,21 +19,6 @@ uniform float specularAlpha;
 
 uniform samplerCube skybox;
 
-uniform bool draw_texcoords;
-uniform bool draw_normals;
-uniform bool gamma;
-
-uniform struct DirectionalLight {
-	vec3 color;
-	vec3 direction;
-} dirL;
-
-uniform struct PointLight {
-	vec3 color;
-	vec3 position;
-	vec3 attenuation;
-} pointL;
-
 vec3 phong(vec3 n, vec3 l, vec3 v, vec3 diffuseC, float diffuseF, vec3 specularC, float specularF, float alpha, bool attenuate, vec3 attenuation) {
 	float d = length(l);
 	l = normalize(l);
@@ -9,7 +9,7 @@ out vec4 color;
 
 layout (location = 1) out vec4 BrightColor;
 
-uniform vec3 camera_world;
+#include "perFrame.glsl"
 
 uniform sampler2D texture_diffuse;  // Texture unit 0
 uniform float metallic;
@@ -20,22 +20,6 @@ uniform float interpolationFactor;
 uniform sampler2D shadowMap;  // Texture unit 1
 uniform samplerCube skybox;   // Texture unit 2
 
-uniform bool draw_texcoords;
-uniform bool draw_normals;
-
-struct DirectionalLight {
-    vec3 color;
-    vec3 direction;
-};
-uniform DirectionalLight dirL;
-
-struct PointLight {
-    vec3 color;
-    vec3 position;
-    vec3 attenuation;  // attenuation.x = constant, attenuation.y = linear, attenuation.z = quadratic
-};
-uniform PointLight pointL;
-
 const float PI = 3.14159265359;
 
 float DistributionGGX(vec3 N, vec3 H, float roughness)
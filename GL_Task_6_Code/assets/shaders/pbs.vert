@@ -9,16 +9,25 @@ out vec2 TexCoords;
 out vec3 position_world;
 out vec4 FragPosLightSpace;
 
+#include "perFrame.glsl"
+
 uniform mat4 modelMatrix;
-uniform mat4 viewProjMatrix;
 uniform mat3 normalMatrix;
-uniform mat4 lightSpaceMatrix;
+
+#include "instances.glsl"
 
 void main( )
 {
-    out_normals = normalMatrix * normal;
+    mat4 model = modelMatrix;
+    mat3 normalModel = normalMatrix;
+    if ( instanced )
+    {
+        model = instances[instanceIndex].modelMatrix;
+        normalModel = mat3( instances[instanceIndex].normalMatrix );
+    }
+    out_normals = normalModel * normal;
     TexCoords = texCoords;
-	vec4 position_w = modelMatrix * vec4( position, 1.0f );
+	vec4 position_w = model * vec4( position, 1.0f );
 	position_world = position_w.xyz;
 	FragPosLightSpace = lightSpaceMatrix * vec4(position_world, 1.0);
 	gl_Position = viewProjMatrix *  position_w;
@@ -0,0 +1,24 @@
+// Values shared by all scene shaders, FrameUniforms writes them once per frame.
+// std140, keep in sync with FrameUniforms::Block in src/FrameUniforms.h
+
+struct DirectionalLight {
+	vec3 color;
+	vec3 direction;
+};
+
+struct PointLight {
+	vec3 color;
+	vec3 position;
+	vec3 attenuation;  // attenuation.x = constant, attenuation.y = linear, attenuation.z = quadratic
+};
+
+layout (std140) uniform PerFrame {
+	mat4 viewProjMatrix;
+	mat4 lightSpaceMatrix;
+	vec3 camera_world;
+	DirectionalLight dirL;
+	PointLight pointL;
+	bool draw_normals;
+	bool draw_texcoords;
+	bool gamma;
+};
@@ -6,14 +6,19 @@ layout(location = 2) in vec2 tex;
 layout(location = 3) in ivec4 boneIds; 
 layout(location = 4) in vec4 weights;
 
-uniform mat4 viewProjMatrix;
+#include "perFrame.glsl"
+
 uniform mat4 modelMatrix;
 uniform mat3 normalMatrix;
-uniform mat4 lightSpaceMatrix;
 
-const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[MAX_BONES];
+
+// bone palettes of all skinned draws of the frame back to back, see BonePalette.h
+layout(std430) readonly buffer BonePalette {
+    mat4 finalBonesMatrices[];
+};
+uniform uint boneOffset;  // first matrix of this draw's palette
+uniform uint boneStride;  // matrices per instance when drawing instanced
 
 out vec3 out_normals;
 out vec2 TexCoords;
@@ -28,7 +33,7 @@ void main()
     {
         int boneID = boneIds[i];
         float weight = weights[i];
-        mat4 boneMatrix = finalBonesMatrices[boneID];
+        mat4 boneMatrix = finalBonesMatrices[boneOffset + uint(gl_InstanceID) * boneStride + uint(boneID)];
         totalPosition += boneMatrix * vec4(pos, 1.0) * weight;
         totalNormal += (boneMatrix * vec4(norm, 0.0)).xyz * weight;
     }
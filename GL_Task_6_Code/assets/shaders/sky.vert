@@ -3,7 +3,7 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 texCoords;
 
-uniform mat4 viewProjMatrix;
+#include "perFrame.glsl"
 
 void main()
 {
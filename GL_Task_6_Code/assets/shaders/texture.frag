@@ -17,29 +17,13 @@ in vec4 FragPosLightSpace;
 
 out vec4 color;
 
-uniform vec3 camera_world;
+#include "perFrame.glsl"
 
 uniform vec3 materialCoefficients; // x = ambient, y = diffuse, z = specular 
 uniform float specularAlpha;
 uniform sampler2D diffuseTexture;
 uniform sampler2D shadowMap;
 
-uniform bool draw_normals;
-uniform bool draw_texcoords;
-uniform bool gamma;
-
-uniform struct DirectionalLight {
-	vec3 color;
-	vec3 direction;
-} dirL;
-
-uniform struct PointLight {
-	vec3 color;
-	vec3 position;
-	vec3 attenuation;
-} pointL;
-
-
 vec3 phong(vec3 n, vec3 l, vec3 v, vec3 diffuseC, float diffuseF, vec3 specularC, float specularF, float alpha, bool attenuate, vec3 attenuation) {
 	float d = length(l);
 	l = normalize(l);
@@ -18,10 +18,10 @@ out VertexData {
 
 out vec4 FragPosLightSpace;
 
+#include "perFrame.glsl"
+
 uniform mat4 modelMatrix;
-uniform mat4 viewProjMatrix;
 uniform mat3 normalMatrix;
-uniform mat4 lightSpaceMatrix;
 
 void main() {
 	vert.normal_world = normalMatrix * normal;
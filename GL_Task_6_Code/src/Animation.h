@@ -7,14 +7,19 @@
 #include "bone.h"
 #include <functional>
 #include "animData.h"
+#include <memory>
 #include "Model.h"
+#include "ImportSession.h"
+#include "ClipCache.h"
+#include "Trace.h"
 
-struct AssimpNodeData
+// one entry of the flattened node hierarchy, parents always come before their children
+struct AnimationNode
 {
-	glm::mat4 transformation;
 	std::string name;
-	int childrenCount;
-	std::vector<AssimpNodeData> children;
+	int parent;
+	int track;
+	glm::mat4 transformation;
 };
 
 class Animation
@@ -24,97 +29,159 @@ public:
 
 	Animation(const std::string& animationPath, Model* model)
 	{
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
-		assert(scene && scene->mRootNode);
-		auto animation = scene->mAnimations[0];
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
-		aiMatrix4x4 globalTransformation = scene->mRootNode->mTransformation;
-		globalTransformation = globalTransformation.Inverse();
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
+		ImportSession session(animationPath, aiProcess_Triangulate);
+		Load(session, 0, model->GetSkeleton());
 	}
 
-	~Animation()
+	// reads clip animationIndex from an already opened session and binds it to the given skeleton
+	Animation(ImportSession& session, std::shared_ptr<Skeleton> skeleton, unsigned int animationIndex = 0)
 	{
+		Load(session, animationIndex, std::move(skeleton));
 	}
 
-	Bone* FindBone(const std::string& name)
+	// all clips of a file, bound to one skeleton
+	static std::vector<Animation> LoadAll(ImportSession& session, std::shared_ptr<Skeleton> skeleton)
 	{
-		auto iter = std::find_if(m_Bones.begin(), m_Bones.end(),
-			[&](const Bone& Bone)
-			{
-				return Bone.GetBoneName() == name;
-			}
-		);
-		if (iter == m_Bones.end()) return nullptr;
-		else return &(*iter);
+		std::vector<Animation> clips;
+		const aiScene* scene = session.scene();
+		unsigned int count = scene ? scene->mNumAnimations : 0;
+		clips.reserve(count);
+		for (unsigned int i = 0; i < count; i++)
+			clips.emplace_back(session, skeleton, i);
+		return clips;
 	}
 
+	~Animation()
+	{
+	}
 
 	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
 	inline float GetDuration() { return m_Duration; }
-	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
+	inline const std::vector<AnimationNode>& GetNodes() const { return m_Nodes; }
+	inline const BoneTrack& GetTrack(int index) const { return m_Tracks[index]; }
 	inline const std::map<std::string, BoneInfo>& GetBoneIDMap()
 	{
-		return m_BoneInfoMap;
+		return m_Skeleton->boneInfoMap;
 	}
+	inline int GetBoneCount() const { return m_Skeleton->boneCount; }
 
-private:
-	static inline glm::mat4 ConvertMatrixToGLMFormat(const aiMatrix4x4& from)
+	// bytes kept in memory for this clip (blob plus the node and track tables)
+	size_t GetResidentBytes() const
 	{
-		glm::mat4 to;
-		to[0][0] = from.a1; to[1][0] = from.a2; to[2][0] = from.a3; to[3][0] = from.a4;
-		to[0][1] = from.b1; to[1][1] = from.b2; to[2][1] = from.b3; to[3][1] = from.b4;
-		to[0][2] = from.c1; to[1][2] = from.c2; to[2][2] = from.c3; to[3][2] = from.c4;
-		to[0][3] = from.d1; to[1][3] = from.d2; to[2][3] = from.d3; to[3][3] = from.d4;
-		return to;
+		size_t bytes = m_Blob ? m_Blob->capacity() : 0;
+		bytes += m_Nodes.capacity() * sizeof(AnimationNode) + m_Tracks.capacity() * sizeof(BoneTrack);
+		for (const AnimationNode& node : m_Nodes)
+			bytes += node.name.capacity();
+		for (const BoneTrack& track : m_Tracks)
+			bytes += track.name.capacity();
+		return bytes;
 	}
-	void ReadMissingBones(const aiAnimation* animation, Model& model)
+
+private:
+	void Load(ImportSession& session, unsigned int animationIndex, std::shared_ptr<Skeleton> skeleton)
 	{
-		int size = animation->mNumChannels;
+		m_Skeleton = std::move(skeleton);
+		std::string name = session.path().substr(session.path().find_last_of("/\\") + 1) + "#" + std::to_string(animationIndex);
 
-		auto& boneInfoMap = model.GetBoneInfoMap();
-		int& boneCount = model.GetBoneCount();
+		TRACE_SCOPE("clip " + name);
+		auto start = AssetClock::now();
+		auto blob = std::make_shared<std::vector<char>>();
+		uint64_t cacheKey = ClipCache::key(session.path(), animationIndex);
+		bool warm = cacheKey != 0 && ClipCache::load(cacheKey, *blob);
 
-		for (int i = 0; i < size; i++)
+		if (!warm)
 		{
-			auto channel = animation->mChannels[i];
-			std::string boneName = channel->mNodeName.data;
-
-			if (boneInfoMap.find(boneName) == boneInfoMap.end())
-			{
-				boneInfoMap[boneName].id = boneCount;
-				boneCount++;
-			}
-			m_Bones.push_back(Bone(channel->mNodeName.data,
-				boneInfoMap[channel->mNodeName.data].id, channel));
+			const aiScene* scene = session.scene();
+			assert(scene && scene->mRootNode && animationIndex < scene->mNumAnimations);
+			*blob = ClipCache::bake(cacheKey, scene, animationIndex, static_cast<float>(assetMsSince(start)));
+			if (cacheKey != 0 && !ClipCache::store(cacheKey, *blob))
+				std::cout << "[ClipCache] failed to write cache entry for " << name << std::endl;
 		}
 
-		m_BoneInfoMap = boneInfoMap;
+		m_Blob = blob;
+		float coldImportMs = 0.0f;
+		uint32_t legacyBytes = 0;
+		if (!ReadBlob(coldImportMs, legacyBytes))
+		{
+			std::cout << "[ClipCache] corrupt clip " << name << std::endl;
+			return;
+		}
+		ReadMissingBones(*m_Skeleton);
+
+		if (warm)
+			std::cout << "[ClipCache] " << name << ": baked load " << assetMsSince(start) << " ms, " << GetResidentBytes() / 1024 << " KB resident"
+			          << " (FBX path: " << coldImportMs << " ms, " << legacyBytes / 1024 << " KB)" << std::endl;
+		else
+			std::cout << "[ClipCache] " << name << ": baked from FBX in " << coldImportMs << " ms, " << GetResidentBytes() / 1024 << " KB resident"
+			          << " (FBX path kept " << legacyBytes / 1024 << " KB)" << std::endl;
 	}
 
-	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
+	// sets up the node and track tables, the key streams are used in place
+	bool ReadBlob(float& coldImportMs, uint32_t& legacyBytes)
 	{
-		assert(src);
+		BinaryReader reader(m_Blob->data(), m_Blob->size());
+		reader.read<uint32_t>();
+		reader.read<uint32_t>();
+		reader.read<uint64_t>();
+		coldImportMs = reader.read<float>();
+		legacyBytes = reader.read<uint32_t>();
+		m_Duration = reader.read<float>();
+		m_TicksPerSecond = static_cast<int>(reader.read<float>());
+		uint32_t nodeCount = reader.read<uint32_t>();
+		uint32_t trackCount = reader.read<uint32_t>();
+
+		m_Nodes.resize(nodeCount);
+		for (AnimationNode& node : m_Nodes)
+		{
+			node.name = reader.readString();
+			node.parent = reader.read<int32_t>();
+			node.track = reader.read<int32_t>();
+			node.transformation = reader.read<glm::mat4>();
+		}
 
-		dest.name = src->mName.data;
-		dest.transformation = ConvertMatrixToGLMFormat(src->mTransformation);
-		dest.childrenCount = src->mNumChildren;
+		m_Tracks.resize(trackCount);
+		for (BoneTrack& track : m_Tracks)
+		{
+			track.name = reader.readString();
+			track.numPositions = reader.read<uint32_t>();
+			track.numRotations = reader.read<uint32_t>();
+			track.numScales = reader.read<uint32_t>();
+			track.positionTimes = reader.view<float>(track.numPositions);
+			track.positions = reader.view<glm::vec3>(track.numPositions);
+			track.rotationTimes = reader.view<float>(track.numRotations);
+			track.rotations = reader.view<int16_t>(track.numRotations * 4);
+			track.scaleTimes = reader.view<float>(track.numScales);
+			track.scales = reader.view<glm::vec3>(track.numScales);
+		}
 
-		for (int i = 0; i < src->mNumChildren; i++)
+		if (!reader.ok())
 		{
-			AssimpNodeData newData;
-			ReadHierarchyData(newData, src->mChildren[i]);
-			dest.children.push_back(newData);
+			m_Nodes.clear();
+			m_Tracks.clear();
+			return false;
 		}
+		return true;
 	}
-	float m_Duration;
-	int m_TicksPerSecond;
-	std::vector<Bone> m_Bones;
-	AssimpNodeData m_RootNode;
-	std::map<std::string, BoneInfo> m_BoneInfoMap;
-};
 
+	void ReadMissingBones(Skeleton& skeleton)
+	{
+		auto& boneInfoMap = skeleton.boneInfoMap;
+		int& boneCount = skeleton.boneCount;
 
+		for (const BoneTrack& track : m_Tracks)
+		{
+			if (boneInfoMap.find(track.name) == boneInfoMap.end())
+			{
+				boneInfoMap[track.name].id = boneCount;
+				boneCount++;
+			}
+		}
+	}
+
+	float m_Duration = 0.0f;
+	int m_TicksPerSecond = 0;
+	std::shared_ptr<const std::vector<char>> m_Blob;
+	std::vector<AnimationNode> m_Nodes;
+	std::vector<BoneTrack> m_Tracks;
+	std::shared_ptr<Skeleton> m_Skeleton = std::make_shared<Skeleton>();
+};
@@ -16,10 +16,7 @@ public:
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
 
-		m_FinalBoneMatrices.reserve(100);
-
-		for (int i = 0; i < 100; i++)
-			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+		ResolveBones();
 	}
 
 	void UpdateAnimation(float dt)
@@ -29,7 +26,7 @@ public:
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			CalculateBoneTransforms();
 		}
 	}
 
@@ -37,42 +34,57 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		ResolveBones();
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	// walks the flattened hierarchy once, parents are always evaluated before their children
+	void CalculateBoneTransforms()
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
-
-		if (Bone)
+		const std::vector<AnimationNode>& nodes = m_CurrentAnimation->GetNodes();
+		for (size_t i = 0; i < nodes.size(); i++)
 		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
+			const AnimationNode& node = nodes[i];
+			glm::mat4 nodeTransform = node.track >= 0
+				? m_CurrentAnimation->GetTrack(node.track).Sample(m_CurrentTime)
+				: node.transformation;
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+			m_GlobalTransforms[i] = node.parent >= 0 ? m_GlobalTransforms[node.parent] * nodeTransform : nodeTransform;
 
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
+			const BoneInfo* bone = m_NodeBones[i];
+			if (bone && bone->id < (int)m_FinalBoneMatrices.size())
+				m_FinalBoneMatrices[bone->id] = m_GlobalTransforms[i] * bone->offset;
 		}
-
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	// one matrix per bone of the skeleton, indexed by BoneInfo::id
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
 private:
+	// node -> bone lookup, done once per clip instead of a map search per node and frame
+	void ResolveBones()
+	{
+		m_NodeBones.clear();
+		m_GlobalTransforms.clear();
+		if (!m_CurrentAnimation)
+			return;
+
+		const auto& boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
+		for (const AnimationNode& node : m_CurrentAnimation->GetNodes())
+		{
+			auto it = boneInfoMap.find(node.name);
+			m_NodeBones.push_back(it != boneInfoMap.end() ? &it->second : nullptr);
+		}
+		m_GlobalTransforms.resize(m_NodeBones.size(), glm::mat4(1.0f));
+		if ((int)m_FinalBoneMatrices.size() < m_CurrentAnimation->GetBoneCount())
+			m_FinalBoneMatrices.resize(m_CurrentAnimation->GetBoneCount(), glm::mat4(1.0f));
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	std::vector<glm::mat4> m_GlobalTransforms;
+	std::vector<const BoneInfo*> m_NodeBones;
 	Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
@@ -6,6 +6,7 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Player.h"
+#include "FrustumCuller.h"
 
 using namespace glm;
 
@@ -18,19 +19,7 @@ private:
 	float sensitivity;
 	vec3 pos;
 	const float PI = 3.14f;
-	struct FrustumPlane {
-		glm::vec3 normal;
-		float distance;
-
-		FrustumPlane() : normal(0.0f), distance(0.0f) {}
-		FrustumPlane(const glm::vec3& normal, float distance) : normal(normal), distance(distance) {}
-
-		float distanceToPoint(const glm::vec3& point) const {
-			return glm::dot(normal, point) + distance;
-		}
-	};
-
-	FrustumPlane frustumPlanes[6];
+	Frustum frustum;
 
 public:
 
@@ -113,62 +102,20 @@ public:
 		radius -= yoffset;
 		radius = glm::clamp(radius, 1.0f, 3.0f);
 	}
-	void ArcCamera::updateFrustumPlanes(const glm::mat4& projectionMatrix, const glm::mat4& viewMatrix) {
-		glm::mat4 clip = projectionMatrix * viewMatrix;
-
-		frustumPlanes[0].normal = glm::vec3(clip[0][3] - clip[0][0],
-			clip[1][3] - clip[1][0],
-			clip[2][3] - clip[2][0]);
-		frustumPlanes[0].distance = clip[3][3] - clip[3][0];
-
-
-		frustumPlanes[1].normal = glm::vec3(clip[0][3] + clip[0][0],
-			clip[1][3] + clip[1][0],
-			clip[2][3] + clip[2][0]);
-		frustumPlanes[1].distance = clip[3][3] + clip[3][0];
-
-		frustumPlanes[2].normal = glm::vec3(clip[0][3] + clip[0][1],
-			clip[1][3] + clip[1][1],
-			clip[2][3] + clip[2][1]);
-		frustumPlanes[2].distance = clip[3][3] + clip[3][1];
-
-		frustumPlanes[3].normal = glm::vec3(clip[0][3] - clip[0][1],
-			clip[1][3] - clip[1][1],
-			clip[2][3] - clip[2][1]);
-		frustumPlanes[3].distance = clip[3][3] - clip[3][1];
-
-		frustumPlanes[4].normal = glm::vec3(clip[0][3] - clip[0][2],
-			clip[1][3] - clip[1][2],
-			clip[2][3] - clip[2][2]);
-		frustumPlanes[4].distance = clip[3][3] - clip[3][2];
-
-		frustumPlanes[5].normal = glm::vec3(clip[0][3] + clip[0][2],
-			clip[1][3] + clip[1][2],
-			clip[2][3] + clip[2][2]);
-		frustumPlanes[5].distance = clip[3][3] + clip[3][2];
-
-		for (int i = 0; i < 6; ++i) {
-			float length = glm::length(frustumPlanes[i].normal);
-			frustumPlanes[i].normal /= length;
-			frustumPlanes[i].distance /= length;
-		}
+	void updateFrustumPlanes(const glm::mat4& projectionMatrix, const glm::mat4& viewMatrix) {
+		frustum = Frustum::fromMatrix(projectionMatrix * viewMatrix);
+	}
+
+	// planes of the last updateFrustumPlanes call
+	const Frustum& getFrustum() const {
+		return frustum;
 	}
 
-	bool ArcCamera::isPointInFrustum(const glm::vec3& point) const {
-		for (int i = 0; i < 6; ++i) {
-			if (frustumPlanes[i].distanceToPoint(point) < 0) {
-				return false;
-			}
-		}
-		return true;
+	bool isPointInFrustum(const glm::vec3& point) const {
+		return frustum.containsSphere(point, 0.0f);
 	}
 
-	bool ArcCamera::isSphereInFrustum(const glm::vec3& center, float radius) const {
-		for (int i = 0; i < 6; ++i) {
-			if (frustumPlanes[i].distanceToPoint(center) < -radius) {
-				return false;
-			}
-		}
-		return true;
+	bool isSphereInFrustum(const glm::vec3& center, float radius) const {
+		return frustum.containsSphere(center, radius);
 	}
 };
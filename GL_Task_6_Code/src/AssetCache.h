@@ -0,0 +1,303 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PathUtils.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+// Shared helpers for the on-disk caches (baked meshes, clips, cooked collision, ...).
+// Cache files live in "<executable dir>/cache" and are named after a 64 bit content key,
+// so a changed source file simply produces a new file instead of overwriting a stale one.
+
+using AssetClock = std::chrono::high_resolution_clock;
+
+inline double assetMsSince(AssetClock::time_point start) {
+    return std::chrono::duration<double, std::milli>(AssetClock::now() - start).count();
+}
+
+// 64 bit FNV-1a, used for all cache keys
+inline uint64_t assetHash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline uint64_t assetHash(const std::string& text, uint64_t seed = 14695981039346656037ull) {
+    return assetHash(text.data(), text.size(), seed);
+}
+
+inline bool assetReadFile(const std::string& path, std::vector<char>& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    out.resize(static_cast<size_t>(size));
+    return size == 0 || file.read(out.data(), size).good();
+}
+
+inline std::filesystem::path assetCacheDir() {
+    static std::filesystem::path dir = [] {
+        std::filesystem::path p = gcgGetExecutableDir() / "cache";
+        std::error_code ec;
+        std::filesystem::create_directories(p, ec);
+        return p;
+    }();
+    return dir;
+}
+
+inline std::string assetCachePath(uint64_t key, const char* extension) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return (assetCacheDir() / (std::string(name) + extension)).string();
+}
+
+/*!
+ * Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path) { open(path); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+        _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_mapping == NULL) {
+            close();
+            return false;
+        }
+        _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        _size = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        _data = static_cast<const char*>(ptr);
+        _size = static_cast<size_t>(st.st_size);
+#endif
+        if (!_data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+        if (_data) UnmapViewOfFile(_data);
+        if (_mapping) CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+        _mapping = NULL;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if (_data) munmap(const_cast<char*>(_data), _size);
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    bool isOpen() const { return _data != nullptr; }
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = NULL;
+#endif
+};
+
+/*!
+ * Sequential reader over a memory block (usually a MappedFile).
+ * All reads are bounds checked, a failed read sets ok() to false and returns zeroes.
+ */
+class BinaryReader {
+public:
+    BinaryReader(const char* data, size_t size) : _data(data), _size(size) {}
+
+    template <typename T>
+    T read() {
+        T value{};
+        if (!check(sizeof(T))) return value;
+        std::memcpy(&value, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return value;
+    }
+
+    // returns a pointer into the mapped block, count elements of T
+    template <typename T>
+    const T* view(size_t count) {
+        if (!check(count * sizeof(T))) return nullptr;
+        const T* ptr = reinterpret_cast<const T*>(_data + _pos);
+        _pos += count * sizeof(T);
+        align();
+        return ptr;
+    }
+
+    template <typename T>
+    void readArray(std::vector<T>& out, size_t count) {
+        const T* ptr = view<T>(count);
+        if (ptr) out.assign(ptr, ptr + count);
+    }
+
+    std::string readString() {
+        uint32_t length = read<uint32_t>();
+        const char* ptr = view<char>(length);
+        return ptr ? std::string(ptr, length) : std::string();
+    }
+
+    bool ok() const { return _ok; }
+    size_t position() const { return _pos; }
+
+private:
+    bool check(size_t bytes) {
+        if (!_ok || _pos + bytes > _size) {
+            _ok = false;
+            return false;
+        }
+        return true;
+    }
+    void align() { _pos = (_pos + 3) & ~size_t(3); }
+
+    const char* _data;
+    size_t _size;
+    size_t _pos = 0;
+    bool _ok = true;
+};
+
+/*!
+ * Writes a cache file next to its final location and renames it into place once complete,
+ * so a crash while baking never leaves a truncated cache entry behind.
+ * Without a path the data is collected in memory and can be fetched with memory().
+ */
+class BinaryWriter {
+public:
+    BinaryWriter() = default;
+
+    explicit BinaryWriter(const std::string& path) : _path(path), _tmpPath(path + ".tmp") {
+        _out.open(_tmpPath, std::ios::binary | std::ios::trunc);
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        put(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void writeArray(const T* data, size_t count) {
+        if (count > 0) {
+            put(reinterpret_cast<const char*>(data), count * sizeof(T));
+        }
+        align();
+    }
+
+    void writeString(const std::string& text) {
+        write<uint32_t>(static_cast<uint32_t>(text.size()));
+        writeArray(text.data(), text.size());
+    }
+
+    const std::vector<char>& memory() const { return _memory; }
+
+    size_t position() const { return _pos; }
+
+    // zero fill up to the next multiple of alignment
+    void pad(size_t alignment) {
+        static const char zeros[16] = {};
+        while (_pos % alignment != 0) {
+            put(zeros, std::min(alignment - _pos % alignment, sizeof(zeros)));
+        }
+    }
+
+    bool commit() {
+        if (_path.empty()) {
+            return true;
+        }
+        _out.close();
+        if (!_out) {
+            std::remove(_tmpPath.c_str());
+            return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(_tmpPath, _path, ec);
+        if (ec) {
+            std::remove(_tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void put(const char* data, size_t size) {
+        if (_path.empty()) {
+            _memory.insert(_memory.end(), data, data + size);
+        } else {
+            _out.write(data, size);
+        }
+        _pos += size;
+    }
+
+    void align() {
+        static const char zeros[4] = { 0, 0, 0, 0 };
+        size_t padding = ((_pos + 3) & ~size_t(3)) - _pos;
+        if (padding > 0) {
+            put(zeros, padding);
+        }
+    }
+
+    std::string _path;
+    std::string _tmpPath;
+    std::ofstream _out;
+    std::vector<char> _memory;
+    size_t _pos = 0;
+};
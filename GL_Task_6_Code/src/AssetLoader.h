@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AssetCache.h"
+#include "JobSystem.h"
+#include "Model.h"
+#include "Trace.h"
+
+/*!
+ * Loads startup assets in parallel.
+ * The CPU part of every asset (Assimp import, image decoding, collision cooking) runs on the
+ * job system, the GL part is queued back and executed on the main thread in finish().
+ */
+class AssetLoader {
+public:
+    explicit AssetLoader(JobSystem& jobs)
+        : _jobs(jobs)
+        , _start(AssetClock::now()) {}
+
+    /*!
+     * Schedules an asset
+     * @param name: name shown in the timing report
+     * @param cpuWork: runs on a worker thread, must not call into OpenGL
+     * @param glWork: runs on the main thread after cpuWork finished
+     */
+    void add(const std::string& name, std::function<void()> cpuWork, std::function<void()> glWork) {
+        auto timing = std::make_shared<AssetTiming>();
+        timing->name = name;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _timings.push_back(timing);
+        }
+
+        _jobs.submit([this, timing, cpuWork, glWork] {
+            TRACE_SCOPE(timing->name);
+            auto start = AssetClock::now();
+            if (cpuWork) {
+                cpuWork();
+            }
+            timing->cpuMs = assetMsSince(start);
+
+            _jobs.runOnMainThread([timing, glWork] {
+                TRACE_SCOPE(timing->name + " (GL)");
+                auto start = AssetClock::now();
+                if (glWork) {
+                    glWork();
+                }
+                timing->glMs = assetMsSince(start);
+            });
+        });
+    }
+
+    /*!
+     * Schedules a model, the asynchronous equivalent of the Model constructors
+     * @param afterImport: optional extra CPU work that needs the imported model, gets the model's import
+     *                     session so animation clips can be read without parsing the file again
+     */
+    void load(Model& model, const std::string& path, bool gamma, PxPhysics* physics = nullptr, PxScene* scene = nullptr, bool isDynamic = false, std::function<void(ImportSession&)> afterImport = nullptr) {
+        std::string name = path.substr(path.find_last_of("/\\") + 1);
+        add(name,
+            [this, &model, path, gamma, physics, isDynamic, afterImport] {
+                ImportSession session(path);
+                model.import(session, gamma);
+                if (physics && !isDynamic) {
+                    model.cookCollision(physics, &_jobs);
+                }
+                if (afterImport) {
+                    afterImport(session);
+                }
+            },
+            [&model, physics, scene, isDynamic] {
+                model.finalize(physics, scene, isDynamic);
+            });
+    }
+
+    /*!
+     * Blocks until every scheduled asset is resident and prints the per-asset timings
+     */
+    void finish() {
+        TRACE_SCOPE("wait for assets");
+        _jobs.waitIdle();
+        double wallMs = assetMsSince(_start);
+
+        std::vector<std::shared_ptr<AssetTiming>> timings;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            timings.swap(_timings);
+        }
+        std::sort(timings.begin(), timings.end(), [](const auto& a, const auto& b) {
+            return a->cpuMs + a->glMs > b->cpuMs + b->glMs;
+        });
+
+        double cpuSum = 0.0;
+        double glSum = 0.0;
+        for (const auto& timing : timings) {
+            cpuSum += timing->cpuMs;
+            glSum += timing->glMs;
+        }
+
+        std::ios::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "[AssetLoader] " << timings.size() << " assets on " << _jobs.workerCount() << " workers in " << wallMs
+                  << " ms (CPU " << cpuSum << " ms, GL " << glSum << " ms)" << std::endl;
+        for (const auto& timing : timings) {
+            std::cout << "  " << std::left << std::setw(20) << timing->name << std::right
+                      << " cpu " << std::setw(8) << timing->cpuMs << " ms"
+                      << "   gl " << std::setw(7) << timing->glMs << " ms" << std::endl;
+        }
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+        _start = AssetClock::now();
+    }
+
+private:
+    struct AssetTiming {
+        std::string name;
+        double cpuMs = 0.0;
+        double glMs = 0.0;
+    };
+
+    JobSystem& _jobs;
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<AssetTiming>> _timings;
+    AssetClock::time_point _start;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AssetCache.h"
+#include "PathUtils.h"
+
+// Asset package: every file below assets/ in one archive that is memory mapped at startup.
+//
+// File layout (all blocks 16 byte aligned):
+//   header    magic, version, entry count, reserved, index offset, names offset
+//   data      file contents, stored as they are on disk
+//   index     entries sorted by path hash: hash, offset, size, stored size, codec, name offset
+//   names     zero terminated normalized paths, used to rule out hash collisions
+//
+// Paths are normalized to "assets/..." with forward slashes and lower case, so absolute paths
+// (e.g. from gcgFindTextureFile) and relative references inside models map to the same entry.
+
+/*!
+ * Read-only view of an asset. Views into the package point straight into the mapping, views of
+ * loose files keep their own mapping alive.
+ */
+struct AssetView {
+    const char* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<MappedFile> loose;
+
+    bool empty() const { return data == nullptr; }
+};
+
+class AssetPack {
+public:
+    static constexpr uint32_t MAGIC = 0x4B415041; // "APAK"
+    static constexpr uint32_t VERSION = 1;
+
+    // only stored entries for now, the field keeps room for compressed chunks
+    enum Codec : uint32_t { CODEC_STORED = 0 };
+
+    struct Entry {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t storedSize;
+        uint32_t codec;
+        uint32_t nameOffset;
+    };
+
+    // "assets/..." relative path with forward slashes, original case
+    static std::string relativePath(const std::string& path) {
+        std::string generic = std::filesystem::path(path).lexically_normal().generic_string();
+        size_t assets = lowerCase(generic).rfind("assets/");
+        if (assets != std::string::npos && (assets == 0 || generic[assets - 1] == '/')) {
+            generic = generic.substr(assets);
+        }
+        return generic;
+    }
+
+    // key used in the index, lower case because the assets are authored on Windows
+    static std::string normalize(const std::string& path) {
+        return lowerCase(relativePath(path));
+    }
+
+    static std::string lowerCase(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        return text;
+    }
+
+    static uint64_t pathHash(const std::string& normalized) { return assetHash(normalized); }
+
+    static constexpr uint64_t HEADER_SIZE = 32;
+
+    static uint64_t alignUp(uint64_t offset) { return (offset + 15) & ~uint64_t(15); }
+
+    /*!
+     * Looks for --pack and removes it from argv
+     * @return if the package should be built instead of starting the game
+     */
+    static bool takePackFlag(int& argc, char** argv) {
+        return gcgTakeFlag(argc, argv, "--pack");
+    }
+
+    /*!
+     * Packs every file below the assets directory
+     * @param assetsDir: the assets directory itself
+     * @param packPath: archive to write
+     */
+    static bool build(const std::filesystem::path& assetsDir, const std::string& packPath) {
+        auto start = AssetClock::now();
+        std::vector<std::filesystem::path> files;
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(assetsDir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_regular_file()) {
+                files.push_back(it->path());
+            }
+        }
+        if (ec || files.empty()) {
+            std::cout << "[AssetPack] nothing to pack in " << assetsDir.string() << std::endl;
+            return false;
+        }
+
+        // the layout is known up front because every entry is stored as is
+        std::vector<Entry> entries;
+        std::string names;
+        uint64_t offset = HEADER_SIZE;
+        for (const std::filesystem::path& file : files) {
+            std::string name = normalize((std::filesystem::path("assets") / std::filesystem::relative(file, assetsDir)).string());
+            uint64_t size = std::filesystem::file_size(file, ec);
+            offset = alignUp(offset);
+            entries.push_back({ pathHash(name), offset, size, size, CODEC_STORED, uint32_t(names.size()) });
+            offset += size;
+            names += name;
+            names += '\0';
+        }
+        uint64_t indexOffset = alignUp(offset);
+        uint64_t namesOffset = alignUp(indexOffset + entries.size() * sizeof(Entry));
+
+        std::vector<Entry> index = entries;
+        std::sort(index.begin(), index.end(), [](const Entry& a, const Entry& b) { return a.hash < b.hash; });
+        for (size_t i = 1; i < index.size(); i++) {
+            if (index[i].hash == index[i - 1].hash) {
+                std::cout << "[AssetPack] path hash collision at " << names.c_str() + index[i].nameOffset << std::endl;
+                return false;
+            }
+        }
+
+        BinaryWriter writer(packPath);
+        writer.write(MAGIC);
+        writer.write(VERSION);
+        writer.write(static_cast<uint32_t>(entries.size()));
+        writer.write(uint32_t(0));
+        writer.write(indexOffset);
+        writer.write(namesOffset);
+
+        std::vector<char> contents;
+        for (size_t i = 0; i < files.size(); i++) {
+            writer.pad(16);
+            if (!assetReadFile(files[i].string(), contents) || contents.size() != entries[i].size || writer.position() != entries[i].offset) {
+                std::cout << "[AssetPack] failed to read " << files[i].string() << std::endl;
+                return false;
+            }
+            writer.writeArray(contents.data(), contents.size());
+        }
+        writer.pad(16);
+        writer.writeArray(index.data(), index.size());
+        writer.pad(16);
+        writer.writeArray(names.data(), names.size());
+
+        if (!writer.commit()) {
+            std::cout << "[AssetPack] failed to write " << packPath << std::endl;
+            return false;
+        }
+        std::cout << "[AssetPack] packed " << entries.size() << " files (" << offset / (1024 * 1024) << " MB) into "
+                  << packPath << " in " << assetMsSince(start) << " ms" << std::endl;
+        return true;
+    }
+};
+
+/*!
+ * Resolves asset paths against the mounted package, falling back to loose files below the
+ * assets directory when no package is mounted (or, in debug builds, when it lacks a file).
+ * Thread safe once mounted.
+ */
+class Vfs {
+public:
+    static Vfs& instance() {
+        static Vfs vfs;
+        return vfs;
+    }
+
+    // maps the package, returns false (and keeps serving loose files) if there is none
+    bool mount(const std::string& packPath) {
+        if (!_pack.open(packPath)) {
+            std::cout << "[Vfs] no package at " << packPath << ", using loose files below " << _looseRoot.string() << std::endl;
+            return false;
+        }
+        BinaryReader reader(_pack.data(), _pack.size());
+        uint32_t magic = reader.read<uint32_t>();
+        uint32_t version = reader.read<uint32_t>();
+        uint32_t count = reader.read<uint32_t>();
+        reader.read<uint32_t>();
+        uint64_t indexOffset = reader.read<uint64_t>();
+        uint64_t namesOffset = reader.read<uint64_t>();
+        if (!reader.ok() || magic != AssetPack::MAGIC || version != AssetPack::VERSION
+            || indexOffset + count * sizeof(AssetPack::Entry) > _pack.size() || namesOffset > _pack.size()) {
+            std::cout << "[Vfs] ignoring outdated package " << packPath << std::endl;
+            _pack.close();
+            return false;
+        }
+        _index = reinterpret_cast<const AssetPack::Entry*>(_pack.data() + indexOffset);
+        _count = count;
+        _names = _pack.data() + namesOffset;
+        _namesSize = _pack.size() - namesOffset;
+        std::cout << "[Vfs] mounted " << packPath << " (" << count << " files)" << std::endl;
+        return true;
+    }
+
+    bool mounted() const { return _count != 0; }
+
+    // the assets directory used for loose files
+    std::filesystem::path assetsDir() const { return _looseRoot / "assets"; }
+
+    AssetView open(const std::string& path) const {
+        if (const AssetPack::Entry* entry = find(path)) {
+            AssetView view;
+            view.data = _pack.data() + entry->offset;
+            view.size = size_t(entry->size);
+            return view;
+        }
+        if (mounted() && !allowLoose()) {
+            std::cout << "[Vfs] " << path << " is not in the package" << std::endl;
+            return {};
+        }
+
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(loosePath(path))) {
+            return {};
+        }
+        AssetView view;
+        view.data = file->data();
+        view.size = file->size();
+        view.loose = std::move(file);
+        return view;
+    }
+
+    bool exists(const std::string& path) const {
+        if (find(path)) {
+            return true;
+        }
+        if (mounted() && !allowLoose()) {
+            return false;
+        }
+        std::error_code ec;
+        return std::filesystem::is_regular_file(loosePath(path), ec);
+    }
+
+private:
+    Vfs() {
+        // one walk up from the executable, instead of probing the parent directories per file
+        std::filesystem::path dir = gcgGetExecutableDir();
+        std::error_code ec;
+        while (!std::filesystem::is_directory(dir / "assets", ec) && dir.has_parent_path() && dir.parent_path() != dir) {
+            dir = dir.parent_path();
+        }
+        _looseRoot = std::filesystem::is_directory(dir / "assets", ec) ? dir : std::filesystem::current_path(ec);
+    }
+
+    static bool allowLoose() {
+#ifdef NDEBUG
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    std::string loosePath(const std::string& path) const {
+        std::filesystem::path p(path);
+        if (p.is_absolute()) {
+            return path;
+        }
+        return (_looseRoot / AssetPack::relativePath(path)).string();
+    }
+
+    const AssetPack::Entry* find(const std::string& path) const {
+        if (_count == 0) {
+            return nullptr;
+        }
+        std::string name = AssetPack::normalize(path);
+        uint64_t hash = AssetPack::pathHash(name);
+        const AssetPack::Entry* end = _index + _count;
+        const AssetPack::Entry* entry = std::lower_bound(_index, end, hash, [](const AssetPack::Entry& e, uint64_t h) { return e.hash < h; });
+        if (entry == end || entry->hash != hash || entry->nameOffset >= _namesSize || name != _names + entry->nameOffset) {
+            return nullptr;
+        }
+        return entry;
+    }
+
+    MappedFile _pack;
+    const AssetPack::Entry* _index = nullptr;
+    size_t _count = 0;
+    const char* _names = nullptr;
+    size_t _namesSize = 0;
+    std::filesystem::path _looseRoot;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Bone matrices of all skinned draws of a frame in one shader storage buffer. Each draw appends
+ * its palette with add() and passes the returned offset to the shader as boneOffset, upload()
+ * then sends everything in one call. The skinning shader indexes the buffer with
+ * boneOffset + gl_InstanceID * boneStride + bone id, so the size of a palette is up to the skeleton.
+ */
+class BonePalette {
+public:
+    static const GLuint BINDING = 1;
+    static constexpr const char* BLOCK_NAME = "BonePalette";
+
+    BonePalette() {
+        glGenBuffers(1, &_buffer);
+    }
+
+    ~BonePalette() {
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    BonePalette(const BonePalette&) = delete;
+    BonePalette& operator=(const BonePalette&) = delete;
+
+    // starts collecting the palettes of a new frame
+    void begin() {
+        _matrices.clear();
+    }
+
+    // @return index of the first matrix of the palette in the buffer
+    uint32_t add(const std::vector<glm::mat4>& bones) {
+        uint32_t offset = uint32_t(_matrices.size());
+        _matrices.insert(_matrices.end(), bones.begin(), bones.end());
+        return offset;
+    }
+
+    // uploads the palettes added since begin() and binds the buffer to BINDING
+    void upload() {
+        if (_matrices.empty()) {
+            return;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _matrices.size() * sizeof(glm::mat4), _matrices.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, _buffer);
+    }
+
+private:
+    GLuint _buffer = 0;
+    std::vector<glm::mat4> _matrices;
+};
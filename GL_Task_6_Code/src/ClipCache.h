@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "bone.h"
+
+// Baked animation clip, loaded with a single file read and used in place by Animation.
+//
+// File layout (all blocks 4 byte aligned):
+//   header    magic, version, key, cold import time, FBX path resident bytes,
+//             duration, ticks per second, node count, track count
+//   nodes     name, parent index, track index, bind transformation
+//             (flattened hierarchy in depth first order, parents always precede their children)
+//   tracks    name, position/rotation/scale key counts, then per channel a time stream
+//             followed by a value stream; rotations are int16 x4 (w, x, y, z), 1.0 = 32767
+
+class ClipCache {
+public:
+    static const uint32_t MAGIC = 0x50494C43; // "CLIP"
+    static const uint32_t VERSION = 1;
+
+    // returns 0 if the source file can not be read
+    static uint64_t key(const std::string& sourcePath, unsigned int animationIndex) {
+        AssetView source = Vfs::instance().open(sourcePath);
+        if (source.empty()) {
+            return 0;
+        }
+        uint64_t seed = assetHash(&VERSION, sizeof(VERSION));
+        seed = assetHash(&animationIndex, sizeof(animationIndex), seed);
+        return assetHash(source.data, source.size, seed);
+    }
+
+    // one read of the whole entry, the Animation keeps the blob and points into it
+    static bool load(uint64_t key, std::vector<char>& blob) {
+        if (!assetReadFile(assetCachePath(key, ".clip"), blob) || blob.size() < 16) {
+            return false;
+        }
+        BinaryReader reader(blob.data(), blob.size());
+        if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION || reader.read<uint64_t>() != key) {
+            std::cout << "[ClipCache] ignoring outdated cache entry " << assetCachePath(key, ".clip") << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static bool store(uint64_t key, const std::vector<char>& blob) {
+        BinaryWriter writer(assetCachePath(key, ".clip"));
+        writer.writeArray(blob.data(), blob.size());
+        return writer.commit();
+    }
+
+    /*!
+     * Converts one clip of an imported scene into the baked format
+     * @param coldImportMs: time spent in Assimp for this clip, stored for the load report
+     */
+    static std::vector<char> bake(uint64_t key, const aiScene* scene, unsigned int animationIndex, float coldImportMs) {
+        const aiAnimation* animation = scene->mAnimations[animationIndex];
+
+        std::vector<const aiNode*> nodes;
+        std::vector<int32_t> parents;
+        flatten(scene->mRootNode, -1, nodes, parents);
+
+        std::vector<int32_t> nodeTracks(nodes.size(), -1);
+        for (size_t n = 0; n < nodes.size(); n++) {
+            for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+                if (animation->mChannels[c]->mNodeName == nodes[n]->mName) {
+                    nodeTracks[n] = int32_t(c);
+                    break;
+                }
+            }
+        }
+
+        BinaryWriter writer;
+        writer.write(MAGIC);
+        writer.write(VERSION);
+        writer.write(key);
+        writer.write(coldImportMs);
+        writer.write(static_cast<uint32_t>(legacyBytes(animation, nodes)));
+        writer.write(static_cast<float>(animation->mDuration));
+        writer.write(static_cast<float>(animation->mTicksPerSecond));
+        writer.write(static_cast<uint32_t>(nodes.size()));
+        writer.write(static_cast<uint32_t>(animation->mNumChannels));
+
+        for (size_t n = 0; n < nodes.size(); n++) {
+            writer.writeString(nodes[n]->mName.C_Str());
+            writer.write(parents[n]);
+            writer.write(nodeTracks[n]);
+            writer.write(toGlm(nodes[n]->mTransformation));
+        }
+
+        for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+            const aiNodeAnim* channel = animation->mChannels[c];
+            writer.writeString(channel->mNodeName.C_Str());
+            writer.write(static_cast<uint32_t>(channel->mNumPositionKeys));
+            writer.write(static_cast<uint32_t>(channel->mNumRotationKeys));
+            writer.write(static_cast<uint32_t>(channel->mNumScalingKeys));
+
+            std::vector<float> times;
+            std::vector<glm::vec3> vectors;
+            for (unsigned int k = 0; k < channel->mNumPositionKeys; k++) {
+                const aiVectorKey& frame = channel->mPositionKeys[k];
+                times.push_back(float(frame.mTime));
+                vectors.push_back(glm::vec3(frame.mValue.x, frame.mValue.y, frame.mValue.z));
+            }
+            writer.writeArray(times.data(), times.size());
+            writer.writeArray(vectors.data(), vectors.size());
+
+            times.clear();
+            std::vector<int16_t> rotations;
+            for (unsigned int k = 0; k < channel->mNumRotationKeys; k++) {
+                const aiQuatKey& frame = channel->mRotationKeys[k];
+                aiQuaternion q = frame.mValue;
+                q.Normalize();
+                times.push_back(float(frame.mTime));
+                rotations.push_back(BoneTrack::QuantizeRotation(q.w));
+                rotations.push_back(BoneTrack::QuantizeRotation(q.x));
+                rotations.push_back(BoneTrack::QuantizeRotation(q.y));
+                rotations.push_back(BoneTrack::QuantizeRotation(q.z));
+            }
+            writer.writeArray(times.data(), times.size());
+            writer.writeArray(rotations.data(), rotations.size());
+
+            times.clear();
+            vectors.clear();
+            for (unsigned int k = 0; k < channel->mNumScalingKeys; k++) {
+                const aiVectorKey& frame = channel->mScalingKeys[k];
+                times.push_back(float(frame.mTime));
+                vectors.push_back(glm::vec3(frame.mValue.x, frame.mValue.y, frame.mValue.z));
+            }
+            writer.writeArray(times.data(), times.size());
+            writer.writeArray(vectors.data(), vectors.size());
+        }
+        return writer.memory();
+    }
+
+private:
+    static void flatten(const aiNode* node, int32_t parent, std::vector<const aiNode*>& nodes, std::vector<int32_t>& parents) {
+        int32_t index = int32_t(nodes.size());
+        nodes.push_back(node);
+        parents.push_back(parent);
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+            flatten(node->mChildren[i], index, nodes, parents);
+        }
+    }
+
+    // what the previous runtime representation (Bone objects with array-of-struct keys and a
+    // node tree) kept resident for this clip, so the report can compare both paths
+    static size_t legacyBytes(const aiAnimation* animation, const std::vector<const aiNode*>& nodes) {
+        const size_t nodeSize = sizeof(glm::mat4) + sizeof(std::string) + sizeof(int) + 3 * sizeof(void*);
+        const size_t boneSize = 3 * 3 * sizeof(void*) + 3 * sizeof(int) + sizeof(glm::mat4) + sizeof(std::string) + sizeof(int);
+        size_t bytes = 0;
+        for (const aiNode* node : nodes) {
+            bytes += nodeSize + node->mName.length;
+        }
+        for (unsigned int c = 0; c < animation->mNumChannels; c++) {
+            const aiNodeAnim* channel = animation->mChannels[c];
+            bytes += boneSize + channel->mNodeName.length;
+            bytes += channel->mNumPositionKeys * (sizeof(glm::vec3) + sizeof(float));
+            bytes += channel->mNumRotationKeys * (sizeof(glm::vec4) + sizeof(float));
+            bytes += channel->mNumScalingKeys * (sizeof(glm::vec3) + sizeof(float));
+        }
+        return bytes;
+    }
+
+    static glm::mat4 toGlm(const aiMatrix4x4& from) {
+        glm::mat4 to;
+        to[0][0] = from.a1; to[1][0] = from.a2; to[2][0] = from.a3; to[3][0] = from.a4;
+        to[0][1] = from.b1; to[1][1] = from.b2; to[2][1] = from.b3; to[3][1] = from.b4;
+        to[0][2] = from.c1; to[1][2] = from.c2; to[2][2] = from.c3; to[3][2] = from.c4;
+        to[0][3] = from.d1; to[1][3] = from.d2; to[2][3] = from.d3; to[3][3] = from.d4;
+        return to;
+    }
+};
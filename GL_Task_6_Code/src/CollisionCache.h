@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "PxPhysicsAPI.h"
+#include "cooking/PxCooking.h"
+
+#include "AssetCache.h"
+#include "VertexFormat.h"
+
+// Cooked PhysX triangle meshes, stored exactly as PxCookTriangleMesh produced them.
+// The key covers the vertex positions, the indices and every cooking parameter that changes the
+// output, so a warm start hands the mapped file straight to PxPhysics::createTriangleMesh.
+
+class CollisionCache {
+public:
+    static const uint32_t VERSION = 1;
+
+    static uint64_t key(const PackedMesh& geometry, const physx::PxCookingParams& params) {
+        uint64_t seed = assetHash(&VERSION, sizeof(VERSION));
+        uint32_t sdkVersion = PX_PHYSICS_VERSION;
+        seed = assetHash(&sdkVersion, sizeof(sdkVersion), seed);
+
+        // hashed field by field, the struct itself has padding
+        float tolerances[6] = {
+            params.scale.length, params.scale.speed, params.meshWeldTolerance,
+            params.meshAreaMinLimit, params.meshEdgeLengthMaxLimit, params.areaTestEpsilon
+        };
+        uint32_t flags[5] = {
+            uint32_t(params.meshPreprocessParams), uint32_t(params.midphaseDesc.getType()),
+            uint32_t(params.suppressTriangleMeshRemapTable), uint32_t(params.buildTriangleAdjacencies),
+            uint32_t(params.buildGPUData)
+        };
+        seed = assetHash(tolerances, sizeof(tolerances), seed);
+        seed = assetHash(flags, sizeof(flags), seed);
+
+        uint32_t stride = geometry.layout().stride;
+        for (uint32_t i = 0; i < geometry.vertexCount; i++) {
+            seed = assetHash(geometry.vertices.data() + size_t(i) * stride, sizeof(glm::vec3), seed);
+        }
+        uint32_t indexSize = uint32_t(geometry.indexSize());
+        seed = assetHash(&indexSize, sizeof(indexSize), seed);
+        // only the full detail level collides
+        return assetHash(geometry.indices.data(), geometry.lods[0].indexCount * geometry.indexSize(), seed);
+    }
+
+    /*!
+     * Returns the triangle mesh for the given geometry, cooking and storing it on a cache miss.
+     * Safe to call from worker threads.
+     * @param cooked: set to true if the mesh had to be cooked
+     */
+    static physx::PxTriangleMesh* create(physx::PxPhysics* physics, const PackedMesh& geometry, bool& cooked) {
+        const physx::PxCookingParams params(physics->getTolerancesScale());
+        uint64_t cacheKey = key(geometry, params);
+        std::string path = assetCachePath(cacheKey, ".pxtm");
+        cooked = false;
+
+        MappedFile file;
+        if (file.open(path)) {
+            physx::PxDefaultMemoryInputData input(reinterpret_cast<physx::PxU8*>(const_cast<char*>(file.data())), physx::PxU32(file.size()));
+            if (physx::PxTriangleMesh* mesh = physics->createTriangleMesh(input)) {
+                return mesh;
+            }
+            std::cout << "[CollisionCache] ignoring unreadable cache entry " << path << std::endl;
+        }
+
+        // positions and indices are read in place from the packed buffers, no temporary copy
+        physx::PxTriangleMeshDesc desc;
+        desc.points.count = physx::PxU32(geometry.vertexCount);
+        desc.points.stride = geometry.layout().stride;
+        desc.points.data = geometry.vertices.empty() ? nullptr : geometry.vertices.data();
+        desc.triangles.count = physx::PxU32(geometry.lods[0].indexCount / 3);
+        desc.triangles.stride = physx::PxU32(3 * geometry.indexSize());
+        desc.triangles.data = geometry.indices.data();
+        if (geometry.flags & INDEX_16) {
+            desc.flags |= physx::PxMeshFlag::e16_BIT_INDICES;
+        }
+
+        physx::PxDefaultMemoryOutputStream output;
+        physx::PxTriangleMeshCookingResult::Enum result;
+        if (!PxCookTriangleMesh(params, desc, output, &result)) {
+            std::cout << "Failed to create triangle mesh" << std::endl;
+            return nullptr;
+        }
+        cooked = true;
+
+        BinaryWriter writer(path);
+        writer.writeArray(output.getData(), output.getSize());
+        if (!writer.commit()) {
+            std::cout << "[CollisionCache] failed to write cache entry " << path << std::endl;
+        }
+
+        physx::PxDefaultMemoryInputData input(output.getData(), output.getSize());
+        return physics->createTriangleMesh(input);
+    }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Uniform buffer with the values every scene shader needs once per frame (camera, lights,
+ * shadow matrix, debug flags). The shaders declare it by including assets/shaders/perFrame.glsl,
+ * Shader binds the block to BINDING after linking.
+ */
+class FrameUniforms {
+public:
+    static const GLuint BINDING = 0;
+    static constexpr const char* BLOCK_NAME = "PerFrame";
+
+    // std140 layout of the PerFrame block, vec3 members take a full vec4 slot
+    struct Block {
+        glm::mat4 viewProjMatrix;
+        glm::mat4 lightSpaceMatrix;
+        glm::vec4 cameraWorld;
+        glm::vec4 dirLColor;
+        glm::vec4 dirLDirection;
+        glm::vec4 pointLColor;
+        glm::vec4 pointLPosition;
+        glm::vec4 pointLAttenuation;
+        GLint drawNormals;
+        GLint drawTexcoords;
+        GLint gamma;
+        GLint padding;
+    };
+    static_assert(sizeof(Block) == 240, "Block has to match the std140 layout of PerFrame");
+
+    FrameUniforms() {
+        glGenBuffers(1, &_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, _buffer);
+    }
+
+    ~FrameUniforms() {
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+    // replaces the whole block, respecifying the storage lets the driver hand out fresh memory
+    // instead of waiting for draws of the previous frame that still read the old values
+    void update(const Block& block) {
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    GLuint _buffer = 0;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+/*!
+ * Six planes with inward normals, (normal, distance) per plane; a point p is inside a plane
+ * if dot(normal, p) + distance >= 0
+ */
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+    static Frustum fromMatrix(const glm::mat4& clip) {
+        glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+        glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+        glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+        glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+        Frustum frustum;
+        frustum.planes[0] = row3 - row0;
+        frustum.planes[1] = row3 + row0;
+        frustum.planes[2] = row3 + row1;
+        frustum.planes[3] = row3 - row1;
+        frustum.planes[4] = row3 - row2;
+        frustum.planes[5] = row3 + row2;
+        for (glm::vec4& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool containsSphere(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/*!
+ * Visibility of many bounding volumes against one frustum. The world space bounds are kept as
+ * structure of arrays, so the test runs over 8 (AVX) or 4 (SSE) volumes per instruction; a volume
+ * is visible if neither its sphere nor its box lies completely behind one of the planes.
+ *
+ * The arrays are padded to whole batches, the padding is a point at the origin and its results
+ * are not reported.
+ */
+class FrustumCuller {
+public:
+#if defined(FRUSTUM_CULLER_AVX)
+    static const size_t LANES = 8;
+#elif defined(FRUSTUM_CULLER_SSE)
+    static const size_t LANES = 4;
+#else
+    static const size_t LANES = 1;
+#endif
+
+    void clear() {
+        _count = 0;
+        for (std::vector<float> FrustumCuller::*column : COLUMNS) {
+            (this->*column).clear();
+        }
+    }
+
+    /*!
+     * Adds the object space bounds of a mesh placed with model
+     * @return index of the volume in the visibility list of cull()
+     */
+    size_t add(const glm::vec4& sphere, const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& model) {
+        if (_count % LANES == 0) {
+            for (std::vector<float> FrustumCuller::*column : COLUMNS) {
+                (this->*column).resize(_count + LANES, 0.0f);
+            }
+        }
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 boxCenter;
+        glm::vec3 extent;
+        worldBox(boxMin, boxMax, model, boxCenter, extent);
+
+        size_t i = _count++;
+        _sphereX[i] = center.x;
+        _sphereY[i] = center.y;
+        _sphereZ[i] = center.z;
+        _radius[i] = sphere.w * scale;
+        _boxX[i] = boxCenter.x;
+        _boxY[i] = boxCenter.y;
+        _boxZ[i] = boxCenter.z;
+        _extentX[i] = extent.x;
+        _extentY[i] = extent.y;
+        _extentZ[i] = extent.z;
+        return i;
+    }
+
+    size_t size() const { return _count; }
+
+    // Arvo, center and half extents along the world axes of a transformed box
+    static void worldBox(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& model, glm::vec3& center, glm::vec3& extent) {
+        center = glm::vec3(model * glm::vec4((boxMin + boxMax) * 0.5f, 1.0f));
+        glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(model[0])), glm::abs(glm::vec3(model[1])), glm::abs(glm::vec3(model[2])));
+        extent = absolute * ((boxMax - boxMin) * 0.5f);
+    }
+
+    /*!
+     * @param visible: resized to size(), 1 for every volume that intersects the frustum
+     * @return number of visible volumes
+     */
+    size_t cull(const Frustum& frustum, std::vector<uint8_t>& visible) const {
+        visible.resize(_count + LANES);
+        for (size_t first = 0; first < _count; first += LANES) {
+            cullBatch(frustum, first, &visible[first]);
+        }
+        visible.resize(_count);
+        return size_t(std::count(visible.begin(), visible.end(), uint8_t(1)));
+    }
+
+private:
+#if defined(FRUSTUM_CULLER_AVX)
+    void cullBatch(const Frustum& frustum, size_t first, uint8_t* visible) const {
+        __m256 sphereX = _mm256_loadu_ps(&_sphereX[first]);
+        __m256 sphereY = _mm256_loadu_ps(&_sphereY[first]);
+        __m256 sphereZ = _mm256_loadu_ps(&_sphereZ[first]);
+        __m256 radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&_radius[first]));
+        __m256 boxX = _mm256_loadu_ps(&_boxX[first]);
+        __m256 boxY = _mm256_loadu_ps(&_boxY[first]);
+        __m256 boxZ = _mm256_loadu_ps(&_boxZ[first]);
+        __m256 extentX = _mm256_loadu_ps(&_extentX[first]);
+        __m256 extentY = _mm256_loadu_ps(&_extentY[first]);
+        __m256 extentZ = _mm256_loadu_ps(&_extentZ[first]);
+        __m256 outside = _mm256_setzero_ps();
+        for (const glm::vec4& plane : frustum.planes) {
+            __m256 nx = _mm256_set1_ps(plane.x);
+            __m256 ny = _mm256_set1_ps(plane.y);
+            __m256 nz = _mm256_set1_ps(plane.z);
+            __m256 d = _mm256_set1_ps(plane.w);
+            __m256 sphere = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, sphereX), _mm256_mul_ps(ny, sphereY)), _mm256_add_ps(_mm256_mul_ps(nz, sphereZ), d));
+            __m256 box = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, boxX), _mm256_mul_ps(ny, boxY)), _mm256_add_ps(_mm256_mul_ps(nz, boxZ), d));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), extentX),
+                                                       _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), extentY)),
+                                         _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), extentZ));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(sphere, radius, _CMP_LT_OQ));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(box, reach), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        int mask = _mm256_movemask_ps(outside);
+        for (size_t lane = 0; lane < LANES; lane++) {
+            visible[lane] = uint8_t(((mask >> lane) & 1) == 0);
+        }
+    }
+#elif defined(FRUSTUM_CULLER_SSE)
+    void cullBatch(const Frustum& frustum, size_t first, uint8_t* visible) const {
+        __m128 sphereX = _mm_loadu_ps(&_sphereX[first]);
+        __m128 sphereY = _mm_loadu_ps(&_sphereY[first]);
+        __m128 sphereZ = _mm_loadu_ps(&_sphereZ[first]);
+        __m128 radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&_radius[first]));
+        __m128 boxX = _mm_loadu_ps(&_boxX[first]);
+        __m128 boxY = _mm_loadu_ps(&_boxY[first]);
+        __m128 boxZ = _mm_loadu_ps(&_boxZ[first]);
+        __m128 extentX = _mm_loadu_ps(&_extentX[first]);
+        __m128 extentY = _mm_loadu_ps(&_extentY[first]);
+        __m128 extentZ = _mm_loadu_ps(&_extentZ[first]);
+        __m128 outside = _mm_setzero_ps();
+        for (const glm::vec4& plane : frustum.planes) {
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 d = _mm_set1_ps(plane.w);
+            __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sphereX), _mm_mul_ps(ny, sphereY)), _mm_add_ps(_mm_mul_ps(nz, sphereZ), d));
+            __m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, boxX), _mm_mul_ps(ny, boxY)), _mm_add_ps(_mm_mul_ps(nz, boxZ), d));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), extentX),
+                                                 _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), extentY)),
+                                      _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), extentZ));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(sphere, radius));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(box, reach), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (size_t lane = 0; lane < LANES; lane++) {
+            visible[lane] = uint8_t(((mask >> lane) & 1) == 0);
+        }
+    }
+#else
+    void cullBatch(const Frustum& frustum, size_t first, uint8_t* visible) const {
+        bool outside = false;
+        for (const glm::vec4& plane : frustum.planes) {
+            float sphere = plane.x * _sphereX[first] + plane.y * _sphereY[first] + plane.z * _sphereZ[first] + plane.w;
+            float box = plane.x * _boxX[first] + plane.y * _boxY[first] + plane.z * _boxZ[first] + plane.w;
+            float reach = std::fabs(plane.x) * _extentX[first] + std::fabs(plane.y) * _extentY[first] + std::fabs(plane.z) * _extentZ[first];
+            outside = outside || sphere < -_radius[first] || box + reach < 0.0f;
+        }
+        visible[0] = uint8_t(!outside);
+    }
+#endif
+
+    size_t _count = 0;
+    std::vector<float> _sphereX, _sphereY, _sphereZ, _radius;
+    std::vector<float> _boxX, _boxY, _boxZ;
+    std::vector<float> _extentX, _extentY, _extentZ;
+
+    static constexpr std::vector<float> FrustumCuller::*COLUMNS[] = {
+        &FrustumCuller::_sphereX, &FrustumCuller::_sphereY, &FrustumCuller::_sphereZ, &FrustumCuller::_radius,
+        &FrustumCuller::_boxX, &FrustumCuller::_boxY, &FrustumCuller::_boxZ,
+        &FrustumCuller::_extentX, &FrustumCuller::_extentY, &FrustumCuller::_extentZ
+    };
+};
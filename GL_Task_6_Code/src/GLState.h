@@ -0,0 +1,352 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <GL/glew.h>
+
+/*!
+ * Shadow copy of the GL state the renderer changes per draw (program, vertex array, texture units,
+ * framebuffers, depth/blend/cull state). Every setter compares with the copy and skips the GL call
+ * when nothing would change, so callers can simply bind what they need instead of restoring
+ * defaults after each draw.
+ *
+ * The copy starts out unknown, the first call of each setter always reaches GL. Code that changes
+ * this state behind the cache's back has to call invalidate() afterwards; objects that are deleted
+ * while bound have to be forgotten, or a later object reusing the name would not be bound.
+ *
+ * With validation on (--validate-gl-state) every skipped call is checked against glGet* first
+ * and the whole copy once per frame in endFrame(), mismatches are logged as stale.
+ */
+class GLState {
+public:
+    // texture units and targets with a cached binding, others always reach GL
+    static const GLuint MAX_UNITS = 16;
+    static const int TARGETS = 2;
+
+    static GLState& instance() {
+        static GLState state;
+        return state;
+    }
+
+    void setValidation(bool enabled) { _validate = enabled; }
+    bool validating() const { return _validate; }
+
+    // forgets everything, the next call of each setter reaches GL
+    void invalidate() {
+        _program = UNKNOWN;
+        _vertexArray = UNKNOWN;
+        _activeUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++) {
+            for (int target = 0; target < TARGETS; target++) {
+                _textures[unit][target] = UNKNOWN;
+            }
+        }
+        _drawFramebuffer = UNKNOWN;
+        _readFramebuffer = UNKNOWN;
+        _depthTest = _blend = _cullFace = -1;
+        _depthMask = -1;
+        _depthFunc = UNKNOWN;
+        _blendSrc = _blendDst = UNKNOWN;
+    }
+
+    GLuint program() const { return _program; }
+
+    void useProgram(GLuint program) {
+        if (program == _program && !stale("program", GL_CURRENT_PROGRAM, program)) {
+            _elided++;
+            return;
+        }
+        _program = program;
+        glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vertexArray) {
+        if (vertexArray == _vertexArray && !stale("vertex array", GL_VERTEX_ARRAY_BINDING, vertexArray)) {
+            _elided++;
+            return;
+        }
+        _vertexArray = vertexArray;
+        glBindVertexArray(vertexArray);
+    }
+
+    void activeTexture(GLuint unit) {
+        if (unit == _activeUnit && !stale("active texture", GL_ACTIVE_TEXTURE, GL_TEXTURE0 + unit)) {
+            _elided++;
+            return;
+        }
+        _activeUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // the active unit only changes when the binding does
+    void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+        int slot = targetSlot(target);
+        if (unit >= MAX_UNITS || slot < 0) {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+            return;
+        }
+        if (texture == _textures[unit][slot] && !staleTexture(unit, target, texture)) {
+            _elided++;
+            return;
+        }
+        activeTexture(unit);
+        _textures[unit][slot] = texture;
+        glBindTexture(target, texture);
+    }
+
+    // binds to the unit that is active, for creating and uploading textures
+    void bindTexture(GLenum target, GLuint texture) {
+        if (_activeUnit == UNKNOWN) {
+            activeTexture(0);
+        }
+        bindTexture(_activeUnit, target, texture);
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void bindFramebuffer(GLenum target, GLuint framebuffer) {
+        bool draw = target != GL_READ_FRAMEBUFFER;
+        bool read = target != GL_DRAW_FRAMEBUFFER;
+        if ((!draw || framebuffer == _drawFramebuffer) && (!read || framebuffer == _readFramebuffer)
+            && !(draw && stale("draw framebuffer", GL_DRAW_FRAMEBUFFER_BINDING, framebuffer))
+            && !(read && stale("read framebuffer", GL_READ_FRAMEBUFFER_BINDING, framebuffer))) {
+            _elided++;
+            return;
+        }
+        if (draw) {
+            _drawFramebuffer = framebuffer;
+        }
+        if (read) {
+            _readFramebuffer = framebuffer;
+        }
+        glBindFramebuffer(target, framebuffer);
+    }
+
+    // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are cached, other capabilities always reach GL
+    void setEnabled(GLenum capability, bool enabled) {
+        int8_t* cached = capabilitySlot(capability);
+        if (cached && *cached == int8_t(enabled) && !staleCapability(capability, enabled)) {
+            _elided++;
+            return;
+        }
+        if (cached) {
+            *cached = int8_t(enabled);
+        }
+        if (enabled) {
+            glEnable(capability);
+        }
+        else {
+            glDisable(capability);
+        }
+    }
+
+    void depthFunc(GLenum function) {
+        if (function == _depthFunc && !stale("depth func", GL_DEPTH_FUNC, function)) {
+            _elided++;
+            return;
+        }
+        _depthFunc = function;
+        glDepthFunc(function);
+    }
+
+    void depthMask(bool write) {
+        if (_depthMask == int8_t(write) && !stale("depth mask", GL_DEPTH_WRITEMASK, write ? GL_TRUE : GL_FALSE)) {
+            _elided++;
+            return;
+        }
+        _depthMask = int8_t(write);
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void blendFunc(GLenum source, GLenum destination) {
+        if (source == _blendSrc && destination == _blendDst
+            && !stale("blend source", GL_BLEND_SRC_RGB, source) && !stale("blend destination", GL_BLEND_DST_RGB, destination)) {
+            _elided++;
+            return;
+        }
+        _blendSrc = source;
+        _blendDst = destination;
+        glBlendFunc(source, destination);
+    }
+
+    // deleting a bound object reverts the binding to 0, call these right after glDelete*
+    void forgetProgram(GLuint program) {
+        if (program == _program) {
+            _program = UNKNOWN;
+        }
+    }
+
+    void forgetVertexArray(GLuint vertexArray) {
+        if (vertexArray == _vertexArray) {
+            _vertexArray = UNKNOWN;
+        }
+    }
+
+    void forgetTexture(GLuint texture) {
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++) {
+            for (int target = 0; target < TARGETS; target++) {
+                if (_textures[unit][target] == texture) {
+                    _textures[unit][target] = UNKNOWN;
+                }
+            }
+        }
+    }
+
+    void forgetFramebuffer(GLuint framebuffer) {
+        if (framebuffer == _drawFramebuffer) {
+            _drawFramebuffer = UNKNOWN;
+        }
+        if (framebuffer == _readFramebuffer) {
+            _readFramebuffer = UNKNOWN;
+        }
+    }
+
+    // with validation on, compares the whole copy with GL; the counters restart
+    void endFrame() {
+        if (_validate) {
+            validate();
+        }
+        _lastElided = _elided;
+        _elided = 0;
+    }
+
+    // @return false if a known part of the copy differs from GL
+    bool validate() {
+        size_t before = _staleCount;
+        bool validating = _validate;
+        _validate = true;
+        known(_program, [&] { stale("program", GL_CURRENT_PROGRAM, _program); });
+        known(_vertexArray, [&] { stale("vertex array", GL_VERTEX_ARRAY_BINDING, _vertexArray); });
+        known(_drawFramebuffer, [&] { stale("draw framebuffer", GL_DRAW_FRAMEBUFFER_BINDING, _drawFramebuffer); });
+        known(_readFramebuffer, [&] { stale("read framebuffer", GL_READ_FRAMEBUFFER_BINDING, _readFramebuffer); });
+        known(_depthFunc, [&] { stale("depth func", GL_DEPTH_FUNC, _depthFunc); });
+        known(_blendSrc, [&] { stale("blend source", GL_BLEND_SRC_RGB, _blendSrc); });
+        known(_blendDst, [&] { stale("blend destination", GL_BLEND_DST_RGB, _blendDst); });
+        if (_depthMask >= 0) {
+            stale("depth mask", GL_DEPTH_WRITEMASK, _depthMask ? GL_TRUE : GL_FALSE);
+        }
+        for (GLenum capability : { GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE }) {
+            int8_t cached = *capabilitySlot(capability);
+            if (cached >= 0) {
+                staleCapability(capability, cached != 0);
+            }
+        }
+        known(_activeUnit, [&] { stale("active texture", GL_ACTIVE_TEXTURE, GL_TEXTURE0 + _activeUnit); });
+        for (GLuint unit = 0; unit < MAX_UNITS; unit++) {
+            for (int target = 0; target < TARGETS; target++) {
+                if (_textures[unit][target] != UNKNOWN) {
+                    staleTexture(unit, TARGET_ENUMS[target], _textures[unit][target]);
+                }
+            }
+        }
+        _validate = validating;
+        return _staleCount == before;
+    }
+
+    // GL calls skipped last frame
+    size_t elidedCalls() const { return _lastElided; }
+    // mismatches found by validation since the start
+    size_t staleCount() const { return _staleCount; }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static constexpr GLenum TARGET_ENUMS[TARGETS] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP };
+    static constexpr GLenum TARGET_BINDINGS[TARGETS] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_CUBE_MAP };
+
+    GLState() {
+        invalidate();
+    }
+
+    static int targetSlot(GLenum target) {
+        for (int slot = 0; slot < TARGETS; slot++) {
+            if (TARGET_ENUMS[slot] == target) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    int8_t* capabilitySlot(GLenum capability) {
+        switch (capability) {
+        case GL_DEPTH_TEST: return &_depthTest;
+        case GL_BLEND: return &_blend;
+        case GL_CULL_FACE: return &_cullFace;
+        default: return nullptr;
+        }
+    }
+
+    template <typename Check>
+    static void known(GLuint value, Check check) {
+        if (value != UNKNOWN) {
+            check();
+        }
+    }
+
+    // only queries GL with validation on, a skipped call that was needed is logged and made after all
+    bool stale(const char* what, GLenum binding, GLuint expected) {
+        if (!_validate) {
+            return false;
+        }
+        GLint actual = 0;
+        glGetIntegerv(binding, &actual);
+        if (GLuint(actual) == expected) {
+            return false;
+        }
+        report(what, expected, GLuint(actual));
+        return true;
+    }
+
+    // querying a texture binding needs the unit active, the active unit is put back afterwards
+    bool staleTexture(GLuint unit, GLenum target, GLuint expected) {
+        if (!_validate) {
+            return false;
+        }
+        GLint activeUnit = 0;
+        GLint actual = 0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glGetIntegerv(TARGET_BINDINGS[targetSlot(target)], &actual);
+        glActiveTexture(GLenum(activeUnit));
+        if (GLuint(actual) == expected) {
+            return false;
+        }
+        report(std::string(target == GL_TEXTURE_2D ? "2D" : "cube map") + " texture on unit " + std::to_string(unit), expected, GLuint(actual));
+        return true;
+    }
+
+    bool staleCapability(GLenum capability, bool expected) {
+        if (!_validate || (glIsEnabled(capability) == GL_TRUE) == expected) {
+            return false;
+        }
+        report(capability == GL_DEPTH_TEST ? "depth test" : capability == GL_BLEND ? "blend" : "cull face", expected, !expected);
+        return true;
+    }
+
+    void report(const std::string& what, GLuint cached, GLuint actual) {
+        _staleCount++;
+        std::cout << "[GLState] stale " << what << ": cache " << cached << ", GL " << actual << std::endl;
+    }
+
+    bool _validate = false;
+
+    GLuint _program;
+    GLuint _vertexArray;
+    GLuint _activeUnit;
+    GLuint _textures[MAX_UNITS][TARGETS];
+    GLuint _drawFramebuffer;
+    GLuint _readFramebuffer;
+    // -1 unknown, 0 off, 1 on
+    int8_t _depthTest;
+    int8_t _blend;
+    int8_t _cullFace;
+    int8_t _depthMask;
+    GLenum _depthFunc;
+    GLenum _blendSrc;
+    GLenum _blendDst;
+
+    size_t _elided = 0;
+    size_t _lastElided = 0;
+    size_t _staleCount = 0;
+};
@@ -6,6 +6,8 @@
 
 #include "Geometry.h"
 
+#include "GLState.h"
+
 #undef min
 #undef max
 
@@ -15,7 +17,7 @@ Geometry::Geometry(glm::mat4 modelMatrix, const GeometryData& data, std::shared_
     , material{material} {
     // create VAO
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    GLState::instance().bindVertexArray(vao);
 
     // create positions VBO
     glGenBuffers(1, &vboPositions);
@@ -56,7 +58,7 @@ Geometry::Geometry(glm::mat4 modelMatrix, const GeometryData& data, std::shared_
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIndices);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), data.indices.data(), GL_STATIC_DRAW);
 
-    glBindVertexArray(0);
+    GLState::instance().bindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
@@ -66,19 +68,18 @@ Geometry::~Geometry() {
     glDeleteBuffers(1, &vboUVs);
     glDeleteBuffers(1, &vboIndices);
     glDeleteVertexArrays(1, &vao);
+    GLState::instance().forgetVertexArray(vao);
 }
 
 void Geometry::draw() {
     Shader* shader = material->getShader();
     shader->use();
 
-    shader->setUniform("modelMatrix", modelMatrix);
-    shader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(modelMatrix))));
+    material->setTransform(modelMatrix);
     material->setUniforms();
 
-    glBindVertexArray(vao);
+    GLState::instance().bindVertexArray(vao);
     glDrawElements(GL_TRIANGLES, elements, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
 }
 glm::mat4 Geometry::getModelMatrix() const {
     return modelMatrix;
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include <algorithm>
+#include <cstring>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include "AssetPack.h"
+#include "Trace.h"
+
+// Read-only Assimp stream over an asset view, so importers parse straight out of the package
+class VfsIOStream : public Assimp::IOStream {
+public:
+    explicit VfsIOStream(AssetView view)
+        : _view(std::move(view)) {}
+
+    size_t Read(void* buffer, size_t size, size_t count) override {
+        if (size == 0) {
+            return 0;
+        }
+        count = std::min(count, (_view.size - _pos) / size);
+        std::memcpy(buffer, _view.data + _pos, size * count);
+        _pos += size * count;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override { return 0; }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override {
+        size_t target = origin == aiOrigin_SET ? offset : origin == aiOrigin_CUR ? _pos + offset : _view.size + offset;
+        if (target > _view.size) {
+            return aiReturn_FAILURE;
+        }
+        _pos = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return _pos; }
+    size_t FileSize() const override { return _view.size; }
+    void Flush() override {}
+
+private:
+    AssetView _view;
+    size_t _pos = 0;
+};
+
+// lets Assimp open the model and everything it references (.mtl files, ...) through the Vfs
+class VfsIOSystem : public Assimp::IOSystem {
+public:
+    bool Exists(const char* file) const override { return Vfs::instance().exists(file); }
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream* Open(const char* file, const char* mode) override {
+        if (std::strchr(mode, 'w') || std::strchr(mode, 'a')) {
+            return nullptr;
+        }
+        AssetView view = Vfs::instance().open(file);
+        return view.empty() ? nullptr : new VfsIOStream(std::move(view));
+    }
+
+    void Close(Assimp::IOStream* file) override { delete file; }
+};
+
+/*!
+ * One Assimp import of a source file, shared by everything that is built from it.
+ * The file is parsed on the first scene() call only, so a Model whose meshes come from the mesh
+ * cache and the animation clips read from the same file still cost a single parse, and a cold
+ * import of meshes and clips never parses twice.
+ */
+class ImportSession {
+public:
+    static const unsigned int defaultFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals;
+
+    /*!
+     * @param path: source file
+     * @param flags: Assimp post-processing steps, files that only provide animation clips can pass 0
+     */
+    explicit ImportSession(const std::string& path, unsigned int flags = defaultFlags)
+        : _path(path)
+        , _flags(flags) {
+        // the importer takes ownership
+        _importer.SetIOHandler(new VfsIOSystem());
+    }
+
+    ImportSession(const ImportSession&) = delete;
+    ImportSession& operator=(const ImportSession&) = delete;
+
+    const std::string& path() const { return _path; }
+    unsigned int flags() const { return _flags; }
+    bool parsed() const { return _parsed; }
+
+    // parses the file on first use, returns nullptr if the import failed
+    const aiScene* scene() {
+        if (!_parsed) {
+            _parsed = true;
+            TRACE_SCOPE("assimp " + _path.substr(_path.find_last_of("/\\") + 1));
+            _scene = _importer.ReadFile(_path, _flags);
+            if (!_scene || _scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !_scene->mRootNode) {
+                std::cout << "ERROR::ASSIMP:: " << _importer.GetErrorString() << std::endl;
+                _scene = nullptr;
+            }
+        }
+        return _scene;
+    }
+
+private:
+    std::string _path;
+    unsigned int _flags;
+    bool _parsed = false;
+    Assimp::Importer _importer;
+    const aiScene* _scene = nullptr;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/*!
+ * Per-instance data of instanced draws in one shader storage buffer, laid out like the Instance
+ * struct of assets/shaders/instances.glsl. A draw passes the index of its first instance as base
+ * instance. GL 4.3 shaders cannot read the base instance, so vertex arrays that take part get an
+ * attribute with divisor 1 over 0, 1, 2, ... (setupIndexAttribute), which yields
+ * base instance + gl_InstanceID.
+ */
+class InstanceBuffer {
+public:
+    static const GLuint BINDING = 2;
+    static constexpr const char* BLOCK_NAME = "Instances";
+    static const GLuint INDEX_LOCATION = 7;
+    // instances the index attribute can address
+    static const uint32_t MAX_INSTANCES = 65536;
+
+    // std430, the normal matrix takes a full mat4 so the struct needs no padding rules
+    struct Instance {
+        glm::mat4 modelMatrix;
+        glm::mat4 normalMatrix;
+        glm::vec4 parameters;
+    };
+    static_assert(sizeof(Instance) == 144, "Instance has to match the std430 layout in instances.glsl");
+
+    InstanceBuffer() {
+        glGenBuffers(1, &_buffer);
+    }
+
+    ~InstanceBuffer() {
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    void begin() {
+        _instances.clear();
+    }
+
+    // @return index of the instance in the buffer
+    uint32_t add(const glm::mat4& modelMatrix, const glm::vec4& parameters) {
+        _instances.push_back({ modelMatrix, glm::mat4(glm::transpose(glm::inverse(glm::mat3(modelMatrix)))), parameters });
+        return uint32_t(_instances.size() - 1);
+    }
+
+    // uploads the instances added since begin() and binds the buffer to BINDING
+    void upload(GLenum usage = GL_STREAM_DRAW) {
+        if (_instances.empty()) {
+            return;
+        }
+        if (_instances.size() > MAX_INSTANCES) {
+            std::cout << "[InstanceBuffer] " << _instances.size() << " instances, only the first " << MAX_INSTANCES << " can be drawn" << std::endl;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _instances.size() * sizeof(Instance), _instances.data(), usage);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        bind();
+    }
+
+    void bind() const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, _buffer);
+    }
+
+    // adds the instance index attribute to the bound vertex array, changes GL_ARRAY_BUFFER
+    static void setupIndexAttribute() {
+        static GLuint indices = createIndices();
+        glBindBuffer(GL_ARRAY_BUFFER, indices);
+        glEnableVertexAttribArray(INDEX_LOCATION);
+        glVertexAttribIPointer(INDEX_LOCATION, 1, GL_UNSIGNED_INT, 0, nullptr);
+        glVertexAttribDivisor(INDEX_LOCATION, 1);
+    }
+
+private:
+    // shared by all vertex arrays, lives as long as the context
+    static GLuint createIndices() {
+        std::vector<uint32_t> indices(MAX_INSTANCES);
+        std::iota(indices.begin(), indices.end(), 0u);
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        return buffer;
+    }
+
+    GLuint _buffer = 0;
+    std::vector<Instance> _instances;
+};
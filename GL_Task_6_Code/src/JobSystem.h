@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Trace.h"
+
+/*!
+ * Small fixed-size thread pool.
+ * Worker jobs must not touch OpenGL; anything that needs the context is pushed onto the
+ * main thread queue with runOnMainThread() and executed by the GL thread in drainMainThread()
+ * or while it blocks in waitIdle().
+ */
+class JobSystem {
+public:
+    explicit JobSystem(unsigned int workerCount = defaultWorkerCount()) {
+        for (unsigned int i = 0; i < workerCount; i++) {
+            _workers.emplace_back([this, i] {
+                Trace::instance().setThreadName("worker " + std::to_string(i));
+                workerLoop();
+            });
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _jobCv.notify_all();
+        for (std::thread& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    static unsigned int defaultWorkerCount() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        // leave one core to the GL thread, which keeps draining uploads meanwhile
+        return std::max(1u, cores > 1 ? cores - 1 : 1u);
+    }
+
+    unsigned int workerCount() const { return static_cast<unsigned int>(_workers.size()); }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+            _pending++;
+        }
+        _jobCv.notify_one();
+    }
+
+    // may be called from any thread, the function is executed on the GL thread
+    void runOnMainThread(std::function<void()> work) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _mainQueue.push_back(std::move(work));
+        }
+        _mainCv.notify_all();
+    }
+
+    // runs all queued main thread work, returns how many items were executed
+    size_t drainMainThread() {
+        std::deque<std::function<void()>> work;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            work.swap(_mainQueue);
+        }
+        for (auto& item : work) {
+            item();
+        }
+        return work.size();
+    }
+
+    // blocks the GL thread until every submitted job finished, executing main thread work as it arrives
+    void waitIdle() {
+        while (true) {
+            drainMainThread();
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_pending == 0 && _mainQueue.empty()) {
+                return;
+            }
+            _mainCv.wait(lock, [this] { return _pending == 0 || !_mainQueue.empty(); });
+        }
+    }
+
+    /*!
+     * Runs fn(i) for every i in [0, count) and returns when all calls finished.
+     * The calling thread takes part in the work, so this may also be used from inside a job.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+        struct Batch {
+            std::mutex mutex;
+            std::condition_variable cv;
+            size_t next = 0;
+            size_t done = 0;
+        };
+        auto batch = std::make_shared<Batch>();
+        auto run = [batch, count, &fn] {
+            while (true) {
+                size_t index;
+                {
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    if (batch->next == count) {
+                        return;
+                    }
+                    index = batch->next++;
+                }
+                fn(index);
+                {
+                    std::lock_guard<std::mutex> lock(batch->mutex);
+                    batch->done++;
+                }
+                batch->cv.notify_all();
+            }
+        };
+
+        size_t helpers = std::min(count - 1, _workers.size());
+        for (size_t i = 0; i < helpers; i++) {
+            submit(run);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->cv.wait(lock, [&] { return batch->done == count; });
+    }
+
+private:
+    void workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _jobCv.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+                if (_stopping && _jobs.empty()) {
+                    return;
+                }
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _pending--;
+            }
+            _mainCv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _jobs;
+    std::deque<std::function<void()>> _mainQueue;
+    std::mutex _mutex;
+    std::condition_variable _jobCv;
+    std::condition_variable _mainCv;
+    size_t _pending = 0;
+    bool _stopping = false;
+};
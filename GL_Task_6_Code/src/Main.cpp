@@ -12,12 +12,24 @@
 #include "Light.h"
 #include "Texture.h"
 #include "Model.h"
+#include "AssetLoader.h"
+#include "AssetPack.h"
 #include <filesystem>
 #include "Skybox.h"
 #include "Player.h"
 #include "ArcCamera.h"
 #include "Geometry.h"
 #include "Animator.h"
+#include "Trace.h"
+#include "TextBatch.h"
+#include "UniformBench.h"
+#include "OcclusionBench.h"
+#include "FrameUniforms.h"
+#include "BonePalette.h"
+#include "RenderQueue.h"
+#include "StaticGeometry.h"
+#include "Pvs.h"
+#include "GLState.h"
 
 #include <filesystem>
 
@@ -51,19 +63,16 @@ static std::string FormatDebugOutput(GLenum source, GLenum type, GLuint id, GLen
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouse_callback(GLFWwindow* window, double xPos, double yPos);
 void scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
-void setPerFrameUniforms(Shader* shader, ArcCamera& camera, DirectionalLight& dirL, PointLight& pointL);
+void setPerFrameUniforms(FrameUniforms& frameUniforms, const glm::mat4& viewProjectionMatrix, const glm::mat4& lightSpaceMatrix, ArcCamera& camera, DirectionalLight& dirL, PointLight& pointL);
 void initPhysics();
 void gameplay(glm::vec3 playerPosition, glm::vec3 key1, glm::vec3 key2, glm::vec3 key3, glm::vec3 key4, glm::vec3 key5, glm::vec3 key6, glm::vec3 key7, glm::vec3 key8);
-void RenderText(std::shared_ptr<Shader> shader, std::string text, float x, float y, float scale, glm::vec3 color);
-void setPBRProperties(Shader* shader, float metallic, float roughness, float ao);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 ImGuiIO setupImGUI(GLFWwindow* window);
 void setupHUD(ImGuiIO io, int keyCounter, int width, int height, int health, GLint splashArt, GLint keyArt, float fps);
 void RenderHUD();
-GLuint LoadTexture(const char* filename);
-unsigned int loadTexture(const char* path, bool gammaCorrection);
 void renderQuad();
 void renderCube();
+std::shared_ptr<Shader> loadShader(const std::string& vertexShader, const std::string& fragmentShader);
 
 
 
@@ -73,6 +82,8 @@ void renderCube();
 
 static bool _wireframe = false;
 static bool _culling = false;
+static bool _frustumCulling = true;
+static bool _occlusionCulling = false;
 
 static bool _draw_normals = false;
 static bool _draw_texcoords = false;
@@ -84,6 +95,8 @@ static float _zoom = 5.0f;
 bool gammaEnabled = false;
 
 ArcCamera camera;
+// potentially visible sets of the maze, baked with --bake-pvs
+Pvs mazePvs;
 bool firstMouse = true;
 static float PI = 3.14159265358979;
 
@@ -130,16 +143,6 @@ PxPvd* gPvd = nullptr;
 
 unsigned int planeVAO;
 
-/// Holds all state information relevant to a character as loaded using FreeType
-struct Character {
-    unsigned int TextureID; // ID handle of the glyph texture
-    glm::ivec2   Size;      // Size of glyph
-    glm::ivec2   Bearing;   // Offset from baseline to left/top of glyph
-    unsigned int Advance;   // Horizontal offset to advance to next glyph
-};
-
-std::map<GLchar, Character> Characters;
-unsigned int VAO, VBO;
 float startTime = 0.0f;
 
 
@@ -149,6 +152,33 @@ float startTime = 0.0f;
 
 int main(int argc, char** argv) {
 
+    // --trace[=file] records the startup timeline, gcgParseArgs does not know the flag
+    Trace::instance().parseArgs(argc, argv);
+    TraceScope startupZone("startup");
+
+    // --pack bundles assets/ into assets.pak next to the executable and exits
+    std::string packPath = (gcgGetExecutableDir() / "assets.pak").string();
+    if (AssetPack::takePackFlag(argc, argv)) {
+        return AssetPack::build(Vfs::instance().assetsDir(), packPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    Vfs::instance().mount(packPath);
+
+    // --bake-pvs computes the potentially visible sets of the maze into maze.pvs and exits
+    if (Pvs::takeBakeFlag(argc, argv)) {
+        JobSystem bakeJobs;
+        return Pvs::bake("assets/geometry/maze/maze.obj", bakeJobs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // --bench-uniforms times the uniform lookup paths once the shaders are loaded
+    bool benchUniforms = UniformBench::takeFlag(argc, argv);
+    // --bench-occlusion compares the culled triangles and CPU cost of the culling paths once the level is built
+    bool benchOcclusion = OcclusionBench::takeFlag(argc, argv);
+
+    // --validate-gl-state checks every skipped GL call against glGet* and logs stale state
+    GLState::instance().setValidation(gcgTakeFlag(argc, argv, "--validate-gl-state"));
+
+    TraceScope settingsZone("settings");
+
     CMDLineArgs cmdline_args;
     gcgParseArgs(cmdline_args, argc, argv);
 
@@ -183,14 +213,20 @@ int main(int argc, char** argv) {
     _draw_normals = renderer_reader.GetBoolean("renderer", "normals", false);
     _draw_texcoords = renderer_reader.GetBoolean("renderer", "texcoords", false);
     bool _depthtest = renderer_reader.GetBoolean("renderer", "depthtest", true);
+    MeshOptimizer::settings().overdraw = renderer_reader.GetBoolean("renderer", "overdraw_sort", false);
+    MeshChunker::settings().chunkSize = float(renderer_reader.GetReal("renderer", "chunk_size", 20.0));
+    _frustumCulling = renderer_reader.GetBoolean("renderer", "frustum_culling", true);
+    _occlusionCulling = renderer_reader.GetBoolean("renderer", "occlusion_culling", false);
 
     glm::mat4 projection = glm::perspective(radians(fov), (float)window_width / (float)window_height, nearZ, farZ);
     glm::mat4 viewProjectionMatrix = mat4(1.0f);
+    settingsZone.end();
 
     /* --------------------------------------------- */
     // Create context
     /* --------------------------------------------- */
 
+    TraceScope contextZone("create context");
     glfwSetErrorCallback([](int error, const char* description) { std::cout << "GLFW error " << error << ": " << description << std::endl; });
 
     if (!glfwInit()) {
@@ -232,6 +268,7 @@ int main(int argc, char** argv) {
         EXIT_WITH_ERROR("Failed to init GLEW: " << glewGetErrorString(err));
     }
     std::cout << "GLEW was initialized." << std::endl;
+    contextZone.end();
 
     // Debug callback
     if (glDebugMessageCallback != NULL) {
@@ -248,6 +285,7 @@ int main(int argc, char** argv) {
     // Init framework
     /* --------------------------------------------- */
 
+    TraceScope frameworkZone("init framework");
     if (!initFramework()) {
         EXIT_WITH_ERROR("Failed to init framework");
     }
@@ -261,23 +299,25 @@ int main(int argc, char** argv) {
 
     // set GL defaults
     glClearColor(1.0, 0.8, 1.0, 1);
-    if (_depthtest) {
-        glEnable(GL_DEPTH_TEST);
-    }
-    else {
-        glDisable(GL_DEPTH_TEST);
-    }
-    if (_culling) {
-        glEnable(GL_CULL_FACE);
-    }
+    GLState& glState = GLState::instance();
+    glState.setEnabled(GL_DEPTH_TEST, _depthtest);
+    glState.setEnabled(GL_CULL_FACE, _culling);
     if (_wireframe) {
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     }
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.setEnabled(GL_BLEND, true);
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // textures get their small mip levels immediately, the rest streams in over the first frames
+    TextureStreamer::instance().init(16 * 1024 * 1024, 2 * 1024 * 1024);
 
-    initPhysics();
+    frameworkZone.end();
+
+    {
+        TRACE_SCOPE("init physics");
+        initPhysics();
+    }
 
     std::deque<float> deltaTimes;
     int frameCount = refresh_rate * 3;
@@ -288,41 +328,37 @@ int main(int argc, char** argv) {
     /* --------------------------------------------- */
     {
         // Load shader(s)
-        std::shared_ptr<Shader> depthShader = std::make_shared<Shader>("assets/shaders/depthShader.vert", "assets/shaders/depthShader.frag");
-        std::shared_ptr<Shader> textureShader = std::make_shared<Shader>("assets/shaders/texture.vert", "assets/shaders/texture.frag");
-        std::shared_ptr<Shader> modelShader = std::make_shared<Shader>("assets/shaders/model.vert", "assets/shaders/model.frag");
-        std::shared_ptr<Shader> sky = std::make_shared<Shader>("assets/shaders/sky.vert", "assets/shaders/sky.frag");
-        std::shared_ptr<Shader> debugDepthQuad = std::make_shared<Shader>("assets/shaders/debugDepthQuad.vert", "assets/shaders/debugDepthQuad.frag");
-        std::shared_ptr<Shader> fontShader = std::make_shared<Shader>("assets/shaders/font.vert", "assets/shaders/font.frag");
-        std::shared_ptr<Shader> pbsShader = std::make_shared<Shader>("assets/shaders/pbs.vert", "assets/shaders/pbs.frag");
-        std::shared_ptr<Shader> skinningShader = std::make_shared<Shader>("assets/shaders/skinning.vert", "assets/shaders/skinning.frag");
-        std::shared_ptr<Shader> puzzleShader = std::make_shared<Shader>("assets/shaders/puzzle.vert", "assets/shaders/puzzle.frag");
-        std::shared_ptr<Shader> hdrShader = std::make_shared<Shader>("assets/shaders/hdr.vert", "assets/shaders/hdr.frag");
-        std::shared_ptr<Shader> lightningShader = std::make_shared<Shader>("assets/shaders/lightning.vert", "assets/shaders/lightning.frag");
-        std::shared_ptr<Shader> blurrShader = std::make_shared<Shader>("assets/shaders/blurr.vert", "assets/shaders/blurr.frag");
+        TraceScope shaderZone("shaders");
+        auto shaderStart = AssetClock::now();
+        std::shared_ptr<Shader> depthShader = loadShader("assets/shaders/depthShader.vert", "assets/shaders/depthShader.frag");
+        std::shared_ptr<Shader> textureShader = loadShader("assets/shaders/texture.vert", "assets/shaders/texture.frag");
+        std::shared_ptr<Shader> modelShader = loadShader("assets/shaders/model.vert", "assets/shaders/model.frag");
+        std::shared_ptr<Shader> sky = loadShader("assets/shaders/sky.vert", "assets/shaders/sky.frag");
+        std::shared_ptr<Shader> debugDepthQuad = loadShader("assets/shaders/debugDepthQuad.vert", "assets/shaders/debugDepthQuad.frag");
+        std::shared_ptr<Shader> fontShader = loadShader("assets/shaders/font.vert", "assets/shaders/font.frag");
+        std::shared_ptr<Shader> pbsShader = loadShader("assets/shaders/pbs.vert", "assets/shaders/pbs.frag");
+        std::shared_ptr<Shader> skinningShader = loadShader("assets/shaders/skinning.vert", "assets/shaders/skinning.frag");
+        std::shared_ptr<Shader> puzzleShader = loadShader("assets/shaders/puzzle.vert", "assets/shaders/puzzle.frag");
+        std::shared_ptr<Shader> hdrShader = loadShader("assets/shaders/hdr.vert", "assets/shaders/hdr.frag");
+        std::shared_ptr<Shader> lightningShader = loadShader("assets/shaders/lightning.vert", "assets/shaders/lightning.frag");
+        std::shared_ptr<Shader> blurrShader = loadShader("assets/shaders/blurr.vert", "assets/shaders/blurr.frag");
+        std::cout << "[ShaderCache] shader setup took " << assetMsSince(shaderStart) << " ms" << std::endl;
+        shaderZone.end();
+        if (benchUniforms) {
+            UniformBench::run(*modelShader);
+        }
 
         // Create textures
+        TraceScope textureZone("textures");
         std::shared_ptr<Texture> fireTexture = std::make_shared<Texture>("assets/textures/fire.dds");
         std::shared_ptr<Texture> torchTexture = std::make_shared<Texture>("assets/textures/torch.dds");
 
         //std::shared_ptr<Texture> keyTexture = std::make_shared<Texture>("assets/textures/gelb.dds");
 
-        DDSImage img = loadDDS(gcgFindTextureFile("assets/textures/Militia-Texture.dds").c_str());
-        GLuint texture3;
-        glGenTextures(1, &texture3);
-        glBindTexture(GL_TEXTURE_2D, texture3);
+        std::shared_ptr<Texture> militiaTexture = std::make_shared<Texture>("assets/textures/Militia-Texture.dds");
+        GLuint texture3 = militiaTexture->getHandle();
 
-        // Transfer image data to GPU
-        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, img.width, img.height, 0, img.size, img.data);
-
-        // Generate mipmaps
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        // Set texture parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        textureZone.end();
 
         // Create materials
         std::shared_ptr<Material> fireTextureMaterial = std::make_shared<TextureMaterial>(lightningShader, glm::vec3(0.1f, 0.7f, 0.1f), 2.0f, fireTexture);
@@ -356,40 +392,56 @@ int main(int argc, char** argv) {
             torchShadow
         );
 
-        string path = gcgFindTextureFile("assets/geometry/maze/maze.obj");
-        Model map(&path[0], gPhysics, gScene, false, false);
-        Skybox skybox;
+        // Models, animations and the cubemap are imported on worker threads, the GL uploads are
+        // executed here on the main thread while the remaining assets are still being decoded
+        TraceScope assetZone("assets");
+        JobSystem jobs;
+        AssetLoader loader(jobs);
 
-        string path1 = gcgFindTextureFile("assets/geometry/podest/podest.obj");
-        Model podest(&path1[0], gPhysics, gScene, false, false);
+        Model map, podest, floor, diamond, adventurer, key, bridge, lava, statue;
+        Animation idle, walk;
 
-        string path2 = gcgFindTextureFile("assets/geometry/floor/floor.obj");
-        Model floor(&path2[0], gPhysics, gScene, false, false);
+        string path = "assets/geometry/maze/maze.obj";
+        loader.load(map, path, false, gPhysics, gScene, false);
+        Skybox skybox(loader);
 
-        string path3 = gcgFindTextureFile("assets/geometry/diamond/diamond.obj");
-        Model diamond(&path3[0], gPhysics, gScene, false, false);
+        string path1 = "assets/geometry/podest/podest.obj";
+        loader.load(podest, path1, false, gPhysics, gScene, false);
 
-        string path4 = gcgFindTextureFile("assets/geometry/adventurer/walk.fbx");
-        Model adventurer(&path4[0], gPhysics, gScene, true, false);
-        Animation idle(path4, &adventurer);
-        Animator idleAnimator(&idle);
+        string path2 = "assets/geometry/floor/floor.obj";
+        loader.load(floor, path2, false, gPhysics, gScene, false);
 
-        string walkPath = gcgFindTextureFile("assets/geometry/adventurer/idle.fbx");
-        Model walkModel(&walkPath[0], false);
-        Animation walk(walkPath, &walkModel);
-        Animator walkAnimator(&walk);
+        string path3 = "assets/geometry/diamond/diamond.obj";
+        loader.load(diamond, path3, false, gPhysics, gScene, false);
+
+        // walk.fbx provides the mesh, skeleton and first clip from a single parse, idle.fbx only
+        // contributes its clip, bound to the same skeleton (both clips run in one job because
+        // binding may add bones to the shared skeleton)
+        string path4 = "assets/geometry/adventurer/walk.fbx";
+        string walkPath = "assets/geometry/adventurer/idle.fbx";
+        loader.load(adventurer, path4, false, gPhysics, gScene, true, [&](ImportSession& session) {
+            idle = Animation(session, adventurer.GetSkeleton());
+            ImportSession clipSession(walkPath, 0);
+            walk = Animation(clipSession, adventurer.GetSkeleton());
+        });
+
+        string path5 = "assets/geometry/key/key.obj";
+        loader.load(key, path5, true, gPhysics, gScene, false);
 
-        string path5 = gcgFindTextureFile("assets/geometry/key/key.obj");
-        Model key(&path5[0], gPhysics, gScene, false, true);
+        string path6 = "assets/geometry/bridge/bridge.obj";
+        loader.load(bridge, path6, false, gPhysics, gScene, false);
 
-        string path6 = gcgFindTextureFile("assets/geometry/bridge/bridge.obj");
-        Model bridge(&path6[0], gPhysics, gScene, false, false);
+        string path7 = "assets/geometry/lava/lava.obj";
+        loader.load(lava, path7, true);
 
-        string path7 = gcgFindTextureFile("assets/geometry/lava/lava.obj");
-        Model lava(&path7[0], true);
+        string path8 = "assets/geometry/statue/statue.obj";
+        loader.load(statue, path8, true);
 
-        string path8 = gcgFindTextureFile("assets/geometry/statue/statue.obj");
-        Model statue(&path8[0], true);
+        loader.finish();
+        assetZone.end();
+
+        Animator idleAnimator(&idle);
+        Animator walkAnimator(&walk);
 
         Player player1 = Player(adventurer, 0.0f, 0.0f, 0.0f, 1.0f, adventurer.getController());
 
@@ -412,6 +464,7 @@ int main(int argc, char** argv) {
 
 
         mat4 viewMatrix = camera.calculateMatrix(camera.getRadius(), camera.getPitch(), camera.getYaw(), player1);
+        camera.updateFrustumPlanes(projection, viewMatrix);
         glm::vec3 camDir = camera.getPos();
 
         glm::mat4 play = glm::mat4(1.0f);
@@ -440,13 +493,14 @@ int main(int argc, char** argv) {
         glm::mat4 fireModel = glm::translate(glm::mat4(1), glm::vec3(0, 2.5, 0));
 
 
+        TraceScope targetZone("render targets");
         const unsigned int SHADOW_WIDTH = 16384, SHADOW_HEIGHT = 8192;
         unsigned int depthMapFBO;
         glGenFramebuffers(1, &depthMapFBO);
         
         unsigned int depthMap;
         glGenTextures(1, &depthMap);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
+        glState.bindTexture(GL_TEXTURE_2D, depthMap);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -455,17 +509,22 @@ int main(int argc, char** argv) {
         float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
         glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
        
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
         glDrawBuffer(GL_NONE);
         glReadBuffer(GL_NONE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         // text rendering
 
 
+        targetZone.end();
+
         // FreeType
         // --------
+        GlyphAtlas fontAtlas;
+        TextBatch textBatch;
+        TraceScope fontZone("font glyphs");
         FT_Library ft;
 
         if (FT_Init_FreeType(&ft))
@@ -475,8 +534,9 @@ int main(int argc, char** argv) {
         }
 
         // find path to font
-        std::string font_name = gcgFindTextureFile("assets/fonts/Rockers_Garage.ttf");
-        if (font_name.empty())
+        // the face reads straight from the view, which has to outlive it
+        AssetView fontFile = Vfs::instance().open("assets/fonts/Rockers_Garage.ttf");
+        if (fontFile.empty())
         {
             std::cout << "ERROR::FREETYPE: Failed to load font_name" << std::endl;
             return -1;
@@ -484,7 +544,7 @@ int main(int argc, char** argv) {
 
         // load font as face
         FT_Face face;
-        if (FT_New_Face(ft, font_name.c_str(), 0, &face)) {
+        if (FT_New_Memory_Face(ft, reinterpret_cast<const FT_Byte*>(fontFile.data), FT_Long(fontFile.size), 0, &face)) {
             std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
             return -1;
         }
@@ -492,74 +552,30 @@ int main(int argc, char** argv) {
             // set size to load glyphs as
             FT_Set_Pixel_Sizes(face, 0, 48);
 
-            // disable byte-alignment restriction
-            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-            // load first 128 characters of ASCII set
-            for (unsigned char c = 0; c < 128; c++)
-            {
-                // Load character glyph 
-                if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-                {
-                    std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-                    continue;
-                }
-                // generate texture
-                unsigned int texture;
-                glGenTextures(1, &texture);
-                glBindTexture(GL_TEXTURE_2D, texture);
-                glTexImage2D(
-                    GL_TEXTURE_2D,
-                    0,
-                    GL_RED,
-                    face->glyph->bitmap.width,
-                    face->glyph->bitmap.rows,
-                    0,
-                    GL_RED,
-                    GL_UNSIGNED_BYTE,
-                    face->glyph->bitmap.buffer
-                );
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                Character character = {
-                    texture,
-                    glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-                    glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-                    static_cast<unsigned int>(face->glyph->advance.x)
-                };
-                Characters.insert(std::pair<char, Character>(c, character));
-            }
-            glBindTexture(GL_TEXTURE_2D, 0);
+            // all ASCII glyphs go into one atlas texture
+            fontAtlas.build(face);
         }
         FT_Done_Face(face);
         FT_Done_FreeType(ft);
+        fontZone.end();
 
 
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        TraceScope bufferZone("text and bloom buffers");
+        textBatch.init(&fontAtlas);
 
         unsigned int hdrFBO;
         glGenFramebuffers(1, &hdrFBO);
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
 
         unsigned int otherBuffer;
         glGenFramebuffers(1, &otherBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, otherBuffer);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, otherBuffer);
         
         unsigned int colorBuffers[2];
         glGenTextures(2, colorBuffers);
         for (unsigned int i = 0; i < 2; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
+            glState.bindTexture(GL_TEXTURE_2D, colorBuffers[i]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, window_width, window_height, 0, GL_RGBA, GL_FLOAT, NULL);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -580,7 +596,7 @@ int main(int argc, char** argv) {
         
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         unsigned int pingpongFBO[2];
         unsigned int pingpongColorbuffers[2];
@@ -588,8 +604,8 @@ int main(int argc, char** argv) {
         glGenTextures(2, pingpongColorbuffers);
         for (unsigned int i = 0; i < 2; i++)
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
+            glState.bindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+            glState.bindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, window_width, window_height, 0, GL_RGBA, GL_FLOAT, NULL);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -600,6 +616,8 @@ int main(int argc, char** argv) {
                 std::cout << "Framebuffer not complete!" << std::endl;
         }
 
+        bufferZone.end();
+
         // colors
         std::vector<glm::vec3> lightColors;
         lightColors.push_back(glm::vec3(5.0f, 5.0f, 5.0f));
@@ -637,26 +655,100 @@ int main(int argc, char** argv) {
         blurrShader->use();
         blurrShader->setUniform("image", 0);
 
+        // camera, lights and shadow matrix for all scene shaders, see assets/shaders/perFrame.glsl
+        FrameUniforms frameUniforms;
+        // bone matrices of the skinned draws, uploaded in one call per frame
+        BonePalette bonePalette;
+
+        // model draws go through the render queue, sorted by pass, program, material and textures
+        RenderQueue renderQueue;
+        Material shadowMaterial(depthShader, glm::vec3(0.0f), 0.0f);
+        Material sceneMaterial(modelShader, materialCoefficients, alpha);
+        PbrMaterial podestMaterial(pbsShader, 0.0f, 0.9f, 0.7f, 0.005f);
+        PbrMaterial statueMaterial(pbsShader, 0.0f, 0.1f, 1.0f, 0.8f);
+        PbrMaterial demoKeyMaterial(pbsShader, 1.0f, 0.4f, 1.0f, 0.007f);
+        PbrMaterial demoMapMaterial(pbsShader, 1.0f, 0.4f, 1.0f, 1.0f);
+        PbrMaterial demoKeyMaterial2(pbsShader, 0.0f, 0.9f, 1.0f, 0.001f);
+        EmissiveMaterial lavaMaterial(lightningShader, lightColors[1], true);
+        EmissiveMaterial diamondMaterial(lightningShader, lightColors[3], true);
+        EmissiveMaterial keyMaterial(lightningShader, lightColors[0], true);
+
+        // handles of the uniforms set per draw, resolved once instead of per call
+        Uniform<glm::mat4> lightningModel = lightningShader->uniform<glm::mat4>("model");
+        Uniform<glm::vec3> lightningLightColor = lightningShader->uniform<glm::vec3>("lightColor");
+        Uniform<int> lightningTex = lightningShader->uniform<int>("tex");
+        Uniform<unsigned int> skinningBoneOffset = skinningShader->uniform<unsigned int>("boneOffset");
+        Uniform<unsigned int> skinningBoneStride = skinningShader->uniform<unsigned int>("boneStride");
+
 
         glm::vec3 lightPos(2.0f, 4.0f, 1.0f);
 
         lightPos *= 10;
 
+        TraceScope hudZone("hud");
         ImGuiIO io = setupImGUI(window);
 
-        string daPath = gcgFindTextureFile("assets/uiPictures/portrait.png");
-        GLuint splashArt = LoadTexture(daPath.c_str());
-        string keyPath = gcgFindTextureFile("assets/uiPictures/key.png");
-        GLuint keyArt = LoadTexture(keyPath.c_str());
+        string daPath = "assets/uiPictures/portrait.png";
+        TextureRef splashArt = TextureRegistry::instance().acquire(daPath, false);
+        string keyPath = "assets/uiPictures/key.png";
+        TextureRef keyArt = TextureRegistry::instance().acquire(keyPath, false);
+        TextureRegistry::instance().printStats();
+        hudZone.end();
 
         glm::mat4 statueModel = glm::mat4(1.0f);
         statueModel = glm::translate(statueModel, glm::vec3(11.0f, 0.0f, 0.0f));
         statueModel = glm::scale(statueModel, glm::vec3(0.025f));
         statueModel = glm::rotate(statueModel, glm::radians(270.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        
+
+        // the level never moves, its meshes share one arena and each pass is a few indirect draws
+        StaticGeometry staticGeometry;
+        glm::mat4 floorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0, -0.15f, 0));
+        glm::mat4 lavaModel = glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(0.45f)), glm::vec3(0, 0, -2.5));
+        map.AddStatic(staticGeometry, RENDER_PASS_SHADOW, shadowMaterial, glm::mat4(1.0f));
+        floor.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, sceneMaterial, floorModel);
+        map.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, sceneMaterial, glm::mat4(1.0f));
+        size_t bridgeObject = bridge.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, sceneMaterial, glm::mat4(1.0f));
+        podest.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, podestMaterial, glm::mat4(1.0f));
+        statue.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, statueMaterial, statueModel);
+        size_t demoMapObject = map.AddStatic(staticGeometry, RENDER_PASS_OPAQUE, demoMapMaterial, glm::mat4(1.0f));
+        lava.AddStatic(staticGeometry, RENDER_PASS_EMISSIVE, lavaMaterial, lavaModel);
+        staticGeometry.build();
+        mazePvs.load(path);
+
+        // the maze walls are rasterized on the workers every frame, for mazes without a baked set
+        OcclusionCuller occlusion;
+        _occlusionCulling = _occlusionCulling || !mazePvs.loaded();
+        if (_occlusionCulling || benchOcclusion) {
+            map.AddOccluders(occlusion, glm::mat4(1.0f));
+            staticGeometry.addOcclusionQueries(occlusion);
+            std::cout << "[OcclusionCuller] " << occlusion.occluderTriangles() << " occluder triangles" << std::endl;
+        }
+        if (benchOcclusion) {
+            staticGeometry.setEnabled(bridgeObject, false);
+            staticGeometry.setEnabled(demoMapObject, false);
+            std::vector<OcclusionBench::Item> items;
+            staticGeometry.forEachDraw(RENDER_PASS_OPAQUE, [&](const glm::vec3& lower, const glm::vec3& upper, size_t triangles) {
+                items.push_back({ lower, upper, triangles });
+            });
+            OcclusionBench::run(occlusion, items, mazePvs, projection, jobs);
+        }
+        const OcclusionCuller* viewOcclusion = _occlusionCulling ? &occlusion : nullptr;
+        renderQueue.setOcclusion(viewOcclusion);
+
+        // the static models only live in the arena from here on, the occluders were read back above
+        for (Model* model : { &map, &floor, &bridge, &podest, &statue, &lava }) {
+            model->ReleaseGpuBuffers();
+        }
+
+        startupZone.end();
+        Trace::instance().write();
 
         while (!glfwWindowShouldClose(window)) {
 
+            // finish assets loaded in the background and continue pending texture uploads
+            jobs.drainMainThread();
+            TextureStreamer::instance().update();
+
             glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -669,7 +761,7 @@ int main(int argc, char** argv) {
             lightSpaceMatrix = lightProjection * lightView;
 
             glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-            glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+            glState.bindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
             glClear(GL_DEPTH_BUFFER_BIT);
             depthShader->use();
             depthShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
@@ -677,18 +769,17 @@ int main(int argc, char** argv) {
             fireShad.draw();
             torchShad.draw();
             player1.Draw(depthShader, camDir, won);
-            depthShader->setUniform("modelMatrix", glm::mat4(1.0f));
-            map.Draw(depthShader);
-
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            // the shadow map has its own level of detail, its texels cover far more of the scene
+            LodView shadowView = LodView::ortho(200.0f, float(SHADOW_HEIGHT), 2.0f);
+            staticGeometry.draw(RENDER_PASS_SHADOW, shadowView);
 
             glViewport(0, 0, window_width, window_height);
 
-            glBindFramebuffer(GL_FRAMEBUFFER, otherBuffer);
+            glState.bindFramebuffer(GL_FRAMEBUFFER, otherBuffer);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
             if (drawHud) {
-                setupHUD(io, keyCounter, window_width, window_height, health, splashArt, keyArt, framerate);
+                setupHUD(io, keyCounter, window_width, window_height, health, splashArt->id(), keyArt->id(), framerate);
             }
 
             if (!won) {
@@ -696,120 +787,60 @@ int main(int argc, char** argv) {
                 viewMatrix = camera.calculateMatrix(camera.getRadius(), camera.getPitch(), camera.getYaw(), player1);
                 camDir = camera.extractCameraDirection(viewMatrix);
                 viewProjectionMatrix = projection * viewMatrix;
+                camera.updateFrustumPlanes(projection, viewMatrix);
             }
+            const Frustum* viewFrustum = _frustumCulling ? &camera.getFrustum() : nullptr;
+            if (viewOcclusion) {
+                occlusion.render(jobs, viewProjectionMatrix);
+            }
+            setPerFrameUniforms(frameUniforms, viewProjectionMatrix, lightSpaceMatrix, camera, dirL, pointL);
 
 
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, depthMap);
+            glState.bindTexture(2, GL_TEXTURE_2D, depthMap);
 
             sky->use();
-            sky->setUniform("viewProjMatrix", viewProjectionMatrix);
             skybox.draw();
 
-            if (drawWalk && !drawIdle) {
+            if (drawWalk != drawIdle) {
+                // the walk flag plays idleAnimator and the idle flag walkAnimator
+                Animator& animator = drawWalk ? idleAnimator : walkAnimator;
+                bonePalette.begin();
+                uint32_t playerBones = bonePalette.add(animator.GetFinalBoneMatrices());
+                animator.UpdateAnimation(dt);
+                bonePalette.upload();
+
                 skinningShader->use();
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, texture3);
-                skinningShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-                skinningShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
+                glState.bindTexture(0, GL_TEXTURE_2D, texture3);
                 skinningShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(play))));
-                setPerFrameUniforms(skinningShader.get(), camera, dirL, pointL);
                 skinningShader->setUniform("materialCoefficients", materialCoefficients);
                 skinningShader->setUniform("specularAlpha", alpha);
-                auto transforms = idleAnimator.GetFinalBoneMatrices();
-                skinningShader->setUniform("gamma", gammaEnabled);
-                idleAnimator.UpdateAnimation(dt);
-                for (int i = 0; i < transforms.size(); ++i)
-                {
-                    skinningShader->setUniform("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-                }
-                player1.Draw(skinningShader, camDir, won);
-            }
-            if (drawIdle && !drawWalk) {
-                skinningShader->use();
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, texture3);
-                skinningShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-                skinningShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
-                skinningShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(play))));
-                setPerFrameUniforms(skinningShader.get(), camera, dirL, pointL);
-                skinningShader->setUniform("materialCoefficients", materialCoefficients);
-                skinningShader->setUniform("specularAlpha", alpha);
-                auto transforms = walkAnimator.GetFinalBoneMatrices();
-                skinningShader->setUniform("gamma", gammaEnabled);
-                walkAnimator.UpdateAnimation(dt);
-                for (int i = 0; i < transforms.size(); ++i)
-                {
-                    skinningShader->setUniform("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-                }
+                skinningShader->set(skinningBoneOffset, playerBones);
+                skinningShader->set(skinningBoneStride, unsigned(animator.GetFinalBoneMatrices().size()));
                 player1.Draw(skinningShader, camDir, won);
             }
 
 
-            modelShader->use();
+            LodView cameraView = LodView::perspective(glm::vec3(glm::inverse(viewMatrix)[3]), glm::radians(fov), float(window_height));
 
-            if (!won) {
-                modelShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-                modelShader->setUniform("materialCoefficients", materialCoefficients);
-                modelShader->setUniform("specularAlpha", alpha);
-                setPerFrameUniforms(modelShader.get(), camera, dirL, pointL);
-                modelShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
-                modelShader->setUniform("gamma", gammaEnabled);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, depthMap);
+            // only the cells the camera cell can see are submitted
+            int cameraCell = mazePvs.cellAt(cameraView.eye);
+            if (mazePvs.loaded()) {
+                mazePvs.recordFrame(cameraCell);
             }
+            staticGeometry.setVisibleCells(mazePvs, cameraCell);
+            renderQueue.setVisibleCells(&mazePvs, cameraCell);
 
-            glm::mat4 floorModel = glm::translate(glm::mat4(1.0f), glm::vec3(0, -0.15f, 0));
-
-            modelShader->setUniform("modelMatrix", floorModel);
-            modelShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(floorModel))));
-            floor.Draw(modelShader);
-            modelShader->setUniform("modelMatrix", glm::mat4(1.0f));
-            modelShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(glm::mat4(1.0f)))));
-            map.Draw(modelShader);
-
-            if (keyCounter >= 4) {
-                modelShader->setUniform("modelMatrix", glm::mat4(1.0f));
-                modelShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(glm::mat4(1.0f)))));
-                bridge.Draw(modelShader);
-            }
-
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, depthMap);
-            pbsShader->use();
-            pbsShader->setUniform("modelMatrix", glm::mat4(1.0f));
-            pbsShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-            pbsShader->setUniform("normalMatrix", glm::mat3(glm::transpose(glm::inverse(play))));
-            pbsShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
-            pbsShader->setUniform("interpolationFactor", 0.005f);
-            setPerFrameUniforms(pbsShader.get(), camera, dirL, pointL);
-            setPBRProperties(pbsShader.get(), 0.0f, 0.9f, 0.7f);
-            podest.Draw(pbsShader);
-            pbsShader->setUniform("modelMatrix", statueModel);
-            pbsShader->setUniform("interpolationFactor", 0.8f);
-            setPBRProperties(pbsShader.get(), 0.0f, 0.1f, 1.0f);
-            statue.Draw(pbsShader);
+            staticGeometry.setEnabled(bridgeObject, keyCounter >= 4);
+            staticGeometry.setEnabled(demoMapObject, pbsDemo);
             if (pbsDemo) {
-                setPBRProperties(pbsShader.get(), 1.0f, 0.4f, 1.0f);
-                pbsShader->setUniform("interpolationFactor", 0.007f);
-                pbsShader->setUniform("modelMatrix", glm::translate(demokey1, vec3(player1.getPosition().x - 1, player1.getPosition().y, player1.getPosition().z)));
-                key.Draw(pbsShader);
-                pbsShader->setUniform("interpolationFactor", 1.0f);
-                pbsShader->setUniform("modelMatrix", glm::mat4(1.0f));
-                map.Draw(pbsShader);
-                pbsShader->setUniform("interpolationFactor", 0.001f);
-                pbsShader->setUniform("modelMatrix", glm::translate(demokey2, vec3(player1.getPosition().x - 1, player1.getPosition().y, player1.getPosition().z + 2)));
-                setPBRProperties(pbsShader.get(), 0.0f, 0.9f, 1.0f);
-                key.Draw(pbsShader);
+                glm::mat4 demoKeyModel = glm::translate(demokey1, vec3(player1.getPosition().x - 1, player1.getPosition().y, player1.getPosition().z));
+                key.Submit(renderQueue, RENDER_PASS_OPAQUE, demoKeyMaterial, cameraView, demoKeyModel);
+                demoKeyModel = glm::translate(demokey2, vec3(player1.getPosition().x - 1, player1.getPosition().y, player1.getPosition().z + 2));
+                key.Submit(renderQueue, RENDER_PASS_OPAQUE, demoKeyMaterial2, cameraView, demoKeyModel);
             }
 
             if (!won) {
-                setPerFrameUniforms(textureShader.get(), camera, dirL, pointL);
-                textureShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-                textureShader->setUniform("lightSpaceMatrix", lightSpaceMatrix);
-                textureShader->setUniform("gamma", gammaEnabled);
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, depthMap);
+                glState.bindTexture(2, GL_TEXTURE_2D, depthMap);
             }
 
             torch.draw();
@@ -821,19 +852,11 @@ int main(int argc, char** argv) {
 
             // finally show all the light sources as bright cubes
             lightningShader->use();
-            lightningShader->setUniform("viewProjMatrix", viewProjectionMatrix);
-
-            glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(0.45f));
-            model = glm::translate(model, glm::vec3(0, 0, -2.5));
-            lightningShader->setUniform("model", model);
-            lightningShader->setUniform("lightColor", lightColors[1]);
-            lightningShader->setUniform("tex", true);
-            lava.Draw(lightningShader);
-
-            model = glm::scale(fireModel, glm::vec3(0.1f, 0.1f, 0.1f));
-            lightningShader->setUniform("lightColor", lightColors[2]);
-            lightningShader->setUniform("tex", true);
-            lightningShader->setUniform("model", model);
+
+            glm::mat4 model = glm::scale(fireModel, glm::vec3(0.1f, 0.1f, 0.1f));
+            lightningShader->set(lightningLightColor, lightColors[2]);
+            lightningShader->set(lightningTex, true);
+            lightningShader->set(lightningModel, model);
             fire.draw();
 
             glm::vec3 firePosition = player1.getPosition() + glm::vec3(0.5f, -1.125f, 0.0f);
@@ -847,82 +870,58 @@ int main(int argc, char** argv) {
             pointL.position = player1.getPosition() + glm::vec3(0.5f, -1.125f, 0.0f);
 
             modelDiamiond = glm::rotate(modelDiamiond, glm::radians(0.1f), glm::vec3(0.0f, 1.0f, 0.0f));
-            lightningShader->setUniform("lightColor", lightColors[3]);
-            lightningShader->setUniform("tex", true);
-            lightningShader->setUniform("model", modelDiamiond);
-            diamond.Draw(lightningShader);
+            diamond.Submit(renderQueue, RENDER_PASS_EMISSIVE, diamondMaterial, cameraView, modelDiamiond);
 
 
             if (keyCounter < 4) {
 
                 glm::mat4 keyModel = glm::translate(mat4(1.0f), key1);
                 if (!key1Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key2);
                 if (!key2Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key3);
                 if (!key3Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key4);
                 if (!key4Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key5);
                 if (!key5Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key6);
                 if (!key6Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key7);
                 if (!key7Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
                 keyModel = glm::translate(mat4(1.0f), key8);
                 if (!key8Found) {
-                    lightningShader->setUniform("model", keyModel);
-                    lightningShader->setUniform("lightColor", lightColors[0]);
-                    lightningShader->setUniform("tex", true);
-                    key.Draw(lightningShader);
+                    key.Submit(renderQueue, RENDER_PASS_EMISSIVE, keyMaterial, cameraView, keyModel);
                 }
             }
-            if (won) {
 
-                glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(window_width), 0.0f, static_cast<float>(window_height));
-                fontShader->use();
-                fontShader->setUniform("projection", projection);
+            // the scene shaders read the shadow map from unit 2, the meshes bind units from 0 up
+            glState.bindTexture(2, GL_TEXTURE_2D, depthMap);
+            staticGeometry.draw(RENDER_PASS_OPAQUE, cameraView, viewFrustum, viewOcclusion);
+            renderQueue.execute(viewFrustum);
+            staticGeometry.draw(RENDER_PASS_EMISSIVE, cameraView, viewFrustum, viewOcclusion);
+
+            if (won) {
                 //glBindFramebuffer(GL_FRAMEBUFFER, 0);
                 //glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
                 //glClear(GL_COLOR_BUFFER_BIT);
                 //glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-                RenderText(fontShader, "You Won!", window_width / 4, window_height / 2.16, 5.0f, glm::vec3(0.5, 0.8f, 0.2f));
+                textBatch.add("You Won!", window_width / 4, window_height / 2.16, 5.0f, glm::vec3(0.5, 0.8f, 0.2f));
 
                 if (startTime == 0.0f) {
 
@@ -938,34 +937,37 @@ int main(int argc, char** argv) {
             }
 
             if (t_sum < 10.0f) {
+                textBatch.add("Collect 4 keys to win.", window_width / 5, window_height / 2.2, 2.5f, glm::vec3(1.0f, 1.0f, 1.0f));
+            }
+
+            // all text of the frame in one draw call
+            if (!textBatch.empty()) {
                 glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(window_width), 0.0f, static_cast<float>(window_height));
                 fontShader->use();
                 fontShader->setUniform("projection", projection);
-                RenderText(fontShader, "Collect 4 keys to win.", window_width / 5, window_height / 2.2, 2.5f, glm::vec3(1.0f, 1.0f, 1.0f));
+                textBatch.draw(fontShader.get());
             }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
             bool horizontal = true, first_iteration = true;
             unsigned int amount = 20;
             blurrShader->use();
             for (unsigned int i = 1; i < amount; i++)
             {
-                glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+                glState.bindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
                 blurrShader->setUniform("horizontal", horizontal);
-                glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
+                glState.bindTexture(0, GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
                 renderQuad();
                 horizontal = !horizontal;
                 if (first_iteration)
                     first_iteration = false;
             }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
 
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             hdrShader->use();
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+            glState.bindTexture(0, GL_TEXTURE_2D, colorBuffers[0]);
+            glState.bindTexture(1, GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
             hdrShader->setUniform("bloom", bloom);
             hdrShader->setUniform("exposure", exposure);
             hdrShader->setUniform("hdr", hdr);
@@ -992,10 +994,11 @@ int main(int argc, char** argv) {
             }
 
             sky->use();
-            sky->setUniform("viewProjMatrix", viewProjectionMatrix);
             skybox.draw();
 
             // Swap buffers
+            RenderStats::instance().endFrame();
+            glState.endFrame();
             glfwSwapBuffers(window);
             glfwPollEvents();
         }
@@ -1011,49 +1014,10 @@ int main(int argc, char** argv) {
 }
 
 
-void RenderText(std::shared_ptr<Shader> shader, std::string text, float x, float y, float scale, glm::vec3 color)
+std::shared_ptr<Shader> loadShader(const std::string& vertexShader, const std::string& fragmentShader)
 {
-    // activate corresponding render state	
-    shader->use();
-    glUniform3f(glGetUniformLocation(shader->getHandle(), "textColor"), color.x, color.y, color.z);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(VAO);
-
-    // iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        float w = ch.Size.x * scale;
-        float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
-
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        x += (ch.Advance >> 6) * scale;
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    TRACE_SCOPE("shader " + vertexShader.substr(vertexShader.find_last_of('/') + 1));
+    return std::make_shared<Shader>(vertexShader, fragmentShader);
 }
 
 void gameplay(glm::vec3 playerPosition, glm::vec3 key1, glm::vec3 key2, glm::vec3 key3, glm::vec3 key4, glm::vec3 key5, glm::vec3 key6, glm::vec3 key7, glm::vec3 key8) {
@@ -1141,7 +1105,7 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        GLState::instance().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -1149,23 +1113,26 @@ void renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::instance().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 
-void setPerFrameUniforms(Shader* shader, ArcCamera& camera, DirectionalLight& dirL, PointLight& pointL) {
-    shader->use();
-    //shader->setUniform("viewProjMatrix", camera.getViewProjectionMatrix());
-    shader->setUniform("camera_world", camera.getPos());
-
-    shader->setUniform("dirL.color", dirL.color);
-    shader->setUniform("dirL.direction", dirL.direction);
-    shader->setUniform("pointL.color", pointL.color);
-    shader->setUniform("pointL.position", pointL.position);
-    shader->setUniform("pointL.attenuation", pointL.attenuation);
-    shader->setUniform("draw_normals", _draw_normals);
-    shader->setUniform("draw_texcoords", _draw_texcoords);
+void setPerFrameUniforms(FrameUniforms& frameUniforms, const glm::mat4& viewProjectionMatrix, const glm::mat4& lightSpaceMatrix, ArcCamera& camera, DirectionalLight& dirL, PointLight& pointL) {
+    FrameUniforms::Block block;
+    block.viewProjMatrix = viewProjectionMatrix;
+    block.lightSpaceMatrix = lightSpaceMatrix;
+    block.cameraWorld = glm::vec4(camera.getPos(), 1.0f);
+
+    block.dirLColor = glm::vec4(dirL.color, 0.0f);
+    block.dirLDirection = glm::vec4(dirL.direction, 0.0f);
+    block.pointLColor = glm::vec4(pointL.color, 0.0f);
+    block.pointLPosition = glm::vec4(pointL.position, 1.0f);
+    block.pointLAttenuation = glm::vec4(pointL.attenuation, 0.0f);
+    block.drawNormals = _draw_normals;
+    block.drawTexcoords = _draw_texcoords;
+    block.gamma = gammaEnabled;
+    block.padding = 0;
+    frameUniforms.update(block);
 }
 
 
@@ -1209,10 +1176,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     case GLFW_KEY_F2:
         if (action == GLFW_PRESS) {
             _culling = !_culling;
-            if (_culling)
-                glEnable(GL_CULL_FACE);
-            else
-                glDisable(GL_CULL_FACE);
+            GLState::instance().setEnabled(GL_CULL_FACE, _culling);
         }
         break;
     case GLFW_KEY_F6:
@@ -1490,12 +1454,6 @@ void initPhysics()
     //gScene->addActor(*groundPlane);
 }
 
-void setPBRProperties(Shader* shader, float metallic, float roughness, float ao) {
-    shader->setUniform("ao", ao);
-    shader->setUniform("roughness", roughness);
-    shader->setUniform("metallic", metallic);
-}
-
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
@@ -1578,6 +1536,19 @@ void setupHUD(ImGuiIO io, int keyCount, int width, int height, int health, GLint
     ImGui::Begin("FPS", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize);
     {
         ImGui::Text("FPS: %.1f", fps);
+        ImGui::Text("Triangles: %zu", RenderStats::instance().triangles());
+        ImGui::Text("Full detail: %zu", RenderStats::instance().fullDetailTriangles());
+        ImGui::Text("Visible meshes: %zu / %zu", RenderStats::instance().visibleMeshes(), RenderStats::instance().totalMeshes());
+        ImGui::Text("Visible triangles: %zu / %zu", RenderStats::instance().visibleTriangles(), RenderStats::instance().totalTriangles());
+        if (mazePvs.loaded()) {
+            ImGui::Text("Maze culled: %.0f%% (average %.0f%%)", mazePvs.culledFraction(mazePvs.cellAt(camera.getPos())) * 100.0f,
+                        mazePvs.runningCulledFraction() * 100.0f);
+        }
+        if (_occlusionCulling) {
+            ImGui::Text("Occluded: %zu meshes, %zu triangles", RenderStats::instance().occludedMeshes(), RenderStats::instance().occludedTriangles());
+        }
+        ImGui::Text("State changes: %zu (unsorted %zu)", RenderStats::instance().stateChanges(), RenderStats::instance().unsortedStateChanges());
+        ImGui::Text("GL calls skipped: %zu", GLState::instance().elidedCalls());
     }
     ImGui::End();
 }
@@ -1587,31 +1558,6 @@ void RenderHUD() {
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
-GLuint LoadTexture(const char* filename) {
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-    if (!data) {
-        std::cerr << "Failed to load texture: " << filename << std::endl;
-        return 0;
-    }
-
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, nrChannels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-
-    return textureID;
-}
-
 unsigned int cubeVAO = 0;
 unsigned int cubeVBO = 0;
 void renderCube()
@@ -1669,7 +1615,7 @@ void renderCube()
         glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState::instance().bindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
@@ -1677,57 +1623,8 @@ void renderCube()
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    GLState::instance().bindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
 }
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path, bool gammaCorrection)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum internalFormat;
-        GLenum dataFormat;
-        if (nrComponents == 1)
-        {
-            internalFormat = dataFormat = GL_RED;
-        }
-        else if (nrComponents == 3)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB : GL_RGB;
-            dataFormat = GL_RGB;
-        }
-        else if (nrComponents == 4)
-        {
-            internalFormat = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-            dataFormat = GL_RGBA;
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
\ No newline at end of file
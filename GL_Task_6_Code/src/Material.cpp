@@ -9,24 +9,52 @@
 // Base material
 /* --------------------------------------------- */
 
+static uint32_t nextMaterialId = 0;
+
 Material::Material(std::shared_ptr<Shader> shader, glm::vec3 color, glm::vec3 materialCoefficients, float alpha)
     : _shader(shader)
     , _color(color)
     , _materialCoefficients(materialCoefficients)
-    , _alpha(alpha) {}
+    , _alpha(alpha)
+    , _materialCoefficientsUniform(shader->uniform<glm::vec3>("materialCoefficients"))
+    , _alphaUniform(shader->uniform<float>("specularAlpha"))
+    , _modelMatrixUniform(shader->uniform<glm::mat4>("modelMatrix"))
+    , _normalMatrixUniform(shader->uniform<glm::mat3>("normalMatrix"))
+    , _instancedUniform(shader->uniform<int>("instanced"))
+    , _id(nextMaterialId++) {}
 
 Material::Material(std::shared_ptr<Shader> shader, glm::vec3 materialCoefficients, float alpha)
     : _shader(shader)
     , _materialCoefficients(materialCoefficients)
-    , _alpha(alpha) {}
+    , _alpha(alpha)
+    , _materialCoefficientsUniform(shader->uniform<glm::vec3>("materialCoefficients"))
+    , _alphaUniform(shader->uniform<float>("specularAlpha"))
+    , _modelMatrixUniform(shader->uniform<glm::mat4>("modelMatrix"))
+    , _normalMatrixUniform(shader->uniform<glm::mat3>("normalMatrix"))
+    , _instancedUniform(shader->uniform<int>("instanced"))
+    , _id(nextMaterialId++) {}
 
 Material::~Material() {}
 
 Shader* Material::getShader() { return _shader.get(); }
 
 void Material::setUniforms() {
-    _shader->setUniform("materialCoefficients", _materialCoefficients);
-    _shader->setUniform("specularAlpha", _alpha);
+    _shader->set(_materialCoefficientsUniform, _materialCoefficients);
+    _shader->set(_alphaUniform, _alpha);
+}
+
+void Material::setTransform(const glm::mat4& modelMatrix) {
+    setInstanced(false);
+    _shader->set(_modelMatrixUniform, modelMatrix);
+    if (_normalMatrixUniform.valid()) {
+        _shader->set(_normalMatrixUniform, glm::mat3(glm::transpose(glm::inverse(modelMatrix))));
+    }
+}
+
+void Material::setInstanced(bool instanced) {
+    if (_instancedUniform.valid()) {
+        _shader->set(_instancedUniform, instanced);
+    }
 }
 
 /* --------------------------------------------- */
@@ -35,7 +63,8 @@ void Material::setUniforms() {
 
 TextureMaterial::TextureMaterial(std::shared_ptr<Shader> shader, glm::vec3 materialCoefficients, float alpha, std::shared_ptr<Texture> diffuseTexture)
     : Material(shader, materialCoefficients, alpha)
-    , _diffuseTexture(diffuseTexture) {}
+    , _diffuseTexture(diffuseTexture)
+    , _diffuseTextureUniform(shader->uniform<int>("diffuseTexture")) {}
 
 TextureMaterial::~TextureMaterial() {}
 
@@ -43,6 +72,50 @@ void TextureMaterial::setUniforms() {
     Material::setUniforms();
 
     _diffuseTexture->bind(0);
-    _shader->setUniform("diffuseTexture", 0);
+    _shader->set(_diffuseTextureUniform, 0);
 }
 
+/* --------------------------------------------- */
+// PBR material
+/* --------------------------------------------- */
+
+PbrMaterial::PbrMaterial(std::shared_ptr<Shader> shader, float metallic, float roughness, float ao, float interpolationFactor)
+    : Material(shader, glm::vec3(0.0f), 0.0f)
+    , _metallic(metallic)
+    , _roughness(roughness)
+    , _ao(ao)
+    , _interpolationFactor(interpolationFactor)
+    , _metallicUniform(shader->uniform<float>("metallic"))
+    , _roughnessUniform(shader->uniform<float>("roughness"))
+    , _aoUniform(shader->uniform<float>("ao"))
+    , _interpolationFactorUniform(shader->uniform<float>("interpolationFactor")) {}
+
+PbrMaterial::~PbrMaterial() {}
+
+void PbrMaterial::setUniforms() {
+    _shader->set(_metallicUniform, _metallic);
+    _shader->set(_roughnessUniform, _roughness);
+    _shader->set(_aoUniform, _ao);
+    _shader->set(_interpolationFactorUniform, _interpolationFactor);
+}
+
+/* --------------------------------------------- */
+// Emissive material
+/* --------------------------------------------- */
+
+EmissiveMaterial::EmissiveMaterial(std::shared_ptr<Shader> shader, glm::vec3 lightColor, bool textured)
+    : Material(shader, glm::vec3(0.0f), 0.0f)
+    , _lightColor(lightColor)
+    , _textured(textured)
+    , _lightColorUniform(shader->uniform<glm::vec3>("lightColor"))
+    , _texturedUniform(shader->uniform<int>("tex")) {
+    // the light source shader computes its normals itself
+    _modelMatrixUniform = shader->uniform<glm::mat4>("model");
+}
+
+EmissiveMaterial::~EmissiveMaterial() {}
+
+void EmissiveMaterial::setUniforms() {
+    _shader->set(_lightColorUniform, _lightColor);
+    _shader->set(_texturedUniform, _textured);
+}
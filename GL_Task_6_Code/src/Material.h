@@ -35,6 +35,20 @@ class Material {
      */
     float _alpha;
 
+    /*!
+     * Uniform handles, resolved once in the constructor
+     */
+    Uniform<glm::vec3> _materialCoefficientsUniform;
+    Uniform<float> _alphaUniform;
+    Uniform<glm::mat4> _modelMatrixUniform;
+    Uniform<glm::mat3> _normalMatrixUniform;
+    Uniform<int> _instancedUniform;
+
+    /*!
+     * Unique id of the material, part of the render queue sort key
+     */
+    uint32_t _id;
+
   public:
     /*!
      * Base material constructor
@@ -59,10 +73,27 @@ class Material {
      */
     Shader* getShader();
 
+    /*!
+     * @return The id of this material, unique among all materials created
+     */
+    uint32_t getId() const { return _id; }
+
     /*!
      * Sets this material's parameters as uniforms in the shader
      */
     virtual void setUniforms();
+
+    /*!
+     * Sets the model matrix (and the normal matrix derived from it) of a draw
+     * @param modelMatrix: model matrix of the object
+     */
+    void setTransform(const glm::mat4& modelMatrix);
+
+    /*!
+     * Switches between the transform of setTransform and the one of the instance buffer
+     * @param instanced: if the following draws read their transforms from the instance buffer
+     */
+    void setInstanced(bool instanced);
 };
 
 
@@ -76,6 +107,11 @@ class TextureMaterial : public Material {
      */
     std::shared_ptr<Texture> _diffuseTexture;
 
+    /*!
+     * Handle of the diffuse texture sampler
+     */
+    Uniform<int> _diffuseTextureUniform;
+
   public:
     /*!
      * Texture material constructor
@@ -94,3 +130,79 @@ class TextureMaterial : public Material {
     virtual void setUniforms();
 };
 
+/*!
+ * Physically based material for the pbs shader
+ */
+class PbrMaterial : public Material {
+  protected:
+    /*!
+     * Metallic, roughness and ambient occlusion factors
+     */
+    float _metallic;
+    float _roughness;
+    float _ao;
+
+    /*!
+     * How much of the environment is reflected
+     */
+    float _interpolationFactor;
+
+    Uniform<float> _metallicUniform;
+    Uniform<float> _roughnessUniform;
+    Uniform<float> _aoUniform;
+    Uniform<float> _interpolationFactorUniform;
+
+  public:
+    /*!
+     * PBR material constructor
+     * @param shader: The shader used for rendering this material
+     * @param metallic: metalness of the surface
+     * @param roughness: roughness of the surface
+     * @param ao: ambient occlusion factor
+     * @param interpolationFactor: how much of the environment is reflected
+     */
+    PbrMaterial(std::shared_ptr<Shader> shader, float metallic, float roughness, float ao, float interpolationFactor);
+
+    virtual ~PbrMaterial();
+
+    /*!
+     * Set's this material's parameters as uniforms in the shader
+     */
+    virtual void setUniforms();
+};
+
+/*!
+ * Self illuminated material for the light source shader
+ */
+class EmissiveMaterial : public Material {
+  protected:
+    /*!
+     * Color the object glows in
+     */
+    glm::vec3 _lightColor;
+
+    /*!
+     * If the diffuse texture is multiplied in
+     */
+    bool _textured;
+
+    Uniform<glm::vec3> _lightColorUniform;
+    Uniform<int> _texturedUniform;
+
+  public:
+    /*!
+     * Emissive material constructor
+     * @param shader: The shader used for rendering this material
+     * @param lightColor: color the object glows in
+     * @param textured: if the diffuse texture is multiplied in
+     */
+    EmissiveMaterial(std::shared_ptr<Shader> shader, glm::vec3 lightColor, bool textured);
+
+    virtual ~EmissiveMaterial();
+
+    /*!
+     * Set's this material's parameters as uniforms in the shader
+     */
+    virtual void setUniforms();
+};
+
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "MeshChunker.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "animData.h"
+#include "mesh.h"
+
+// Baked, memory-mappable copy of everything Model::loadModel pulls out of Assimp.
+//
+// File layout (all blocks 4 byte aligned):
+//   header    magic, version, key, cold import time, mesh count, bone count,
+//             mesh optimizer counters, vertex format counters
+//   per mesh  format flags, vertex count, index count, texture count, lod count, bounding
+//             sphere and box,
+//             texture refs (type, path), lod ranges, packed vertices, packed indices
+//   bones     name, id, offset matrix
+//
+// The key is derived from the source file contents and the Assimp import flags, so editing
+// the source asset or changing the post-processing steps automatically invalidates the entry.
+// The meshes are stored after MeshOptimizer ran, its settings are part of the key as well.
+
+struct MeshTextureRef {
+    std::string type;
+    std::string path;
+};
+
+struct BakedMesh {
+    PackedMesh geometry;
+    std::vector<MeshTextureRef> textures;
+};
+
+struct BakedModel {
+    std::vector<BakedMesh> meshes;
+    std::map<std::string, BoneInfo> boneInfoMap;
+    int boneCount = 0;
+    float coldImportMs = 0.0f;
+    MeshOptimizerStats optimizer;
+    VertexFormatStats formats;
+};
+
+class MeshCache {
+public:
+    static const uint32_t MAGIC = 0x48534D45; // "EMSH"
+    static const uint32_t VERSION = 5;
+
+    // returns 0 if the source file can not be read
+    static uint64_t key(const std::string& sourcePath, unsigned int importFlags) {
+        AssetView source = Vfs::instance().open(sourcePath);
+        if (source.empty()) {
+            return 0;
+        }
+        uint64_t seed = assetHash(&VERSION, sizeof(VERSION));
+        seed = assetHash(&importFlags, sizeof(importFlags), seed);
+        uint32_t overdraw = MeshOptimizer::settings().overdraw ? 1 : 0;
+        seed = assetHash(&overdraw, sizeof(overdraw), seed);
+        float threshold = MeshOptimizer::settings().overdrawThreshold;
+        seed = assetHash(&threshold, sizeof(threshold), seed);
+        float chunkSize = MeshChunker::settings().chunkSize;
+        seed = assetHash(&chunkSize, sizeof(chunkSize), seed);
+        uint32_t vertexSize = sizeof(Vertex);
+        seed = assetHash(&vertexSize, sizeof(vertexSize), seed);
+        return assetHash(source.data, source.size, seed);
+    }
+
+    static bool load(uint64_t key, BakedModel& out) {
+        MappedFile file;
+        if (!file.open(assetCachePath(key, ".mesh"))) {
+            return false;
+        }
+
+        BinaryReader reader(file.data(), file.size());
+        if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION || reader.read<uint64_t>() != key) {
+            std::cout << "[MeshCache] ignoring outdated cache entry " << assetCachePath(key, ".mesh") << std::endl;
+            return false;
+        }
+
+        out.coldImportMs = reader.read<float>();
+        uint32_t meshCount = reader.read<uint32_t>();
+        uint32_t boneCount = reader.read<uint32_t>();
+        out.optimizer = reader.read<MeshOptimizerStats>();
+        out.formats = reader.read<VertexFormatStats>();
+
+        out.meshes.resize(meshCount);
+        for (BakedMesh& mesh : out.meshes) {
+            PackedMesh& geometry = mesh.geometry;
+            geometry.flags = reader.read<uint32_t>();
+            geometry.vertexCount = reader.read<uint32_t>();
+            geometry.indexCount = reader.read<uint32_t>();
+            uint32_t textureCount = reader.read<uint32_t>();
+            uint32_t lodCount = reader.read<uint32_t>();
+            geometry.bounds = reader.read<glm::vec4>();
+            geometry.boxMin = reader.read<glm::vec3>();
+            geometry.boxMax = reader.read<glm::vec3>();
+
+            mesh.textures.resize(textureCount);
+            for (MeshTextureRef& texture : mesh.textures) {
+                texture.type = reader.readString();
+                texture.path = reader.readString();
+            }
+            reader.readArray(geometry.lods, lodCount);
+            reader.readArray(geometry.vertices, size_t(geometry.layout().stride) * geometry.vertexCount);
+            reader.readArray(geometry.indices, geometry.indexSize() * geometry.indexCount);
+        }
+
+        for (uint32_t i = 0; i < boneCount; i++) {
+            std::string name = reader.readString();
+            BoneInfo info;
+            info.id = reader.read<int>();
+            info.offset = reader.read<glm::mat4>();
+            out.boneInfoMap[name] = info;
+        }
+        out.boneCount = static_cast<int>(boneCount);
+
+        bool complete = std::all_of(out.meshes.begin(), out.meshes.end(), [](const BakedMesh& mesh) { return !mesh.geometry.lods.empty(); });
+        if (!reader.ok() || !complete) {
+            std::cout << "[MeshCache] truncated cache entry " << assetCachePath(key, ".mesh") << std::endl;
+            out = BakedModel();
+            return false;
+        }
+        return true;
+    }
+
+    static bool store(uint64_t key, const BakedModel& model) {
+        BinaryWriter writer(assetCachePath(key, ".mesh"));
+        writer.write(MAGIC);
+        writer.write(VERSION);
+        writer.write(key);
+        writer.write(model.coldImportMs);
+        writer.write(static_cast<uint32_t>(model.meshes.size()));
+        writer.write(static_cast<uint32_t>(model.boneInfoMap.size()));
+        writer.write(model.optimizer);
+        writer.write(model.formats);
+
+        for (const BakedMesh& mesh : model.meshes) {
+            writer.write(mesh.geometry.flags);
+            writer.write(mesh.geometry.vertexCount);
+            writer.write(mesh.geometry.indexCount);
+            writer.write(static_cast<uint32_t>(mesh.textures.size()));
+            writer.write(static_cast<uint32_t>(mesh.geometry.lods.size()));
+            writer.write(mesh.geometry.bounds);
+            writer.write(mesh.geometry.boxMin);
+            writer.write(mesh.geometry.boxMax);
+            for (const MeshTextureRef& texture : mesh.textures) {
+                writer.writeString(texture.type);
+                writer.writeString(texture.path);
+            }
+            writer.writeArray(mesh.geometry.lods.data(), mesh.geometry.lods.size());
+            writer.writeArray(mesh.geometry.vertices.data(), mesh.geometry.vertices.size());
+            writer.writeArray(mesh.geometry.indices.data(), mesh.geometry.indices.size());
+        }
+
+        for (const auto& bone : model.boneInfoMap) {
+            writer.writeString(bone.first);
+            writer.write(bone.second.id);
+            writer.write(bone.second.offset);
+        }
+        return writer.commit();
+    }
+};
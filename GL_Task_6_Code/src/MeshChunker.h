@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Import-time split of large static meshes into chunks on a grid over x and z, so the frustum
+// culler can drop the parts of a level that are out of view instead of drawing all of it.
+// Every triangle goes to the cell its centroid lies in. The chunks keep the textures of the
+// mesh and run through MeshOptimizer and MeshSimplifier on their own; the cut edges are open
+// borders, which the simplifier locks, so neighbouring chunks still meet at every level.
+
+struct MeshChunkerSettings {
+    float chunkSize = 20.0f; // cell edge in object space, 0 keeps every mesh whole
+};
+
+class MeshChunker {
+public:
+    struct Chunk {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+    };
+
+    static MeshChunkerSettings& settings() {
+        static MeshChunkerSettings settings;
+        return settings;
+    }
+
+    /*!
+     * @return the non-empty cells of the mesh, or the mesh as the only chunk if it is skinned,
+     *         fits into one cell or splitting is off
+     */
+    static std::vector<Chunk> split(std::vector<Vertex> vertices, std::vector<GLuint> indices) {
+        std::vector<Chunk> chunks;
+        float size = settings().chunkSize;
+        if (size <= 0.0f || vertices.empty() || indices.size() % 3 != 0 || skinned(vertices) || !exceeds(vertices, size)) {
+            chunks.push_back({ std::move(vertices), std::move(indices) });
+            return chunks;
+        }
+
+        // triangles per cell, the map keeps the chunk order stable between imports
+        std::map<std::pair<int, int>, std::vector<size_t>> cells;
+        for (size_t triangle = 0; triangle < indices.size() / 3; triangle++) {
+            glm::vec3 centroid = (vertices[indices[triangle * 3]].Position + vertices[indices[triangle * 3 + 1]].Position
+                                  + vertices[indices[triangle * 3 + 2]].Position) / 3.0f;
+            cells[{ int(std::floor(centroid.x / size)), int(std::floor(centroid.z / size)) }].push_back(triangle);
+        }
+
+        // one remap table for all cells, reset through the vertices a cell touched
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        for (const auto& cell : cells) {
+            Chunk chunk;
+            chunk.indices.reserve(cell.second.size() * 3);
+            for (size_t triangle : cell.second) {
+                for (size_t corner = 0; corner < 3; corner++) {
+                    GLuint index = indices[triangle * 3 + corner];
+                    if (remap[index] == UNUSED) {
+                        remap[index] = GLuint(chunk.vertices.size());
+                        chunk.vertices.push_back(vertices[index]);
+                    }
+                    chunk.indices.push_back(remap[index]);
+                }
+            }
+            for (size_t triangle : cell.second) {
+                for (size_t corner = 0; corner < 3; corner++) {
+                    remap[indices[triangle * 3 + corner]] = UNUSED;
+                }
+            }
+            chunks.push_back(std::move(chunk));
+        }
+        return chunks;
+    }
+
+private:
+    static const GLuint UNUSED = ~0u;
+
+    static bool skinned(const std::vector<Vertex>& vertices) {
+        return std::any_of(vertices.begin(), vertices.end(), [](const Vertex& vertex) { return vertex.m_Weights[0] > 0.0f; });
+    }
+
+    // wider or deeper than a cell
+    static bool exceeds(const std::vector<Vertex>& vertices, float size) {
+        glm::vec3 lower = vertices[0].Position;
+        glm::vec3 upper = vertices[0].Position;
+        for (const Vertex& vertex : vertices) {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+        return upper.x - lower.x > size || upper.z - lower.z > size;
+    }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*!
+ * One level of detail: a range of the mesh's index buffer and the geometric error of the
+ * simplification in object space units (0 for the full detail level)
+ */
+struct MeshLod {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;
+};
+
+/*!
+ * The view a level of detail is picked for. The projected error of a level has to stay below
+ * threshold pixels; pixelsPerUnit is the projection scale at distance 1 for perspective views
+ * and the constant scale of orthographic (shadow) views.
+ */
+struct LodView {
+    glm::vec3 eye = glm::vec3(0.0f);
+    float pixelsPerUnit = 0.0f;
+    bool orthographic = false;
+    float threshold = 1.0f;
+
+    static LodView perspective(const glm::vec3& eye, float fovY, float viewportHeight, float threshold = 1.0f) {
+        return { eye, viewportHeight / (2.0f * glm::tan(fovY * 0.5f)), false, threshold };
+    }
+
+    static LodView ortho(float extent, float resolution, float threshold = 1.0f) {
+        return { glm::vec3(0.0f), resolution / extent, true, threshold };
+    }
+
+    /*!
+     * Coarsest level whose error stays below the threshold
+     * @param bounds: bounding sphere of the mesh in object space (center, radius)
+     */
+    size_t select(const std::vector<MeshLod>& lods, const glm::vec4& bounds, const glm::mat4& model) const {
+        if (lods.size() < 2 || pixelsPerUnit <= 0.0f) {
+            return 0;
+        }
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float pixels = pixelsPerUnit * scale;
+        if (!orthographic) {
+            glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.0f));
+            // the closest point of the sphere counts, inside it the full detail level is used
+            float distance = glm::length(center - eye) - bounds.w * scale;
+            if (distance <= 0.0f) {
+                return 0;
+            }
+            pixels /= distance;
+        }
+        for (size_t i = lods.size() - 1; i > 0; i--) {
+            if (lods[i].error * pixels <= threshold) {
+                return i;
+            }
+        }
+        return 0;
+    }
+};
+
+/*!
+ * Triangles and draw calls submitted through Mesh::Draw, the state changes of the render
+ * queue and what frustum culling let through; the counters of the last complete frame are kept
+ * for display
+ */
+class RenderStats {
+public:
+    static RenderStats& instance() {
+        static RenderStats stats;
+        return stats;
+    }
+
+    void addDraw(size_t triangles, size_t fullDetailTriangles) {
+        _triangles += triangles;
+        _fullDetailTriangles += fullDetailTriangles;
+        _drawCalls++;
+    }
+
+    // program, material, texture and vertex array changes, sorted and in submission order
+    void addStateChanges(size_t changes, size_t unsortedChanges) {
+        _stateChanges += changes;
+        _unsortedStateChanges += unsortedChanges;
+    }
+
+    // meshes and their full detail triangles that were tested against a frustum, and how many passed
+    void addCulling(size_t visibleMeshes, size_t meshes, size_t visibleTriangles, size_t triangles) {
+        _visibleMeshes += visibleMeshes;
+        _culledMeshes += meshes;
+        _visibleCulledTriangles += visibleTriangles;
+        _culledTriangles += triangles;
+    }
+
+    // meshes and their full detail triangles that software occlusion culling removed
+    void addOcclusion(size_t meshes, size_t triangles) {
+        _occludedMeshes += meshes;
+        _occludedTriangles += triangles;
+    }
+
+    void endFrame() {
+        _lastTriangles = _triangles;
+        _lastFullDetailTriangles = _fullDetailTriangles;
+        _lastDrawCalls = _drawCalls;
+        _lastStateChanges = _stateChanges;
+        _lastUnsortedStateChanges = _unsortedStateChanges;
+        _triangles = _fullDetailTriangles = _drawCalls = 0;
+        _stateChanges = _unsortedStateChanges = 0;
+        _lastVisibleMeshes = _visibleMeshes;
+        _lastCulledMeshes = _culledMeshes;
+        _lastVisibleCulledTriangles = _visibleCulledTriangles;
+        _lastCulledTriangles = _culledTriangles;
+        _visibleMeshes = _culledMeshes = _visibleCulledTriangles = _culledTriangles = 0;
+        _lastOccludedMeshes = _occludedMeshes;
+        _lastOccludedTriangles = _occludedTriangles;
+        _occludedMeshes = _occludedTriangles = 0;
+    }
+
+    size_t triangles() const { return _lastTriangles; }
+    // what the same draws would have cost without levels of detail
+    size_t fullDetailTriangles() const { return _lastFullDetailTriangles; }
+    size_t drawCalls() const { return _lastDrawCalls; }
+    size_t stateChanges() const { return _lastStateChanges; }
+    // what the queued draws would have cost without sorting
+    size_t unsortedStateChanges() const { return _lastUnsortedStateChanges; }
+    // of the meshes and triangles that went through frustum culling
+    size_t visibleMeshes() const { return _lastVisibleMeshes; }
+    size_t totalMeshes() const { return _lastCulledMeshes; }
+    size_t visibleTriangles() const { return _lastVisibleCulledTriangles; }
+    size_t totalTriangles() const { return _lastCulledTriangles; }
+    size_t occludedMeshes() const { return _lastOccludedMeshes; }
+    size_t occludedTriangles() const { return _lastOccludedTriangles; }
+
+private:
+    size_t _triangles = 0;
+    size_t _fullDetailTriangles = 0;
+    size_t _drawCalls = 0;
+    size_t _lastTriangles = 0;
+    size_t _lastFullDetailTriangles = 0;
+    size_t _lastDrawCalls = 0;
+    size_t _stateChanges = 0;
+    size_t _unsortedStateChanges = 0;
+    size_t _lastStateChanges = 0;
+    size_t _lastUnsortedStateChanges = 0;
+    size_t _visibleMeshes = 0;
+    size_t _culledMeshes = 0;
+    size_t _visibleCulledTriangles = 0;
+    size_t _culledTriangles = 0;
+    size_t _lastVisibleMeshes = 0;
+    size_t _lastCulledMeshes = 0;
+    size_t _lastVisibleCulledTriangles = 0;
+    size_t _lastCulledTriangles = 0;
+    size_t _occludedMeshes = 0;
+    size_t _occludedTriangles = 0;
+    size_t _lastOccludedMeshes = 0;
+    size_t _lastOccludedTriangles = 0;
+};
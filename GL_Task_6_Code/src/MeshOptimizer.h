@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+#include "mesh.h"
+
+// Import-time mesh optimization, run on every mesh before it is baked into the mesh cache:
+//
+//   weld             merges bit-identical vertices (OBJ files repeat them per face)
+//   vertex cache     reorders triangles for the post-transform cache (Forsyth, "Linear-Speed
+//                    Vertex Cache Optimisation")
+//   overdraw         optional, sorts cache friendly clusters of triangles so outward facing
+//                    ones come first (Sander et al., "Fast Triangle Reordering for Vertex
+//                    Locality and Reduced Overdraw")
+//   vertex fetch     renumbers vertices in the order the index buffer first uses them
+//
+// All steps keep the Vertex layout, so the result goes through the usual Mesh path.
+
+struct MeshOptimizerSettings {
+    bool overdraw = false;          // cluster sort for overdraw, costs a little cache efficiency
+    float overdrawThreshold = 1.05f; // how much worse than the mesh ACMR a cluster may get
+};
+
+/*!
+ * Counters of one or more meshes before and after optimization, ACMR and ATVR are measured
+ * with a FIFO cache of MeshOptimizer::ANALYZE_CACHE_SIZE entries.
+ */
+struct MeshOptimizerStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t triangles = 0;
+    size_t missesBefore = 0;
+    size_t missesAfter = 0;
+
+    // average cache miss ratio, transformed vertices per triangle (0.5 is the ideal for grids)
+    float acmrBefore() const { return triangles ? float(missesBefore) / triangles : 0.0f; }
+    float acmrAfter() const { return triangles ? float(missesAfter) / triangles : 0.0f; }
+    // average transformed to vertex ratio, 1.0 means every vertex is shaded once
+    float atvrBefore() const { return verticesBefore ? float(missesBefore) / verticesBefore : 0.0f; }
+    float atvrAfter() const { return verticesAfter ? float(missesAfter) / verticesAfter : 0.0f; }
+};
+
+class MeshOptimizer {
+public:
+    static const int CACHE_SIZE = 32;
+    static const int ANALYZE_CACHE_SIZE = 16;
+
+    static MeshOptimizerSettings& settings() {
+        static MeshOptimizerSettings settings;
+        return settings;
+    }
+
+    /*!
+     * Runs the whole pipeline on one mesh and adds its counters to stats
+     */
+    static void optimize(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, MeshOptimizerStats& stats) {
+        if (indices.empty() || indices.size() % 3 != 0) {
+            return;
+        }
+        stats.verticesBefore += vertices.size();
+        stats.triangles += indices.size() / 3;
+        stats.missesBefore += cacheMisses(indices, vertices.size());
+
+        weld(vertices, indices);
+        optimizeVertexCache(indices, vertices.size());
+        if (settings().overdraw) {
+            optimizeOverdraw(indices, vertices, settings().overdrawThreshold);
+        }
+        optimizeVertexFetch(vertices, indices);
+
+        stats.verticesAfter += vertices.size();
+        stats.missesAfter += cacheMisses(indices, vertices.size());
+    }
+
+    /*!
+     * Merges vertices whose attributes (bone weights included) are bit-identical
+     */
+    static void weld(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+        const GLuint EMPTY = ~GLuint(0);
+        size_t tableSize = 1;
+        while (tableSize < vertices.size() * 2) {
+            tableSize *= 2;
+        }
+        // open addressing over the indices of the unique vertices
+        std::vector<GLuint> table(tableSize, EMPTY);
+        std::vector<GLuint> remap(vertices.size());
+        std::vector<Vertex> unique;
+        unique.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            size_t slot = size_t(assetHash(&vertices[i], sizeof(Vertex))) & (tableSize - 1);
+            while (table[slot] != EMPTY && std::memcmp(&unique[table[slot]], &vertices[i], sizeof(Vertex)) != 0) {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+            if (table[slot] == EMPTY) {
+                table[slot] = GLuint(unique.size());
+                unique.push_back(vertices[i]);
+            }
+            remap[i] = table[slot];
+        }
+        for (GLuint& index : indices) {
+            index = remap[index];
+        }
+        vertices = std::move(unique);
+    }
+
+    /*!
+     * Greedy triangle reordering: always emits the triangle with the highest score, which rewards
+     * vertices that are still in the simulated LRU cache and vertices with few triangles left
+     */
+    static void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+        size_t triangleCount = indices.size() / 3;
+
+        // triangles per vertex, the live ones are kept at the front of each vertex's range
+        std::vector<uint32_t> remaining(vertexCount, 0);
+        for (GLuint index : indices) {
+            remaining[index]++;
+        }
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] = offsets[v] + remaining[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScores[v] = vertexScore(-1, remaining[v]);
+        }
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<char> emitted(triangleCount, 0);
+        int best = -1;
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+            if (best < 0 || triangleScores[t] > triangleScores[best]) {
+                best = int(t);
+            }
+        }
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        std::vector<GLuint> cache;
+        std::vector<GLuint> nextCache;
+        size_t cursor = 0;
+        while (result.size() < indices.size()) {
+            if (best < 0) {
+                // nothing in the cache touches a live triangle, continue with the next one in input order
+                while (emitted[cursor]) {
+                    cursor++;
+                }
+                best = int(cursor);
+            }
+
+            const GLuint* triangle = &indices[size_t(best) * 3];
+            emitted[best] = 1;
+            result.insert(result.end(), triangle, triangle + 3);
+
+            nextCache.assign(triangle, triangle + 3);
+            for (int k = 0; k < 3; k++) {
+                // drop the triangle from the live range of its vertex
+                GLuint v = triangle[k];
+                uint32_t* first = &adjacency[offsets[v]];
+                uint32_t* last = first + remaining[v];
+                std::swap(*std::find(first, last, uint32_t(best)), *(last - 1));
+                remaining[v]--;
+            }
+            for (GLuint v : cache) {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                    nextCache.push_back(v);
+                }
+            }
+
+            // rescore everything that moved in or out of the cache along with its triangles
+            for (size_t i = 0; i < nextCache.size(); i++) {
+                GLuint v = nextCache[i];
+                cachePosition[v] = i < CACHE_SIZE ? int(i) : -1;
+                float score = vertexScore(cachePosition[v], remaining[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+                    triangleScores[adjacency[j]] += delta;
+                }
+            }
+            if (nextCache.size() > CACHE_SIZE) {
+                nextCache.resize(CACHE_SIZE);
+            }
+            std::swap(cache, nextCache);
+
+            best = -1;
+            for (GLuint v : cache) {
+                for (uint32_t j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+                    uint32_t t = adjacency[j];
+                    if (best < 0 || triangleScores[t] > triangleScores[best]) {
+                        best = int(t);
+                    }
+                }
+            }
+        }
+        indices = std::move(result);
+    }
+
+    /*!
+     * Splits the (cache optimized) triangle order into clusters at points where the cache restarts
+     * anyway, or where a cluster is still within threshold of the mesh ACMR, and draws the clusters
+     * that face away from the mesh center first
+     */
+    static void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold) {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<int> misses = triangleMisses(indices, vertices.size(), CACHE_SIZE);
+        float meshAcmr = float(std::accumulate(misses.begin(), misses.end(), 0)) / triangleCount;
+
+        std::vector<size_t> clusters;
+        size_t clusterMisses = 0;
+        size_t clusterStart = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            bool hardBoundary = misses[t] == 3 && t > clusterStart;
+            bool softBoundary = t > clusterStart && float(clusterMisses) / (t - clusterStart) <= meshAcmr * threshold
+                && misses[t] > 1;
+            if (t == 0 || hardBoundary || softBoundary) {
+                clusters.push_back(t);
+                clusterStart = t;
+                clusterMisses = 0;
+            }
+            clusterMisses += misses[t];
+        }
+        if (clusters.size() < 2) {
+            return;
+        }
+        clusters.push_back(triangleCount);
+
+        glm::vec3 meshCenter(0.0f);
+        for (const Vertex& vertex : vertices) {
+            meshCenter += vertex.Position;
+        }
+        meshCenter /= float(vertices.size());
+
+        struct Cluster {
+            size_t begin;
+            size_t end;
+            float sortKey;
+        };
+        std::vector<Cluster> sorted;
+        for (size_t c = 0; c + 1 < clusters.size(); c++) {
+            glm::vec3 center(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                const glm::vec3& a = vertices[indices[t * 3]].Position;
+                const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 cross = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(cross);
+                center += (a + b + d) * (triangleArea / 3.0f);
+                normal += cross;
+                area += triangleArea;
+            }
+            center = area > 0.0f ? center / area : vertices[indices[clusters[c] * 3]].Position;
+            float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            sorted.push_back({ clusters[c], clusters[c + 1], glm::dot(center - meshCenter, normal) });
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (const Cluster& cluster : sorted) {
+            result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+        }
+        indices = std::move(result);
+    }
+
+    /*!
+     * Renumbers the vertices in first use order, so the vertex fetch walks the buffer linearly;
+     * vertices no index refers to are dropped
+     */
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+        const GLuint UNUSED = ~GLuint(0);
+        std::vector<GLuint> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (GLuint& index : indices) {
+            if (remap[index] == UNUSED) {
+                remap[index] = GLuint(ordered.size());
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices = std::move(ordered);
+    }
+
+    // transformed vertices of the index buffer in a FIFO cache of ANALYZE_CACHE_SIZE entries
+    static size_t cacheMisses(const std::vector<GLuint>& indices, size_t vertexCount) {
+        std::vector<int> misses = triangleMisses(indices, vertexCount, ANALYZE_CACHE_SIZE);
+        return size_t(std::accumulate(misses.begin(), misses.end(), 0));
+    }
+
+private:
+    // Forsyth's scoring, the last triangle's vertices get a fixed score so they are not favoured too much
+    static float vertexScore(int cachePosition, uint32_t remaining) {
+        if (remaining == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                score = 0.75f;
+            } else {
+                score = std::pow(1.0f - float(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        return score + 2.0f / std::sqrt(float(remaining));
+    }
+
+    // misses per triangle in a FIFO cache
+    static std::vector<int> triangleMisses(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize) {
+        std::vector<int> misses(indices.size() / 3, 0);
+        // a vertex is cached while fewer than cacheSize misses happened since its own
+        std::vector<size_t> stamp(vertexCount, 0);
+        size_t time = cacheSize + 1;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                GLuint v = indices[i + k];
+                if (time - stamp[v] > size_t(cacheSize)) {
+                    stamp[v] = time++;
+                    misses[i / 3]++;
+                }
+            }
+        }
+        return misses;
+    }
+};
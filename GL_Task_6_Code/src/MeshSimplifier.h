@@ -0,0 +1,347 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "MeshLod.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+
+// Import-time level of detail generation by edge collapse (Garland and Heckbert, "Simplifying
+// Surfaces with Color and Texture using Quadric Error Metrics").
+//
+// Every vertex is a point in 8 dimensions: position, normal and uv, the attributes scaled by a
+// weight relative to the mesh radius. Each triangle contributes the quadric of its plane in that
+// space, so a collapse is charged for moving geometry as well as for smearing normals and uvs.
+// Vertices are only ever collapsed onto existing ones, all levels share one vertex buffer and each
+// level is just another index list. Vertices on open borders and on attribute seams (the same
+// position split into several vertices) stay where they are, so there are no cracks.
+
+class MeshSimplifier {
+public:
+    static const int MAX_LODS = 4;
+    // attribute weights relative to the mesh radius
+    static constexpr float NORMAL_WEIGHT = 0.1f;
+    static constexpr float UV_WEIGHT = 0.1f;
+    // no level may deviate more than this from the source, relative to the mesh radius
+    static constexpr float MAX_ERROR = 0.05f;
+    // a level has to drop at least this share of the triangles of the previous one
+    static constexpr float MIN_REDUCTION = 0.2f;
+
+    struct Level {
+        std::vector<GLuint> indices;
+        float error;
+    };
+
+    /*!
+     * Builds up to MAX_LODS levels, each with about half the triangles of the previous one. The
+     * first level is the input itself; the others are ordered for the vertex cache.
+     */
+    static std::vector<Level> buildLods(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+        std::vector<Level> levels;
+        levels.push_back({ indices, 0.0f });
+        if (indices.size() < 3 * MIN_TRIANGLES) {
+            return levels;
+        }
+
+        MeshSimplifier simplifier(vertices, indices);
+        for (int level = 1; level < MAX_LODS; level++) {
+            const std::vector<GLuint>& previous = levels.back().indices;
+            size_t target = previous.size() / 6 * 3;
+            Level next{ previous, levels.back().error };
+            simplifier.simplify(next.indices, target, next.error);
+            if (next.indices.size() > previous.size() * (1.0f - MIN_REDUCTION)) {
+                break;
+            }
+            MeshOptimizer::optimizeVertexCache(next.indices, vertices.size());
+            levels.push_back(std::move(next));
+        }
+        return levels;
+    }
+
+private:
+    static const int DIMENSIONS = 8;
+    static const size_t MIN_TRIANGLES = 64;
+
+    // symmetric matrix as upper triangle, error(x) = x^T A x + 2 b.x + c, weighted by triangle area
+    struct Quadric {
+        double a[DIMENSIONS * (DIMENSIONS + 1) / 2] = {};
+        double b[DIMENSIONS] = {};
+        double c = 0.0;
+        double weight = 0.0;
+
+        void add(const Quadric& other) {
+            for (int i = 0; i < DIMENSIONS * (DIMENSIONS + 1) / 2; i++) {
+                a[i] += other.a[i];
+            }
+            for (int i = 0; i < DIMENSIONS; i++) {
+                b[i] += other.b[i];
+            }
+            c += other.c;
+            weight += other.weight;
+        }
+
+        double error(const double* x) const {
+            double result = c;
+            int k = 0;
+            for (int i = 0; i < DIMENSIONS; i++) {
+                result += 2.0 * b[i] * x[i] + a[k++] * x[i] * x[i];
+                for (int j = i + 1; j < DIMENSIONS; j++) {
+                    result += 2.0 * a[k++] * x[i] * x[j];
+                }
+            }
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double cost;
+    };
+
+    MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+        : _vertices(vertices)
+        , _points(vertices.size() * DIMENSIONS)
+        , _quadrics(vertices.size())
+        , _locked(vertices.size(), 0) {
+        glm::vec4 bounds = VertexFormat::boundingSphere(vertices);
+        _radius = std::max(bounds.w, 1e-6f);
+        for (size_t v = 0; v < vertices.size(); v++) {
+            double* point = &_points[v * DIMENSIONS];
+            const Vertex& vertex = vertices[v];
+            for (int i = 0; i < 3; i++) {
+                point[i] = vertex.Position[i];
+                point[3 + i] = vertex.Normal[i] * NORMAL_WEIGHT * _radius;
+            }
+            point[6] = vertex.TexCoords.x * UV_WEIGHT * _radius;
+            point[7] = vertex.TexCoords.y * UV_WEIGHT * _radius;
+        }
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            addTriangleQuadric(indices[t], indices[t + 1], indices[t + 2]);
+        }
+        lockBordersAndSeams(indices);
+    }
+
+    void addTriangleQuadric(GLuint i0, GLuint i1, GLuint i2) {
+        const double* p = &_points[i0 * DIMENSIONS];
+        const double* q = &_points[i1 * DIMENSIONS];
+        const double* r = &_points[i2 * DIMENSIONS];
+
+        // orthonormal basis of the triangle's plane in attribute space
+        double e1[DIMENSIONS];
+        double e2[DIMENSIONS];
+        for (int i = 0; i < DIMENSIONS; i++) {
+            e1[i] = q[i] - p[i];
+            e2[i] = r[i] - p[i];
+        }
+        if (!normalize(e1)) {
+            return;
+        }
+        double projection = dot(e1, e2);
+        for (int i = 0; i < DIMENSIONS; i++) {
+            e2[i] -= projection * e1[i];
+        }
+        if (!normalize(e2)) {
+            return;
+        }
+
+        glm::vec3 a = _vertices[i0].Position;
+        float area = 0.5f * glm::length(glm::cross(_vertices[i1].Position - a, _vertices[i2].Position - a));
+        double pe1 = dot(p, e1);
+        double pe2 = dot(p, e2);
+
+        Quadric quadric;
+        int k = 0;
+        for (int i = 0; i < DIMENSIONS; i++) {
+            for (int j = i; j < DIMENSIONS; j++) {
+                quadric.a[k++] = area * ((i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j]);
+            }
+            quadric.b[i] = area * (pe1 * e1[i] + pe2 * e2[i] - p[i]);
+        }
+        quadric.c = area * (dot(p, p) - pe1 * pe1 - pe2 * pe2);
+        quadric.weight = area;
+        _quadrics[i0].add(quadric);
+        _quadrics[i1].add(quadric);
+        _quadrics[i2].add(quadric);
+    }
+
+    void lockBordersAndSeams(const std::vector<GLuint>& indices) {
+        // an edge used by a single triangle is on the border
+        std::unordered_map<uint64_t, int> edges;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                edges[edgeKey(indices[t + k], indices[t + (k + 1) % 3])]++;
+            }
+        }
+        for (const auto& edge : edges) {
+            if (edge.second == 1) {
+                _locked[GLuint(edge.first >> 32)] = 1;
+                _locked[GLuint(edge.first & 0xFFFFFFFF)] = 1;
+            }
+        }
+
+        // positions shared by more than one vertex are attribute seams
+        std::unordered_map<uint64_t, GLuint> positions;
+        for (size_t v = 0; v < _vertices.size(); v++) {
+            uint64_t hash = assetHash(&_vertices[v].Position, sizeof(glm::vec3));
+            auto inserted = positions.emplace(hash, GLuint(v));
+            if (!inserted.second && _vertices[inserted.first->second].Position == _vertices[v].Position) {
+                _locked[v] = 1;
+                _locked[inserted.first->second] = 1;
+            }
+        }
+    }
+
+    /*!
+     * Collapses edges, cheapest first, until the index list is down to target or the next collapse
+     * would exceed MAX_ERROR
+     * @param error: largest error of the mesh so far, updated
+     */
+    void simplify(std::vector<GLuint>& indices, size_t target, float& error) {
+        double maxCost = double(MAX_ERROR) * _radius * MAX_ERROR * _radius;
+        std::vector<GLuint> remap(_vertices.size());
+        std::vector<char> touched(_vertices.size());
+        while (indices.size() > target) {
+            buildAdjacency(indices);
+
+            std::vector<Collapse> collapses;
+            collapses.reserve(indices.size() * 2);
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = indices[t + k];
+                    GLuint b = indices[t + (k + 1) % 3];
+                    if (!_locked[a]) {
+                        collapses.push_back({ a, b, collapseCost(a, b) });
+                    }
+                    if (!_locked[b]) {
+                        collapses.push_back({ b, a, collapseCost(b, a) });
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+            // collapses of one pass must not share triangles, so they can not undo each other's checks
+            size_t budget = std::max<size_t>((indices.size() - target) / 6, 1);
+            size_t performed = 0;
+            std::iota(remap.begin(), remap.end(), GLuint(0));
+            std::fill(touched.begin(), touched.end(), 0);
+            for (const Collapse& collapse : collapses) {
+                if (performed >= budget || collapse.cost > maxCost) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to] || flips(collapse, indices)) {
+                    continue;
+                }
+                for (uint32_t j = _offsets[collapse.from]; j < _offsets[collapse.from + 1]; j++) {
+                    size_t t = size_t(_adjacency[j]) * 3;
+                    touched[indices[t]] = touched[indices[t + 1]] = touched[indices[t + 2]] = 1;
+                }
+                remap[collapse.from] = collapse.to;
+                _quadrics[collapse.to].add(_quadrics[collapse.from]);
+                error = std::max(error, float(std::sqrt(collapse.cost)));
+                performed++;
+            }
+            if (performed == 0) {
+                break;
+            }
+
+            // drop the triangles that became degenerate
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                GLuint a = remap[indices[t]];
+                GLuint b = remap[indices[t + 1]];
+                GLuint c = remap[indices[t + 2]];
+                if (a != b && b != c && a != c) {
+                    indices[kept++] = a;
+                    indices[kept++] = b;
+                    indices[kept++] = c;
+                }
+            }
+            indices.resize(kept);
+        }
+    }
+
+    // squared distance in attribute space, averaged over the area of the planes involved
+    double collapseCost(GLuint from, GLuint to) const {
+        const double* x = &_points[to * DIMENSIONS];
+        double weight = std::max(_quadrics[from].weight + _quadrics[to].weight, 1e-12);
+        return (_quadrics[from].error(x) + _quadrics[to].error(x)) / weight;
+    }
+
+    // true if moving from onto to turns any of the remaining triangles around from over
+    bool flips(const Collapse& collapse, const std::vector<GLuint>& indices) const {
+        for (uint32_t j = _offsets[collapse.from]; j < _offsets[collapse.from + 1]; j++) {
+            const GLuint* triangle = &indices[size_t(_adjacency[j]) * 3];
+            if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                continue;
+            }
+            glm::vec3 before[3];
+            glm::vec3 after[3];
+            for (int k = 0; k < 3; k++) {
+                before[k] = _vertices[triangle[k]].Position;
+                after[k] = triangle[k] == collapse.from ? _vertices[collapse.to].Position : before[k];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // triangles around each vertex
+    void buildAdjacency(const std::vector<GLuint>& indices) {
+        _offsets.assign(_vertices.size() + 1, 0);
+        for (GLuint index : indices) {
+            _offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < _vertices.size(); v++) {
+            _offsets[v + 1] += _offsets[v];
+        }
+        _adjacency.resize(indices.size());
+        std::vector<uint32_t> fill(_offsets.begin(), _offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++) {
+            _adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    static uint64_t edgeKey(GLuint a, GLuint b) {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    static double dot(const double* x, const double* y) {
+        double result = 0.0;
+        for (int i = 0; i < DIMENSIONS; i++) {
+            result += x[i] * y[i];
+        }
+        return result;
+    }
+
+    static bool normalize(double* x) {
+        double length = std::sqrt(dot(x, x));
+        if (length < 1e-12) {
+            return false;
+        }
+        for (int i = 0; i < DIMENSIONS; i++) {
+            x[i] /= length;
+        }
+        return true;
+    }
+
+    const std::vector<Vertex>& _vertices;
+    std::vector<double> _points;
+    std::vector<Quadric> _quadrics;
+    std::vector<char> _locked;
+    std::vector<uint32_t> _offsets;
+    std::vector<uint32_t> _adjacency;
+    float _radius = 1.0f;
+};
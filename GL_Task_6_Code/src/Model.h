@@ -8,6 +8,8 @@
 #include <map>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <iomanip>
 
 #include "Shader.h"
 #include "Mesh.h"
@@ -20,6 +22,18 @@
 #include "characterkinematic/PxControllerManager.h"
 #include <cstring>
 #include "animData.h"
+#include "MeshCache.h"
+#include "MeshChunker.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "StaticGeometry.h"
+#include "ImportSession.h"
+#include "CollisionCache.h"
+#include "JobSystem.h"
+#include "TextureRegistry.h"
+#include "Trace.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -41,18 +55,102 @@ public:
 
     Model(GLchar* path, bool gamma)
     {
-        this->loadModel(path, gamma);
+        this->import(path, gamma);
+        this->finalize(nullptr, nullptr, false);
     }
 
     Model(GLchar* path, PxPhysics* physics, PxScene* scene, bool isDynamic, bool gamma) {
-        this->loadModel(path, gamma);
-        this->initPhysics(physics, scene, isDynamic);
+        this->import(path, gamma);
+        if (!isDynamic) {
+            this->cookCollision(physics);
+        }
+        this->finalize(physics, scene, isDynamic);
     }
 
     Model() {
 
     }
 
+    // CPU half of loading (mesh import or cache read, texture decoding). Makes no GL calls,
+    // so it may run on a worker thread; finalize() has to follow on the GL thread.
+    bool import(const string& path, bool gamma)
+    {
+        ImportSession session(path);
+        return import(session, gamma);
+    }
+
+    // same as above, but reuses the parse of a session that also feeds the animation clips
+    bool import(ImportSession& session, bool gamma)
+    {
+        this->gamma = gamma;
+        if (!loadModel(session)) {
+            return false;
+        }
+        // the registry hands out one shared texture per image, no matter how many meshes or models use it
+        pendingTextures.resize(pending.meshes.size());
+        for (size_t i = 0; i < pending.meshes.size(); i++)
+        {
+            for (const MeshTextureRef& ref : pending.meshes[i].textures)
+            {
+                pendingTextures[i].push_back(TextureRegistry::instance().acquire(this->directory + '/' + ref.path, this->gamma));
+            }
+        }
+        return true;
+    }
+
+    // cooks (or loads the cooked) collision meshes of the imported data, worker safe;
+    // with a job system the meshes of the model are cooked in parallel
+    void cookCollision(PxPhysics* physics, JobSystem* jobs = nullptr)
+    {
+        this->physics = physics;
+        TRACE_SCOPE("collision " + name);
+        auto start = AssetClock::now();
+        size_t count = pending.meshes.size();
+        cookedMeshes.assign(count, nullptr);
+        vector<char> cooked(count, 0);
+
+        auto cook = [&](size_t i) {
+            TRACE_SCOPE("cook mesh " + std::to_string(i));
+            bool wasCooked = false;
+            cookedMeshes[i] = CollisionCache::create(physics, pending.meshes[i].geometry, wasCooked);
+            cooked[i] = wasCooked;
+        };
+        if (jobs) {
+            jobs->parallelFor(count, cook);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                cook(i);
+            }
+        }
+
+        size_t cookedCount = std::count(cooked.begin(), cooked.end(), 1);
+        cout << "[CollisionCache] " << name << ": " << count << " meshes (" << cookedCount << " cooked, "
+             << count - cookedCount << " from cache) in " << assetMsSince(start) << " ms" << endl;
+    }
+
+    // uploads meshes and textures and inserts the physics actors, GL thread only
+    void finalize(PxPhysics* physics, PxScene* scene, bool isDynamic)
+    {
+        TRACE_SCOPE("finalize " + name);
+        // the collision meshes are cooked from the packed data, which is dropped once uploaded
+        if (physics && scene && !isDynamic && cookedMeshes.size() != pending.meshes.size()) {
+            cookCollision(physics);
+        }
+        for (size_t i = 0; i < pending.meshes.size(); i++)
+        {
+            BakedMesh& mesh = pending.meshes[i];
+            vector<Text> textures = loadMaterialTextures(mesh.textures, pendingTextures[i]);
+            meshes.push_back(Mesh(mesh.geometry, std::move(textures)));
+        }
+        pending.meshes.clear();
+        pendingTextures.clear();
+
+        if (physics && scene) {
+            this->initPhysics(physics, scene, isDynamic);
+        }
+        cookedMeshes.clear();
+    }
+
     void Draw(std::shared_ptr<Shader> shader)
     {
         for (GLuint i = 0; i < this->meshes.size(); i++)
@@ -61,14 +159,71 @@ public:
         }
     }
 
-    auto& GetBoneInfoMap() { return m_BoneInfoMap; }
-    int& GetBoneCount() { return m_BoneCounter; }
+    // draws each mesh at the level of detail its projected error allows from view, skipping meshes outside frustum
+    void Draw(std::shared_ptr<Shader> shader, const LodView& view, const glm::mat4& modelMatrix, const Frustum* frustum = nullptr)
+    {
+        if (frustum)
+        {
+            this->culler.clear();
+            for (const Mesh& mesh : this->meshes)
+            {
+                this->culler.add(mesh.Bounds(), mesh.BoxMin(), mesh.BoxMax(), modelMatrix);
+            }
+            this->culler.cull(*frustum, this->visible);
+        }
+        for (GLuint i = 0; i < this->meshes.size(); i++)
+        {
+            if (!frustum || this->visible[i])
+            {
+                this->meshes[i].Draw(shader, this->meshes[i].selectLod(view, modelMatrix));
+            }
+        }
+    }
+
+    // queues each mesh, the queue picks the level of detail for view and draws copies that share a material instanced
+    void Submit(RenderQueue& queue, RenderPass pass, Material& material, const LodView& view, const glm::mat4& modelMatrix,
+                const glm::vec4& parameters = glm::vec4(1.0f))
+    {
+        for (const Mesh& mesh : this->meshes)
+        {
+            queue.submit(pass, mesh, material, modelMatrix, view, parameters);
+        }
+    }
+
+    // adds the meshes to the static geometry of a pass, @return object id for StaticGeometry::setEnabled
+    size_t AddStatic(StaticGeometry& statics, RenderPass pass, Material& material, const glm::mat4& modelMatrix) const
+    {
+        return statics.add(pass, this->meshes, material, modelMatrix);
+    }
+
+    // the walls of the meshes become occluders of the software occlusion culler
+    void AddOccluders(OcclusionCuller& occlusion, const glm::mat4& modelMatrix) const
+    {
+        for (const Mesh& mesh : this->meshes)
+        {
+            occlusion.addOccluders(mesh, modelMatrix);
+        }
+    }
+
+    // frees the GL buffers of meshes that were copied into a StaticGeometry and are not drawn themselves
+    void ReleaseGpuBuffers()
+    {
+        for (Mesh& mesh : this->meshes)
+        {
+            mesh.ReleaseGpuBuffers();
+        }
+    }
+
+    auto& GetBoneInfoMap() { return skeleton->boneInfoMap; }
+    int& GetBoneCount() { return skeleton->boneCount; }
+    std::shared_ptr<Skeleton> GetSkeleton() { return skeleton; }
 
 private:
 
     vector<Mesh> meshes;
     string directory;
-    vector<Text> textures_loaded;
+    string name;
+    vector<TextureRef> textures_loaded;
     PxPhysics* physics;
     PxScene* scene;
     vector<PxRigidStatic*> physxActors;
@@ -76,8 +231,14 @@ private:
     PxController* controller;
     PxConvexMeshCookingResult* convexMesh;
     float scale;
-    std::map<string, BoneInfo> m_BoneInfoMap;
-    int m_BoneCounter = 0;
+    std::shared_ptr<Skeleton> skeleton = std::make_shared<Skeleton>();
+
+    bool gamma = false;
+    BakedModel pending;
+    vector<vector<TextureRef>> pendingTextures;
+    vector<PxTriangleMesh*> cookedMeshes;
+    FrustumCuller culler;
+    vector<uint8_t> visible;
 
     void initPhysics(PxPhysics* physics, PxScene* scene, bool isDynamic) {
         this->physics = physics;
@@ -90,9 +251,7 @@ private:
         }
         if (!isDynamic) {
             for (GLuint i = 0; i < this->meshes.size(); i++) {
-                Mesh& mesh = this->meshes[i];
-
-                PxTriangleMesh* triangleMesh = createTriangle(this->meshes[i]);
+                PxTriangleMesh* triangleMesh = cookedMeshes[i];
                 if (!triangleMesh) {
                     std::cerr << "Failed to create triangle mesh for mesh: " << i << std::endl;
                     continue;
@@ -147,71 +306,98 @@ public:
         return staticActor;
     }
 
-    PxTriangleMesh* createTriangle(const Mesh& mesh)
+    PxTriangleMesh* createTriangle(const PackedMesh& geometry)
+    {
+        bool cooked = false;
+        return CollisionCache::create(physics, geometry, cooked);
+    }
+private:
+    bool loadModel(ImportSession& session)
     {
+        const string& path = session.path();
+        directory = path.substr(0, path.find_last_of('/'));
+        name = path.substr(path.find_last_of("/\\") + 1);
 
-        vector<Vertex> vertices = mesh.vertices;
-        vector<GLuint> indices = mesh.indices;
+        TRACE_SCOPE("meshes " + name);
+        auto start = AssetClock::now();
+        BakedModel baked;
+        uint64_t cacheKey = MeshCache::key(path, session.flags());
 
-        PxVec3* pxVertices = new PxVec3[vertices.size()];
-        for (size_t i = 0; i < vertices.size(); i++)
+        if (cacheKey != 0 && MeshCache::load(cacheKey, baked))
         {
-            pxVertices[i] = PxVec3(vertices[i].Position.x, vertices[i].Position.y, vertices[i].Position.z);
+            double warmMs = assetMsSince(start);
+            cout << "[MeshCache] " << name << ": warm load " << warmMs << " ms, cold import " << baked.coldImportMs << " ms" << endl;
+            logStats(baked);
         }
+        else
+        {
+            const aiScene* scene = session.scene();
+            if (!scene)
+            {
+                return false;
+            }
 
-        PxTriangleMeshDesc meshDesc;
-        PxTriangleMeshCookingResult::Enum result;
-        meshDesc.points.count = vertices.size();
-        meshDesc.points.stride = sizeof(PxVec3);
-        meshDesc.points.data = pxVertices;
-
-        meshDesc.triangles.count = indices.size() / 3;
-        meshDesc.triangles.stride = 3 * sizeof(GLuint);
-        meshDesc.triangles.data = indices.data();
-
-        const PxCookingParams cookingParams(physics->getTolerancesScale());
-
-        PxTriangleMesh* triangleMesh = PxCreateTriangleMesh(cookingParams, meshDesc);
+            processNode(scene->mRootNode, scene, baked);
+            baked.boneInfoMap = skeleton->boneInfoMap;
+            baked.boneCount = skeleton->boneCount;
+            baked.coldImportMs = static_cast<float>(assetMsSince(start));
 
-        if (triangleMesh) {
-            cout << "Triangle mesh created successfully" << endl;
-        }
-        else {
-            cout << "Failed to create triangle mesh" << endl;
+            if (cacheKey != 0 && !MeshCache::store(cacheKey, baked)) {
+                cout << "[MeshCache] failed to write cache entry for " << name << endl;
+            }
+            cout << "[MeshCache] " << name << ": cold import " << baked.coldImportMs << " ms" << endl;
+            logStats(baked);
         }
 
-        delete[] pxVertices;
-
-        return triangleMesh;
+        skeleton->boneInfoMap = baked.boneInfoMap;
+        skeleton->boneCount = baked.boneCount;
+        pending = std::move(baked);
+        return true;
     }
-private:
-    void loadModel(string const& path, bool gamma)
-    {
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
 
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    void logStats(const BakedModel& baked)
+    {
+        // formatted on the side, models are imported on worker threads
+        const MeshOptimizerStats& stats = baked.optimizer;
+        const VertexFormatStats& formats = baked.formats;
+        std::ostringstream lines;
+        lines << std::fixed << std::setprecision(2) << "[MeshOptimizer] " << name << ": "
+              << stats.verticesBefore << " -> " << stats.verticesAfter << " vertices, ACMR "
+              << stats.acmrBefore() << " -> " << stats.acmrAfter() << ", ATVR "
+              << stats.atvrBefore() << " -> " << stats.atvrAfter() << "\n";
+        lines << std::setprecision(1) << "[VertexFormat] " << name << ": " << formats.staticMeshes << " static, "
+              << formats.skinnedMeshes << " skinned meshes, vertices " << formats.vertexBytesBefore / 1024.0 << " -> "
+              << formats.vertexBytesAfter / 1024.0 << " KB, indices " << formats.indexBytesBefore / 1024.0 << " -> "
+              << formats.indexBytesAfter / 1024.0 << " KB (all levels of detail)\n";
+
+        // triangles per level of detail, summed over the meshes
+        vector<size_t> levelTriangles(MeshSimplifier::MAX_LODS, 0);
+        for (const BakedMesh& mesh : baked.meshes)
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            for (size_t i = 0; i < mesh.geometry.lods.size() && i < levelTriangles.size(); i++)
+            {
+                levelTriangles[i] += mesh.geometry.lods[i].indexCount / 3;
+            }
         }
-
-        directory = path.substr(0, path.find_last_of('/'));
-
-        processNode(scene->mRootNode, scene, gamma);
+        lines << "[MeshSimplifier] " << name << ": triangles per level";
+        for (size_t i = 0; i < levelTriangles.size() && levelTriangles[i] > 0; i++)
+        {
+            lines << (i == 0 ? " " : " / ") << levelTriangles[i];
+        }
+        cout << lines.str() << endl;
     }
 
-    void processNode(aiNode* node, const aiScene* scene, bool gamma)
+    void processNode(aiNode* node, const aiScene* scene, BakedModel& baked)
     {
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
 
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene, gamma));
+            processMesh(mesh, scene, baked);
         }
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene, gamma);
+            processNode(node->mChildren[i], scene, baked);
         }
 
     }
@@ -226,15 +412,18 @@ private:
     }
 
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene, bool gamma)
+    // adds the mesh to the model, large static meshes as several chunks
+    void processMesh(aiMesh* mesh, const aiScene* scene, BakedModel& model)
     {
+        vector<MeshTextureRef> textures;
         vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Text> textures;
+        vector<GLuint> indices;
 
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex{};
             SetVertexBoneDataToDefault(vertex);
             vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
             vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
@@ -259,14 +448,38 @@ private:
         }
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-        vector<Text> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", gamma);
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        vector<Text> normalMap = loadMaterialTextures(material, aiTextureType_NORMALS, "normalMap", gamma);
-        textures.insert(textures.end(), normalMap.begin(), normalMap.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
+        collectMaterialTextures(material, aiTextureType_NORMALS, "normalMap", textures);
 
         ExtractBoneWeightForVertices(vertices, mesh, scene);
 
-        return Mesh(vertices, indices, textures);
+        for (MeshChunker::Chunk& chunk : MeshChunker::split(std::move(vertices), std::move(indices)))
+        {
+            // welded, reordered, simplified into levels of detail and packed into the layout the mesh needs
+            BakedMesh baked;
+            baked.textures = textures;
+            MeshOptimizer::optimize(chunk.vertices, chunk.indices, model.optimizer);
+            vector<MeshSimplifier::Level> levels = MeshSimplifier::buildLods(chunk.vertices, chunk.indices);
+            vector<GLuint> allIndices;
+            vector<MeshLod> lods;
+            for (const MeshSimplifier::Level& level : levels)
+            {
+                lods.push_back({ uint32_t(allIndices.size()), uint32_t(level.indices.size()), level.error });
+                allIndices.insert(allIndices.end(), level.indices.begin(), level.indices.end());
+            }
+            baked.geometry = VertexFormat::pack(chunk.vertices, allIndices, std::move(lods), model.formats);
+            model.meshes.push_back(std::move(baked));
+        }
+    }
+
+    void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const string& typeName, vector<MeshTextureRef>& refs)
+    {
+        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            refs.push_back({ typeName, str.C_Str() });
+        }
     }
 
     void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
@@ -285,8 +498,8 @@ private:
 
     void ExtractBoneWeightForVertices(std::vector<Vertex>& vertices, aiMesh* mesh, const aiScene* scene)
     {
-        auto& boneInfoMap = m_BoneInfoMap;
-        int& boneCount = m_BoneCounter;
+        auto& boneInfoMap = skeleton->boneInfoMap;
+        int& boneCount = skeleton->boneCount;
 
         for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
         {
@@ -321,50 +534,6 @@ private:
     }
 
 
-    unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
-    {
-        string filename = string(path);
-        filename = directory + '/' + filename;
-
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
-
-        int width, height, nrComponents;
-        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            GLenum format;
-            GLenum dataFormat;
-            if (nrComponents == 1){
-                format = dataFormat = GL_RED;
-            } else if (nrComponents == 3) {
-                format = gamma ? GL_SRGB : GL_RGB;
-                dataFormat = GL_RGB;
-            } else if (nrComponents == 4) {
-                format = gamma ? GL_SRGB_ALPHA : GL_RGBA;
-                dataFormat = GL_RGBA;
-            }
-
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Texture failed to load at path: " << path << std::endl;
-            stbi_image_free(data);
-        }
-
-        return textureID;
-    }
-
     static inline glm::mat4 ConvertMatrixToGLMFormat(const aiMatrix4x4& from)
     {
         glm::mat4 to;
@@ -376,27 +545,21 @@ private:
         return to;
     }
 
-    vector<Text> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, bool gamma)
+    vector<Text> loadMaterialTextures(const vector<MeshTextureRef>& refs, const vector<TextureRef>& handles)
     {
         vector<Text> textures;
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        for (size_t i = 0; i < refs.size(); i++)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            Text texture;
+            texture.id = handles[i]->id();
+            texture.type = refs[i].type;
+            texture.path = aiString(refs[i].path);
+            textures.push_back(texture);
+
+            // the model holds one reference per distinct texture for its whole lifetime
+            if (std::find(textures_loaded.begin(), textures_loaded.end(), handles[i]) == textures_loaded.end())
             {
-                textures.push_back(textures_loaded[j]);
-            }
-            if (!skip)
-            {   // if texture hasn't been loaded already, load it
-                Text texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, gamma);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+                textures_loaded.push_back(handles[i]);
             }
         }
         return textures;
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "AssetCache.h"
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+#include "PathUtils.h"
+#include "Pvs.h"
+
+/*!
+ * Benchmark of the culling paths for the static draws, started with --bench-occlusion once the
+ * level is built. Views are taken on a grid over the level at eye height, looking in HEADINGS
+ * directions; views from inside or right in front of a wall are skipped. For every view the
+ * full detail triangles that pass each combination are summed:
+ *   frustum:              FrustumCuller only
+ *   frustum + occlusion:  then OcclusionCuller against the walls
+ *   frustum + pvs:        then the potentially visible set of the camera cell, if one is loaded
+ *   all:                  all three
+ * The CPU cost is the frustum test, the rasterization on the workers, the time until the depth
+ * buffer was ready on the calling thread and the box tests.
+ */
+class OcclusionBench {
+public:
+    static const int HEADINGS = 8;
+    static constexpr float SPACING = 4.0f;
+    static constexpr float EYE_HEIGHT = 2.0f;
+    // views where this much of the buffer is covered within BLOCKED_DISTANCE face a wall
+    static constexpr float BLOCKED_COVERAGE = 0.5f;
+    static constexpr float BLOCKED_DISTANCE = 0.5f;
+
+    struct Item {
+        glm::vec3 lower;
+        glm::vec3 upper;
+        size_t triangles;
+    };
+
+    static bool takeFlag(int& argc, char** argv) {
+        return gcgTakeFlag(argc, argv, "--bench-occlusion");
+    }
+
+    static void run(OcclusionCuller& occlusion, const std::vector<Item>& items, const Pvs& pvs, const glm::mat4& projection, JobSystem& jobs) {
+        if (items.empty()) {
+            return;
+        }
+        FrustumCuller culler;
+        glm::vec3 lower = items[0].lower;
+        glm::vec3 upper = items[0].upper;
+        size_t totalTriangles = 0;
+        for (const Item& item : items) {
+            glm::vec3 center = (item.lower + item.upper) * 0.5f;
+            culler.add(glm::vec4(center, glm::length(item.upper - center)), item.lower, item.upper, glm::mat4(1.0f));
+            lower = glm::min(lower, item.lower);
+            upper = glm::max(upper, item.upper);
+            totalTriangles += item.triangles;
+        }
+
+        Totals frustumOnly, withOcclusion, withPvs, all;
+        double frustumMs = 0.0;
+        double rasterMs = 0.0;
+        double readyMs = 0.0;
+        double testMs = 0.0;
+        size_t views = 0;
+        std::vector<uint8_t> visible;
+        for (float z = lower.z + SPACING * 0.5f; z < upper.z; z += SPACING) {
+            for (float x = lower.x + SPACING * 0.5f; x < upper.x; x += SPACING) {
+                glm::vec3 eye(x, EYE_HEIGHT, z);
+                int cell = pvs.cellAt(eye);
+                for (int heading = 0; heading < HEADINGS; heading++) {
+                    float angle = glm::two_pi<float>() * float(heading) / float(HEADINGS);
+                    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(std::sin(angle), 0.0f, -std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+                    glm::mat4 viewProjection = projection * view;
+
+                    auto start = AssetClock::now();
+                    occlusion.render(jobs, viewProjection);
+                    occlusion.wait();
+                    double ready = assetMsSince(start);
+                    if (occlusion.coverage(BLOCKED_DISTANCE) > BLOCKED_COVERAGE) {
+                        continue;
+                    }
+                    views++;
+                    readyMs += ready;
+                    rasterMs += occlusion.renderMs();
+
+                    start = AssetClock::now();
+                    culler.cull(Frustum::fromMatrix(viewProjection), visible);
+                    frustumMs += assetMsSince(start);
+
+                    start = AssetClock::now();
+                    std::vector<uint8_t> unoccluded(items.size(), 0);
+                    for (size_t i = 0; i < items.size(); i++) {
+                        unoccluded[i] = visible[i] && occlusion.visible(items[i].lower, items[i].upper);
+                    }
+                    testMs += assetMsSince(start);
+
+                    for (size_t i = 0; i < items.size(); i++) {
+                        if (!visible[i]) {
+                            continue;
+                        }
+                        bool inSet = !pvs.loaded() || pvs.visible(cell, items[i].lower, items[i].upper);
+                        frustumOnly.add(items[i].triangles);
+                        if (unoccluded[i]) {
+                            withOcclusion.add(items[i].triangles);
+                        }
+                        if (inSet) {
+                            withPvs.add(items[i].triangles);
+                        }
+                        if (inSet && unoccluded[i]) {
+                            all.add(items[i].triangles);
+                        }
+                    }
+                }
+            }
+        }
+        if (views == 0) {
+            std::cout << "[OcclusionBench] no view outside the walls" << std::endl;
+            return;
+        }
+
+        std::cout << "[OcclusionBench] " << views << " views of " << items.size() << " draws with " << totalTriangles << " triangles, "
+                  << occlusion.occluderTriangles() << " occluder triangles, " << OcclusionCuller::WIDTH << " x "
+                  << OcclusionCuller::HEIGHT << " depth buffer" << std::endl;
+        std::cout << std::fixed << std::setprecision(3);
+        report("frustum", frustumOnly, views, totalTriangles);
+        report("frustum + occlusion", withOcclusion, views, totalTriangles);
+        if (pvs.loaded()) {
+            report("frustum + pvs", withPvs, views, totalTriangles);
+            report("all", all, views, totalTriangles);
+        }
+        std::cout << "[OcclusionBench] per view: frustum " << frustumMs / views << " ms, occluders " << rasterMs / views
+                  << " ms on workers (ready after " << readyMs / views << " ms), box tests " << testMs / views << " ms" << std::endl;
+        std::cout << std::defaultfloat;
+    }
+
+private:
+    struct Totals {
+        size_t draws = 0;
+        size_t triangles = 0;
+
+        void add(size_t drawTriangles) {
+            draws++;
+            triangles += drawTriangles;
+        }
+    };
+
+    static void report(const char* variant, const Totals& totals, size_t views, size_t totalTriangles) {
+        double triangles = double(totals.triangles) / double(views);
+        std::cout << "[OcclusionBench] " << variant << ": " << double(totals.draws) / double(views) << " draws, " << triangles
+                  << " triangles per view (" << 100.0 * (1.0 - triangles / double(totalTriangles)) << "% culled)" << std::endl;
+    }
+};
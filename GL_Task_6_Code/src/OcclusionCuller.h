@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+
+// Software occlusion culling for levels without a baked potentially visible set.
+//
+// The walls of the level are kept on the CPU as occluders and rasterized once per frame into a
+// small depth buffer, entirely on the worker threads. Every pixel stores the inverse view depth
+// of the nearest occluder (0 where there is none), which is linear in screen space. A box is
+// occluded if each pixel its screen rectangle touches holds an occluder in front of the nearest
+// corner of the box.
+//
+// Occluders are the near vertical triangles of the level meshes; floors and tops of walls hide
+// little from a camera above the ground and would only cost fill. The maze is low poly enough
+// that its full detail walls are the proxies. Rows of the buffer are split into bands that are
+// rasterized in parallel, 4 pixels per SSE instruction.
+//
+// Boxes that are known up front, like the draws of StaticGeometry, are registered as queries and
+// tested by the same job right after the depth buffer is complete; other boxes are tested with
+// visible(), which waits for that job.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE 1
+#endif
+
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    // rows per band, a band is one parallelFor item
+    static const int BAND_ROWS = 16;
+    // clip space w below which geometry counts as crossing the near plane
+    static constexpr float NEAR_W = 0.05f;
+    // occluders have to be this much nearer than a box, in inverse depth
+    static constexpr float DEPTH_BIAS = 1.001f;
+    // normals with a larger y are floors or tops and are skipped
+    static constexpr float MAX_OCCLUDER_SLOPE = 0.5f;
+
+    OcclusionCuller()
+        : _depth(size_t(WIDTH) * HEIGHT, 0.0f) {}
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    ~OcclusionCuller() { wait(); }
+
+    /*!
+     * Adds the walls of a mesh placed with modelMatrix as occluders, read back from GL at full detail
+     */
+    void addOccluders(const Mesh& mesh, const glm::mat4& modelMatrix) {
+        std::vector<unsigned char> vertices;
+        std::vector<unsigned char> indices;
+        mesh.ReadBack(vertices, indices);
+        VertexLayout layout(mesh.VertexFlags());
+        const MeshLod& level = mesh.Lod(0);
+        std::vector<glm::vec3> triangles;
+        triangles.reserve(level.indexCount);
+        for (uint32_t i = level.indexOffset; i < level.indexOffset + level.indexCount; i++) {
+            uint32_t index;
+            if (mesh.VertexFlags() & INDEX_16) {
+                uint16_t shortIndex;
+                std::memcpy(&shortIndex, indices.data() + i * sizeof(uint16_t), sizeof(shortIndex));
+                index = shortIndex;
+            } else {
+                std::memcpy(&index, indices.data() + i * sizeof(uint32_t), sizeof(index));
+            }
+            glm::vec3 position;
+            std::memcpy(&position, vertices.data() + size_t(index) * layout.stride, sizeof(position));
+            triangles.push_back(position);
+        }
+        addOccluders(triangles, modelMatrix);
+    }
+
+    /*!
+     * Same as above for triangles that are already on the CPU
+     * @param triangles: three corners per triangle
+     */
+    void addOccluders(const std::vector<glm::vec3>& triangles, const glm::mat4& modelMatrix) {
+        wait();
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            glm::vec3 a = glm::vec3(modelMatrix * glm::vec4(triangles[i], 1.0f));
+            glm::vec3 b = glm::vec3(modelMatrix * glm::vec4(triangles[i + 1], 1.0f));
+            glm::vec3 c = glm::vec3(modelMatrix * glm::vec4(triangles[i + 2], 1.0f));
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length < 1.0e-6f || std::fabs(normal.y) > MAX_OCCLUDER_SLOPE * length) {
+                continue;
+            }
+            _occluders.push_back(a);
+            _occluders.push_back(b);
+            _occluders.push_back(c);
+        }
+    }
+
+    size_t occluderTriangles() const { return _occluders.size() / 3; }
+
+    /*!
+     * Registers a world space box that is tested in every render()
+     * @return index for queryVisible()
+     */
+    size_t addQuery(const glm::vec3& lower, const glm::vec3& upper) {
+        wait();
+        _queries.push_back({ lower, upper });
+        _queryVisible.push_back(1);
+        return _queries.size() - 1;
+    }
+
+    /*!
+     * Starts rasterizing the occluders for viewProjection on the worker threads and returns at once;
+     * waits for the previous frame first
+     */
+    void render(JobSystem& jobs, const glm::mat4& viewProjection) {
+        wait();
+        _viewProjection = viewProjection;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _rendering = true;
+        }
+        jobs.submit([this, &jobs] {
+            auto start = AssetClock::now();
+            setup(jobs);
+            jobs.parallelFor(size_t(HEIGHT / BAND_ROWS), [this](size_t band) {
+                rasterize(int(band) * BAND_ROWS, int(band + 1) * BAND_ROWS);
+            });
+            for (size_t i = 0; i < _queries.size(); i++) {
+                _queryVisible[i] = uint8_t(test(_queries[i].lower, _queries[i].upper));
+            }
+            double ms = assetMsSince(start);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _renderMs = ms;
+                _rendering = false;
+            }
+            _done.notify_all();
+        });
+    }
+
+    // blocks until the last render() finished
+    void wait() const {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return !_rendering; });
+    }
+
+    // if query (from addQuery) may be visible in the last render()
+    bool queryVisible(size_t query) const {
+        wait();
+        return _queryVisible[query] != 0;
+    }
+
+    // if a world space box may be visible in the last render()
+    bool visible(const glm::vec3& lower, const glm::vec3& upper) const {
+        wait();
+        return test(lower, upper);
+    }
+
+    // time the worker threads spent on the last render(), queries included
+    double renderMs() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _renderMs;
+    }
+
+    // fraction of the depth buffer covered by an occluder nearer than distance
+    float coverage(float distance) const {
+        wait();
+        size_t covered = std::count_if(_depth.begin(), _depth.end(), [distance](float depth) { return depth * distance > 1.0f; });
+        return float(covered) / float(_depth.size());
+    }
+
+private:
+    struct Query {
+        glm::vec3 lower;
+        glm::vec3 upper;
+    };
+
+    // edge functions and inverse depth as planes over the pixel coordinates, a pixel is covered
+    // if all three edges are >= 0 at its center
+    struct ScreenTriangle {
+        float edgeX[3], edgeY[3], edgeC[3];
+        float depthX, depthY, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+    // transforms and clips the occluders, one slot pair per triangle so the blocks run in parallel
+    void setup(JobSystem& jobs) {
+        static const size_t BLOCK = 256;
+        size_t count = _occluders.size() / 3;
+        _screen.resize(count * 2);
+        _screenUsed.assign(count * 2, 0);
+        jobs.parallelFor((count + BLOCK - 1) / BLOCK, [this, count](size_t block) {
+            for (size_t i = block * BLOCK; i < std::min(count, (block + 1) * BLOCK); i++) {
+                glm::vec4 clip[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    clip[corner] = _viewProjection * glm::vec4(_occluders[i * 3 + corner], 1.0f);
+                }
+                clipAndProject(clip, i * 2);
+            }
+        });
+    }
+
+    // Sutherland-Hodgman against w >= NEAR_W, the result has up to 4 corners
+    void clipAndProject(const glm::vec4* clip, size_t slot) {
+        if (outside(clip)) {
+            return;
+        }
+        glm::vec4 polygon[4];
+        int corners = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            const glm::vec4& from = clip[corner];
+            const glm::vec4& to = clip[(corner + 1) % 3];
+            if (from.w >= NEAR_W) {
+                polygon[corners++] = from;
+            }
+            if ((from.w >= NEAR_W) != (to.w >= NEAR_W)) {
+                float t = (NEAR_W - from.w) / (to.w - from.w);
+                polygon[corners++] = from + (to - from) * t;
+            }
+        }
+        if (corners >= 3) {
+            _screenUsed[slot] = uint8_t(project(polygon[0], polygon[1], polygon[2], _screen[slot]));
+        }
+        if (corners == 4) {
+            _screenUsed[slot + 1] = uint8_t(project(polygon[0], polygon[2], polygon[3], _screen[slot + 1]));
+        }
+    }
+
+    // all corners beyond the same side plane
+    static bool outside(const glm::vec4* clip) {
+        for (int axis = 0; axis < 2; axis++) {
+            if ((clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w)
+                || (clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w)) {
+                return true;
+            }
+        }
+        return clip[0].w < NEAR_W && clip[1].w < NEAR_W && clip[2].w < NEAR_W;
+    }
+
+    static glm::vec3 toScreen(const glm::vec4& clip) {
+        float inverseW = 1.0f / clip.w;
+        return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * WIDTH, (clip.y * inverseW * 0.5f + 0.5f) * HEIGHT, inverseW);
+    }
+
+    // false if the triangle covers no pixel center
+    static bool project(const glm::vec4& clipA, const glm::vec4& clipB, const glm::vec4& clipC, ScreenTriangle& triangle) {
+        glm::vec3 v[3] = { toScreen(clipA), toScreen(clipB), toScreen(clipC) };
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::fabs(area) < 1.0e-8f) {
+            return false;
+        }
+        // walls are seen from both sides, wind every triangle counter-clockwise
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+        for (int edge = 0; edge < 3; edge++) {
+            const glm::vec3& from = v[edge];
+            const glm::vec3& to = v[(edge + 1) % 3];
+            triangle.edgeX[edge] = from.y - to.y;
+            triangle.edgeY[edge] = to.x - from.x;
+            triangle.edgeC[edge] = from.x * to.y - from.y * to.x;
+        }
+        // barycentric interpolation of the inverse depth, written as a plane
+        triangle.depthX = (triangle.edgeX[1] * v[0].z + triangle.edgeX[2] * v[1].z + triangle.edgeX[0] * v[2].z) / area;
+        triangle.depthY = (triangle.edgeY[1] * v[0].z + triangle.edgeY[2] * v[1].z + triangle.edgeY[0] * v[2].z) / area;
+        triangle.depthC = (triangle.edgeC[1] * v[0].z + triangle.edgeC[2] * v[1].z + triangle.edgeC[0] * v[2].z) / area;
+
+        float lowerX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+        float upperX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+        float lowerY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+        float upperY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+        triangle.minX = std::max(0, int(std::ceil(lowerX - 0.5f)));
+        triangle.maxX = std::min(WIDTH - 1, int(std::floor(upperX - 0.5f)));
+        triangle.minY = std::max(0, int(std::ceil(lowerY - 0.5f)));
+        triangle.maxY = std::min(HEIGHT - 1, int(std::floor(upperY - 0.5f)));
+        return triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY;
+    }
+
+    // rasterizes every occluder into rows first..end-1
+    void rasterize(int first, int end) {
+        std::fill(_depth.begin() + size_t(first) * WIDTH, _depth.begin() + size_t(end) * WIDTH, 0.0f);
+        for (size_t i = 0; i < _screen.size(); i++) {
+            if (!_screenUsed[i]) {
+                continue;
+            }
+            const ScreenTriangle& triangle = _screen[i];
+            int minY = std::max(first, triangle.minY);
+            int maxY = std::min(end - 1, triangle.maxY);
+            for (int y = minY; y <= maxY; y++) {
+                rasterizeRow(triangle, y);
+            }
+        }
+    }
+
+#if defined(OCCLUSION_CULLER_SSE)
+    void rasterizeRow(const ScreenTriangle& triangle, int y) {
+        float* row = &_depth[size_t(y) * WIDTH];
+        float centerY = float(y) + 0.5f;
+        __m128 rowEdge[3];
+        __m128 edgeX[3];
+        for (int edge = 0; edge < 3; edge++) {
+            rowEdge[edge] = _mm_set1_ps(triangle.edgeY[edge] * centerY + triangle.edgeC[edge]);
+            edgeX[edge] = _mm_set1_ps(triangle.edgeX[edge]);
+        }
+        __m128 rowDepth = _mm_set1_ps(triangle.depthY * centerY + triangle.depthC);
+        __m128 depthX = _mm_set1_ps(triangle.depthX);
+        __m128 zero = _mm_setzero_ps();
+        // the buffer rows are a multiple of 4 wide, the groups start on a multiple of 4
+        for (int x = triangle.minX & ~3; x <= triangle.maxX; x += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps(float(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[0], centerX), rowEdge[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[1], centerX), rowEdge[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[2], centerX), rowEdge[2]), zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            __m128 depth = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(depthX, centerX), rowDepth));
+            _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), depth));
+        }
+    }
+#else
+    void rasterizeRow(const ScreenTriangle& triangle, int y) {
+        float* row = &_depth[size_t(y) * WIDTH];
+        float centerY = float(y) + 0.5f;
+        for (int x = triangle.minX; x <= triangle.maxX; x++) {
+            float centerX = float(x) + 0.5f;
+            bool inside = true;
+            for (int edge = 0; edge < 3; edge++) {
+                inside = inside && triangle.edgeX[edge] * centerX + triangle.edgeY[edge] * centerY + triangle.edgeC[edge] >= 0.0f;
+            }
+            if (inside) {
+                row[x] = std::max(row[x], triangle.depthX * centerX + triangle.depthY * centerY + triangle.depthC);
+            }
+        }
+    }
+#endif
+
+    // the box against the depth buffer, boxes that cross the near plane are visible
+    bool test(const glm::vec3& lower, const glm::vec3& upper) const {
+        float lowerX = float(WIDTH);
+        float upperX = 0.0f;
+        float lowerY = float(HEIGHT);
+        float upperY = 0.0f;
+        float nearest = 0.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 position((corner & 1) ? upper.x : lower.x, (corner & 2) ? upper.y : lower.y, (corner & 4) ? upper.z : lower.z);
+            glm::vec4 clip = _viewProjection * glm::vec4(position, 1.0f);
+            if (clip.w < NEAR_W) {
+                return true;
+            }
+            glm::vec3 screen = toScreen(clip);
+            lowerX = std::min(lowerX, screen.x);
+            upperX = std::max(upperX, screen.x);
+            lowerY = std::min(lowerY, screen.y);
+            upperY = std::max(upperY, screen.y);
+            nearest = std::max(nearest, screen.z);
+        }
+        // every pixel the rectangle touches, not only those whose center it covers; boxes beside
+        // the screen are left to the frustum
+        int minX = std::max(0, int(std::floor(lowerX)));
+        int maxX = std::min(WIDTH - 1, int(std::floor(upperX)));
+        int minY = std::max(0, int(std::floor(lowerY)));
+        int maxY = std::min(HEIGHT - 1, int(std::floor(upperY)));
+        if (minX > maxX || minY > maxY) {
+            return true;
+        }
+        float occluded = nearest * DEPTH_BIAS;
+        for (int y = minY; y <= maxY; y++) {
+            const float* row = &_depth[size_t(y) * WIDTH];
+            for (int x = minX; x <= maxX; x++) {
+                if (row[x] <= occluded) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<glm::vec3> _occluders;
+    std::vector<ScreenTriangle> _screen;
+    std::vector<uint8_t> _screenUsed;
+    std::vector<float> _depth;
+    std::vector<Query> _queries;
+    std::vector<uint8_t> _queryVisible;
+    glm::mat4 _viewProjection = glm::mat4(1.0f);
+
+    mutable std::mutex _mutex;
+    mutable std::condition_variable _done;
+    bool _rendering = false;
+    double _renderMs = 0.0;
+};
@@ -20,6 +20,21 @@
 #include <vector>
 #endif
 
+// removes every occurrence of a flag gcgParseArgs does not know from argv
+inline bool gcgTakeFlag(int& argc, char** argv, const char* flag) {
+    bool found = false;
+    int kept = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && std::string(argv[i]) == flag) {
+            found = true;
+            continue;
+        }
+        argv[kept++] = argv[i];
+    }
+    argc = kept;
+    return found;
+}
+
 inline std::filesystem::path gcgGetExecutableDir() {
     char buffer[PATH_MAX];
 #if defined(__APPLE__)
@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "ImportSession.h"
+#include "JobSystem.h"
+#include "PathUtils.h"
+
+// Potentially visible sets of a level, baked offline with --bake-pvs into a .pvs file next to the
+// source mesh and loaded at startup.
+//
+// The level is partitioned into square cells on the x/z grid. For the bake, the walls are cut at
+// two eye heights and rasterized into a fine occupancy grid; a fine cell only blocks sight if it
+// is blocked at both heights, so windows and low walls do not. The open fine cells on the border
+// between two cells are the portals between them. From sample points spread over each cell, rays
+// are cast in all directions through the occupancy grid; every cell a ray crosses before it hits a
+// wall is visible. The result is dilated by one cell, which covers sampling gaps between rays.
+//
+// File layout (all blocks 4 byte aligned):
+//   header    magic, version, key, grid origin (x, z), cell size, width, depth, words per set,
+//             average fraction culled
+//   sets      one bitset per cell, cell index z * width + x
+
+class Pvs {
+public:
+    static constexpr uint32_t MAGIC = 0x31535650; // "PVS1"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr float CELL_SIZE = 4.0f;
+    // occupancy grid cells per cell edge
+    static constexpr int SUBDIVISION = 8;
+    // heights the walls are cut at, around the eye of the player and the camera behind it
+    static constexpr float SIGHT_LOW = 1.0f;
+    static constexpr float SIGHT_HIGH = 6.0f;
+    // ray origins per cell edge and ray directions per origin
+    static constexpr int ORIGINS = 4;
+    static constexpr int DIRECTIONS = 512;
+
+    static bool takeBakeFlag(int& argc, char** argv) {
+        return gcgTakeFlag(argc, argv, "--bake-pvs");
+    }
+
+    // the .pvs file of a source mesh, next to it
+    static std::string pathFor(const std::string& sourcePath) {
+        return sourcePath.substr(0, sourcePath.find_last_of('.')) + ".pvs";
+    }
+
+    /*!
+     * Computes the sets of a mesh and writes them to pathFor(sourcePath) below the loose assets
+     * @param jobs: the cells are computed in parallel
+     */
+    static bool bake(const std::string& sourcePath, JobSystem& jobs) {
+        ImportSession session(sourcePath, aiProcess_Triangulate);
+        const aiScene* scene = session.scene();
+        if (!scene) {
+            std::cout << "[Pvs] can not read " << sourcePath << std::endl;
+            return false;
+        }
+
+        std::vector<glm::vec3> triangles;
+        for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+            const aiMesh* mesh = scene->mMeshes[m];
+            for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+                if (mesh->mFaces[f].mNumIndices != 3) {
+                    continue;
+                }
+                for (unsigned int corner = 0; corner < 3; corner++) {
+                    const aiVector3D& vertex = mesh->mVertices[mesh->mFaces[f].mIndices[corner]];
+                    triangles.push_back(glm::vec3(vertex.x, vertex.y, vertex.z));
+                }
+            }
+        }
+        return bake(sourcePath, triangles, jobs);
+    }
+
+    /*!
+     * Same as above, for triangles that were already read from the source mesh
+     * @param triangles: three corners per triangle
+     */
+    static bool bake(const std::string& sourcePath, const std::vector<glm::vec3>& triangles, JobSystem& jobs) {
+        auto start = AssetClock::now();
+        uint64_t key = sourceKey(sourcePath);
+        if (key == 0 || triangles.empty()) {
+            std::cout << "[Pvs] " << sourcePath << " has no triangles" << std::endl;
+            return false;
+        }
+
+        Pvs pvs;
+        glm::vec3 lower = triangles[0];
+        glm::vec3 upper = triangles[0];
+        for (const glm::vec3& vertex : triangles) {
+            lower = glm::min(lower, vertex);
+            upper = glm::max(upper, vertex);
+        }
+        pvs._origin = glm::floor(glm::vec2(lower.x, lower.z) / CELL_SIZE) * CELL_SIZE;
+        pvs._width = std::max(1, int(std::ceil((upper.x - pvs._origin.x) / CELL_SIZE)));
+        pvs._depth = std::max(1, int(std::ceil((upper.z - pvs._origin.y) / CELL_SIZE)));
+        pvs._words = (pvs.cellCount() + 31) / 32;
+
+        std::vector<uint8_t> blocked = pvs.rasterize(triangles, SIGHT_LOW);
+        std::vector<uint8_t> blockedHigh = pvs.rasterize(triangles, SIGHT_HIGH);
+        for (size_t i = 0; i < blocked.size(); i++) {
+            blocked[i] &= blockedHigh[i];
+        }
+
+        std::vector<std::vector<uint8_t>> seen(pvs.cellCount());
+        jobs.parallelFor(pvs.cellCount(), [&](size_t cell) {
+            seen[cell] = pvs.castRays(int(cell), blocked);
+        });
+        pvs._sets.assign(size_t(pvs.cellCount()) * pvs._words, 0);
+        for (int cell = 0; cell < pvs.cellCount(); cell++) {
+            pvs.dilate(cell, seen[cell]);
+        }
+
+        float culled = 0.0f;
+        for (int cell = 0; cell < pvs.cellCount(); cell++) {
+            culled += pvs.culledFraction(cell);
+        }
+        pvs._averageCulled = culled / float(pvs.cellCount());
+
+        std::string outPath = (Vfs::instance().assetsDir().parent_path() / pathFor(sourcePath)).string();
+        if (!pvs.write(outPath, key)) {
+            std::cout << "[Pvs] failed to write " << outPath << std::endl;
+            return false;
+        }
+        std::cout << "[Pvs] " << outPath << ": " << pvs._width << " x " << pvs._depth << " cells of " << CELL_SIZE << " units, "
+                  << pvs.portalCount(blocked) << " portals, on average " << std::fixed << std::setprecision(1)
+                  << pvs._averageCulled * 100.0f << "% of the cells culled, baked in " << assetMsSince(start) << " ms" << std::endl;
+        return true;
+    }
+
+    /*!
+     * Loads the sets baked for a source mesh, outdated sets (the mesh or the bake settings
+     * changed) are ignored
+     */
+    bool load(const std::string& sourcePath) {
+        _sets.clear();
+        std::string path = pathFor(sourcePath);
+        AssetView view = Vfs::instance().open(path);
+        if (view.empty()) {
+            std::cout << "[Pvs] no " << path << ", run with --bake-pvs to create it" << std::endl;
+            return false;
+        }
+        BinaryReader reader(view.data, view.size);
+        if (reader.read<uint32_t>() != MAGIC || reader.read<uint32_t>() != VERSION || reader.read<uint64_t>() != sourceKey(sourcePath)) {
+            std::cout << "[Pvs] ignoring outdated " << path << ", run with --bake-pvs to update it" << std::endl;
+            return false;
+        }
+        _origin = reader.read<glm::vec2>();
+        reader.read<float>();
+        _width = reader.read<int32_t>();
+        _depth = reader.read<int32_t>();
+        _words = reader.read<uint32_t>();
+        _averageCulled = reader.read<float>();
+        reader.readArray(_sets, size_t(cellCount()) * _words);
+        if (!reader.ok() || _sets.size() != size_t(cellCount()) * _words) {
+            std::cout << "[Pvs] truncated " << path << std::endl;
+            _sets.clear();
+            return false;
+        }
+        std::cout << "[Pvs] " << path << ": " << _width << " x " << _depth << " cells, on average " << std::fixed
+                  << std::setprecision(1) << _averageCulled * 100.0f << "% culled" << std::endl;
+        return true;
+    }
+
+    bool loaded() const { return !_sets.empty(); }
+
+    // @return the cell that contains position, -1 outside the grid
+    int cellAt(const glm::vec3& position) const {
+        int x = int(std::floor((position.x - _origin.x) / CELL_SIZE));
+        int z = int(std::floor((position.z - _origin.y) / CELL_SIZE));
+        if (!loaded() || x < 0 || z < 0 || x >= _width || z >= _depth) {
+            return -1;
+        }
+        return z * _width + x;
+    }
+
+    /*!
+     * @return true if a cell the box overlaps is visible from the cell from; without sets, from
+     *         outside the grid or for boxes reaching out of it there is nothing to cull
+     */
+    bool visible(int from, const glm::vec3& lower, const glm::vec3& upper) const {
+        if (from < 0) {
+            return true;
+        }
+        int x0 = int(std::floor((lower.x - _origin.x) / CELL_SIZE));
+        int z0 = int(std::floor((lower.z - _origin.y) / CELL_SIZE));
+        int x1 = int(std::floor((upper.x - _origin.x) / CELL_SIZE));
+        int z1 = int(std::floor((upper.z - _origin.y) / CELL_SIZE));
+        if (x0 < 0 || z0 < 0 || x1 >= _width || z1 >= _depth) {
+            return true;
+        }
+        for (int z = z0; z <= z1; z++) {
+            for (int x = x0; x <= x1; x++) {
+                if (test(from, z * _width + x)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // share of all cells that are not visible from cell
+    float culledFraction(int cell) const {
+        if (cell < 0) {
+            return 0.0f;
+        }
+        size_t count = 0;
+        for (uint32_t word = 0; word < _words; word++) {
+            count += popcount(_sets[size_t(cell) * _words + word]);
+        }
+        return 1.0f - float(count) / float(cellCount());
+    }
+
+    // over all cells, as baked
+    float averageCulledFraction() const { return _averageCulled; }
+
+    // share culled from the camera cells of the frames recorded so far
+    void recordFrame(int cell) {
+        _frames++;
+        _culledSum += culledFraction(cell);
+    }
+
+    float runningCulledFraction() const { return _frames ? float(_culledSum / double(_frames)) : 0.0f; }
+
+private:
+    static constexpr uint8_t SEEN = 1;
+
+    static uint64_t sourceKey(const std::string& sourcePath) {
+        AssetView source = Vfs::instance().open(sourcePath);
+        if (source.empty()) {
+            return 0;
+        }
+        uint64_t seed = assetHash(&VERSION, sizeof(VERSION));
+        const float settings[] = { CELL_SIZE, float(SUBDIVISION), SIGHT_LOW, SIGHT_HIGH, float(ORIGINS), float(DIRECTIONS) };
+        seed = assetHash(settings, sizeof(settings), seed);
+        // CRLF is hashed as LF, so a checkout that converted the line endings of the text mesh keeps its key
+        const char* text = source.data;
+        size_t start = 0;
+        for (size_t i = 0; i + 1 < source.size; i++) {
+            if (text[i] == '\r' && text[i + 1] == '\n') {
+                seed = assetHash(text + start, i - start, seed);
+                start = i + 1;
+            }
+        }
+        return assetHash(text + start, source.size - start, seed);
+    }
+
+    static uint32_t popcount(uint32_t bits) {
+        uint32_t count = 0;
+        for (; bits; bits &= bits - 1) {
+            count++;
+        }
+        return count;
+    }
+
+    int cellCount() const { return _width * _depth; }
+    int fineWidth() const { return _width * SUBDIVISION; }
+    int fineDepth() const { return _depth * SUBDIVISION; }
+
+    bool test(int from, int cell) const {
+        return (_sets[size_t(from) * _words + uint32_t(cell) / 32] >> (uint32_t(cell) % 32)) & 1u;
+    }
+
+    void set(int from, int cell) {
+        _sets[size_t(from) * _words + uint32_t(cell) / 32] |= 1u << (uint32_t(cell) % 32);
+    }
+
+    // occupancy grid of the segments the triangles leave on the plane y = height
+    std::vector<uint8_t> rasterize(const std::vector<glm::vec3>& triangles, float height) const {
+        std::vector<uint8_t> blocked(size_t(fineWidth()) * fineDepth(), 0);
+        float fine = CELL_SIZE / SUBDIVISION;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            glm::vec2 points[2];
+            int count = 0;
+            for (int edge = 0; edge < 3 && count < 2; edge++) {
+                const glm::vec3& a = triangles[t + edge];
+                const glm::vec3& b = triangles[t + (edge + 1) % 3];
+                if ((a.y < height) != (b.y < height)) {
+                    float s = (height - a.y) / (b.y - a.y);
+                    glm::vec3 p = a + (b - a) * s;
+                    points[count++] = (glm::vec2(p.x, p.z) - _origin) / fine;
+                }
+            }
+            if (count < 2) {
+                continue;
+            }
+            // steps of a quarter fine cell cannot skip one
+            int steps = int(glm::length(points[1] - points[0]) * 4.0f) + 1;
+            for (int i = 0; i <= steps; i++) {
+                glm::vec2 p = glm::mix(points[0], points[1], float(i) / float(steps));
+                int x = int(std::floor(p.x));
+                int z = int(std::floor(p.y));
+                if (x >= 0 && z >= 0 && x < fineWidth() && z < fineDepth()) {
+                    blocked[size_t(z) * fineWidth() + x] = 1;
+                }
+            }
+        }
+        return blocked;
+    }
+
+    // cells reached by rays from the open sample points of cell, one flag per cell
+    std::vector<uint8_t> castRays(int cell, const std::vector<uint8_t>& blocked) const {
+        std::vector<uint8_t> seen(cellCount(), 0);
+        seen[cell] = SEEN;
+        int cellX = cell % _width;
+        int cellZ = cell / _width;
+        for (int oz = 0; oz < ORIGINS; oz++) {
+            for (int ox = 0; ox < ORIGINS; ox++) {
+                glm::vec2 origin((cellX + (ox + 0.5f) / ORIGINS) * SUBDIVISION, (cellZ + (oz + 0.5f) / ORIGINS) * SUBDIVISION);
+                if (blocked[size_t(origin.y) * fineWidth() + size_t(origin.x)]) {
+                    continue;
+                }
+                for (int d = 0; d < DIRECTIONS; d++) {
+                    float angle = (d + 0.5f) * 6.28318531f / DIRECTIONS;
+                    castRay(origin, glm::vec2(std::cos(angle), std::sin(angle)), blocked, seen);
+                }
+            }
+        }
+        return seen;
+    }
+
+    // Amanatides and Woo, walks the occupancy grid until a blocked cell or the border
+    void castRay(const glm::vec2& origin, const glm::vec2& direction, const std::vector<uint8_t>& blocked, std::vector<uint8_t>& seen) const {
+        int x = int(origin.x);
+        int z = int(origin.y);
+        int stepX = direction.x > 0.0f ? 1 : -1;
+        int stepZ = direction.y > 0.0f ? 1 : -1;
+        float deltaX = direction.x != 0.0f ? std::fabs(1.0f / direction.x) : INFINITY;
+        float deltaZ = direction.y != 0.0f ? std::fabs(1.0f / direction.y) : INFINITY;
+        float maxX = direction.x != 0.0f ? (direction.x > 0.0f ? x + 1 - origin.x : origin.x - x) * deltaX : INFINITY;
+        float maxZ = direction.y != 0.0f ? (direction.y > 0.0f ? z + 1 - origin.y : origin.y - z) * deltaZ : INFINITY;
+        while (x >= 0 && z >= 0 && x < fineWidth() && z < fineDepth() && !blocked[size_t(z) * fineWidth() + x]) {
+            seen[(z / SUBDIVISION) * _width + x / SUBDIVISION] = SEEN;
+            if (maxX < maxZ) {
+                maxX += deltaX;
+                x += stepX;
+            } else {
+                maxZ += deltaZ;
+                z += stepZ;
+            }
+        }
+    }
+
+    // seen cells and their neighbours go into the set of cell
+    void dilate(int cell, const std::vector<uint8_t>& seen) {
+        for (int z = 0; z < _depth; z++) {
+            for (int x = 0; x < _width; x++) {
+                if (!seen[z * _width + x]) {
+                    continue;
+                }
+                for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, _depth - 1); nz++) {
+                    for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, _width - 1); nx++) {
+                        set(cell, nz * _width + nx);
+                    }
+                }
+            }
+        }
+    }
+
+    // open spans along the borders between neighbouring cells
+    size_t portalCount(const std::vector<uint8_t>& blocked) const {
+        size_t portals = 0;
+        auto open = [&](int x, int z) { return !blocked[size_t(z) * fineWidth() + x]; };
+        for (int z = 0; z < fineDepth(); z++) {
+            for (int x = SUBDIVISION; x < fineWidth(); x += SUBDIVISION) {
+                bool passable = open(x - 1, z) && open(x, z);
+                bool starts = passable && (z % SUBDIVISION == 0 || !(open(x - 1, z - 1) && open(x, z - 1)));
+                portals += starts ? 1 : 0;
+            }
+        }
+        for (int z = SUBDIVISION; z < fineDepth(); z += SUBDIVISION) {
+            for (int x = 0; x < fineWidth(); x++) {
+                bool passable = open(x, z - 1) && open(x, z);
+                bool starts = passable && (x % SUBDIVISION == 0 || !(open(x - 1, z - 1) && open(x - 1, z)));
+                portals += starts ? 1 : 0;
+            }
+        }
+        return portals;
+    }
+
+    bool write(const std::string& path, uint64_t key) const {
+        BinaryWriter writer(path);
+        writer.write(MAGIC);
+        writer.write(VERSION);
+        writer.write(key);
+        writer.write(_origin);
+        writer.write(CELL_SIZE);
+        writer.write(int32_t(_width));
+        writer.write(int32_t(_depth));
+        writer.write(_words);
+        writer.write(_averageCulled);
+        writer.writeArray(_sets.data(), _sets.size());
+        return writer.commit();
+    }
+
+    glm::vec2 _origin = glm::vec2(0.0f);
+    int _width = 0;
+    int _depth = 0;
+    uint32_t _words = 0;
+    std::vector<uint32_t> _sets;
+    float _averageCulled = 0.0f;
+
+    size_t _frames = 0;
+    double _culledSum = 0.0;
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+#include "Material.h"
+#include "MeshLod.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "Pvs.h"
+
+/*!
+ * Passes are the most significant part of the sort key, a pass is drawn completely before the next
+ */
+enum RenderPass : uint32_t {
+    RENDER_PASS_SHADOW = 0,
+    RENDER_PASS_OPAQUE = 1,
+    RENDER_PASS_EMISSIVE = 2
+};
+
+/*!
+ * One mesh draw: what to draw, at which level of detail, with which material and where.
+ * The parameters go to the shader with the transform (the light source shader tints with them).
+ */
+struct DrawPacket {
+    const Mesh* mesh;
+    size_t lod;
+    Material* material;
+    glm::mat4 modelMatrix;
+    glm::vec4 parameters;
+};
+
+/*!
+ * Collects the draws of a frame and issues them sorted by a 64 bit key, so that draws sharing a
+ * program, material, texture set and vertex array follow each other and the state is set once:
+ *
+ *   bits    63..60  59..52   51..40    39..24       23..12        11..0
+ *           pass    program  material  texture set  vertex array  view distance (front to back)
+ *
+ * Program, material, texture set and vertex array are truncated ids or hashes, a collision only
+ * costs grouping; the executor compares the actual program, material, texture list and vertex
+ * array before changing state.
+ *
+ * Runs of the sorted draws with the same mesh, level of detail and material become one instanced
+ * draw, their transforms and parameters go through an InstanceBuffer.
+ */
+class RenderQueue {
+public:
+    // view distance that maps to the largest depth key, farther draws share it
+    static constexpr float DEPTH_RANGE = 256.0f;
+    static const uint64_t DEPTH_MASK = (1ull << 12) - 1;
+
+    /*!
+     * Queues a mesh, the level of detail is picked for view right away
+     */
+    void submit(RenderPass pass, const Mesh& mesh, Material& material, const glm::mat4& modelMatrix, const LodView& view,
+                const glm::vec4& parameters = glm::vec4(1.0f)) {
+        // the camera's visible set and occlusion do not apply to shadows, hidden casters still cast into view
+        if (pass != RENDER_PASS_SHADOW) {
+            if (_pvs && !inVisibleCells(mesh, modelMatrix)) {
+                return;
+            }
+            if (_occlusion && occluded(mesh, modelMatrix)) {
+                return;
+            }
+        }
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(glm::vec3(mesh.Bounds()), 1.0f));
+        float distance = std::min(glm::length(center - view.eye) / DEPTH_RANGE, 1.0f);
+        uint64_t key = (uint64_t(pass) << 60)
+            | (uint64_t(material.getShader()->getHandle() & 0xFF) << 52)
+            | (uint64_t(material.getId() & 0xFFF) << 40)
+            | (uint64_t(mesh.TextureSet() & 0xFFFF) << 24)
+            | (uint64_t(mesh.VertexArray() & 0xFFF) << 12)
+            | uint64_t(distance * float(DEPTH_MASK));
+        _order.push_back({ key, uint32_t(_packets.size()) });
+        _packets.push_back({ &mesh, mesh.selectLod(view, modelMatrix), &material, modelMatrix, parameters });
+    }
+
+    /*!
+     * Drops later camera pass submits of meshes outside the potentially visible set of cell
+     * @param pvs: nullptr or a cell of -1 keeps every submit
+     */
+    void setVisibleCells(const Pvs* pvs, int cell) {
+        _pvs = pvs;
+        _cell = cell;
+    }
+
+    /*!
+     * Drops later camera pass submits of meshes the last render() of occlusion found hidden
+     * @param occlusion: nullptr keeps every submit
+     */
+    void setOcclusion(const OcclusionCuller* occlusion) {
+        _occlusion = occlusion;
+    }
+
+    /*!
+     * Sorts and draws everything submitted since the last call, then empties the queue
+     * @param frustum: if set, draws whose bounds lie outside are dropped first
+     */
+    void execute(const Frustum* frustum = nullptr) {
+        if (frustum) {
+            cull(*frustum);
+        }
+        if (_order.empty()) {
+            _packets.clear();
+            return;
+        }
+        size_t unsortedChanges = 0;
+        State unsorted;
+        for (const SortItem& item : _order) {
+            unsortedChanges += std::bitset<32>(transition(unsorted, _packets[item.index])).count();
+        }
+
+        radixSort(_order, _scratch);
+        batch();
+
+        size_t changes = 0;
+        State state;
+        for (const Batch& batch : _batches) {
+            const DrawPacket& packet = _packets[batch.packet];
+            GLuint boundUnits = state.boundUnits;
+            Material* previous = state.material;
+            uint32_t changed = transition(state, packet);
+            changes += std::bitset<32>(changed).count();
+
+            Shader* shader = packet.material->getShader();
+            if (changed & CHANGE_PROGRAM) {
+                // the flag belongs to the program, draws outside the queue expect it off
+                if (previous) {
+                    previous->setInstanced(false);
+                }
+                shader->use();
+            }
+            if (changed & CHANGE_MATERIAL) {
+                packet.material->setUniforms();
+            }
+            if (changed & CHANGE_TEXTURES) {
+                packet.mesh->BindTextures(*shader);
+                Mesh::UnbindTextures(state.boundUnits, boundUnits);
+            }
+            if (changed & CHANGE_VERTEX_ARRAY) {
+                GLState::instance().bindVertexArray(packet.mesh->VertexArray());
+            }
+            packet.material->setInstanced(true);
+            packet.mesh->DrawInstances(packet.lod, batch.firstInstance, GLsizei(batch.instances));
+        }
+        state.material->setInstanced(false);
+
+        RenderStats::instance().addStateChanges(changes, unsortedChanges);
+        _packets.clear();
+        _order.clear();
+    }
+
+private:
+    struct SortItem {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // one draw call: the packet whose state it uses and its range in the instance buffer
+    struct Batch {
+        uint32_t packet;
+        uint32_t firstInstance;
+        uint32_t instances;
+    };
+
+    bool inVisibleCells(const Mesh& mesh, const glm::mat4& modelMatrix) const {
+        glm::vec3 center;
+        glm::vec3 extent;
+        FrustumCuller::worldBox(mesh.BoxMin(), mesh.BoxMax(), modelMatrix, center, extent);
+        return _pvs->visible(_cell, center - extent, center + extent);
+    }
+
+    bool occluded(const Mesh& mesh, const glm::mat4& modelMatrix) const {
+        glm::vec3 center;
+        glm::vec3 extent;
+        FrustumCuller::worldBox(mesh.BoxMin(), mesh.BoxMax(), modelMatrix, center, extent);
+        if (_occlusion->visible(center - extent, center + extent)) {
+            return false;
+        }
+        RenderStats::instance().addOcclusion(1, mesh.Lod(0).indexCount / 3);
+        return true;
+    }
+
+    // removes the draws outside frustum from the order, the packets stay until the queue is emptied
+    void cull(const Frustum& frustum) {
+        _culler.clear();
+        for (const DrawPacket& packet : _packets) {
+            _culler.add(packet.mesh->Bounds(), packet.mesh->BoxMin(), packet.mesh->BoxMax(), packet.modelMatrix);
+        }
+        size_t visible = _culler.cull(frustum, _visible);
+        size_t triangles = 0;
+        size_t visibleTriangles = 0;
+        for (size_t i = 0; i < _packets.size(); i++) {
+            size_t meshTriangles = _packets[i].mesh->Lod(0).indexCount / 3;
+            triangles += meshTriangles;
+            visibleTriangles += _visible[i] ? meshTriangles : 0;
+        }
+        _order.erase(std::remove_if(_order.begin(), _order.end(), [this](const SortItem& item) { return !_visible[item.index]; }), _order.end());
+        RenderStats::instance().addCulling(visible, _packets.size(), visibleTriangles, triangles);
+    }
+
+    enum StateChange : uint32_t {
+        CHANGE_PROGRAM = 1 << 0,
+        CHANGE_MATERIAL = 1 << 1,
+        CHANGE_TEXTURES = 1 << 2,
+        CHANGE_VERTEX_ARRAY = 1 << 3
+    };
+
+    struct State {
+        Shader* shader = nullptr;
+        Material* material = nullptr;
+        // mesh whose textures are bound, compared by texture list since the texture set is a hash
+        const Mesh* textureMesh = nullptr;
+        GLuint boundUnits = 0;
+        GLuint vertexArray = 0;
+    };
+
+    // what has to change to draw packet after state, state is updated to the packet
+    static uint32_t transition(State& state, const DrawPacket& packet) {
+        uint32_t changed = 0;
+        Shader* shader = packet.material->getShader();
+        if (shader != state.shader) {
+            changed |= CHANGE_PROGRAM;
+            state.shader = shader;
+        }
+        if (packet.material != state.material) {
+            changed |= CHANGE_MATERIAL;
+            state.material = packet.material;
+        }
+        // samplers belong to the program and a material may bind textures itself
+        GLuint units = GLuint(packet.mesh->TextureCount());
+        bool sameTextures = state.textureMesh && packet.mesh->SameTextures(*state.textureMesh);
+        if ((changed || !sameTextures) && (units > 0 || state.boundUnits > 0)) {
+            changed |= CHANGE_TEXTURES;
+            state.textureMesh = packet.mesh;
+            state.boundUnits = units;
+        }
+        if (packet.mesh->VertexArray() != state.vertexArray) {
+            changed |= CHANGE_VERTEX_ARRAY;
+            state.vertexArray = packet.mesh->VertexArray();
+        }
+        return changed;
+    }
+
+    // merges the sorted packets into batches and uploads their instances
+    void batch() {
+        _batches.clear();
+        _instanceBuffer.begin();
+        for (const SortItem& item : _order) {
+            const DrawPacket& packet = _packets[item.index];
+            uint32_t instance = _instanceBuffer.add(packet.modelMatrix, packet.parameters);
+            if (!_batches.empty()) {
+                const DrawPacket& first = _packets[_batches.back().packet];
+                if (first.mesh == packet.mesh && first.lod == packet.lod && first.material == packet.material) {
+                    _batches.back().instances++;
+                    continue;
+                }
+            }
+            _batches.push_back({ item.index, instance, 1 });
+        }
+        _instanceBuffer.upload();
+    }
+
+    // LSD radix sort, 8 bits per pass; stable, so equal keys keep their submission order.
+    // Passes where all keys share the digit are skipped.
+    static void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+        scratch.resize(items.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t offsets[256] = {};
+            for (const SortItem& item : items) {
+                offsets[(item.key >> shift) & 0xFF]++;
+            }
+            if (offsets[(items[0].key >> shift) & 0xFF] == items.size()) {
+                continue;
+            }
+            size_t offset = 0;
+            for (size_t& count : offsets) {
+                size_t digitCount = count;
+                count = offset;
+                offset += digitCount;
+            }
+            for (const SortItem& item : items) {
+                scratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+            }
+            items.swap(scratch);
+        }
+    }
+
+    std::vector<DrawPacket> _packets;
+    std::vector<SortItem> _order;
+    std::vector<SortItem> _scratch;
+    std::vector<Batch> _batches;
+    InstanceBuffer _instanceBuffer;
+    FrustumCuller _culler;
+    std::vector<uint8_t> _visible;
+    const Pvs* _pvs = nullptr;
+    int _cell = -1;
+    const OcclusionCuller* _occlusion = nullptr;
+};
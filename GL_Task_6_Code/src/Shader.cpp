@@ -0,0 +1,476 @@
+/*
+ * Copyright 2023 Vienna University of Technology.
+ * Institute of Computer Graphics and Algorithms.
+ * This file is part of the GCG Lab Framework and must not be redistributed.
+ */
+#include "Shader.h"
+
+#include <cstring>
+#include <vector>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "BonePalette.h"
+#include "FrameUniforms.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+
+// Linked programs are kept in the asset cache as driver program binaries (glGetProgramBinary).
+// A binary is only valid for the exact driver that produced it, so vendor, renderer and version
+// string are part of the key next to the source text; a binary the driver still rejects (e.g.
+// after an update that kept the version string) falls back to a normal compile and is replaced.
+//
+// Uniforms are written with glProgramUniform, so a shader does not have to be in use to be set up,
+// and each shader remembers what it wrote last per location: a write of the same value is skipped.
+//
+// File layout: magic, version, key, cold compile time, binary format, binary size, binary
+
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x47525047; // "GPRG"
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+static const char* DEFAULT_VERTEX_SHADER =
+    "#version 330 core\n"
+    "layout(location = 0) in vec3 position;\n"
+    "void main() {\n"
+    "\tgl_Position = vec4(position.xy, -position.z, 1);\n"
+    "}\n";
+
+static const char* DEFAULT_FRAGMENT_SHADER =
+    "#version 330 core \n"
+    "uniform vec3 fragColor = vec3(1, 0, 0); \n"
+    "out vec4 color; \n"
+    "void main() {  \n"
+    "\tcolor = vec4(fragColor, 1); \n"
+    "}\n";
+
+static const int MAX_INCLUDE_DEPTH = 8;
+
+// GLSL has no #include, lines of the form #include "file" are replaced by the file (relative
+// to the including shader) before compiling
+static bool readShaderFile(const std::string& file, std::string& source, int depth = 0) {
+    AssetView view = Vfs::instance().open(file);
+    if (view.empty()) {
+        std::cerr << "Unable to load file[" << file << "]!" << std::endl;
+        return false;
+    }
+    std::string text(view.data, view.size);
+    if (text.find("#include") == std::string::npos) {
+        source = std::move(text);
+        return true;
+    }
+    if (depth >= MAX_INCLUDE_DEPTH) {
+        std::cerr << "Shader includes nested too deeply in " << file << std::endl;
+        return false;
+    }
+
+    std::string directory = file.substr(0, file.find_last_of("/\\") + 1);
+    source.clear();
+    size_t lineStart = 0;
+    while (lineStart < text.size()) {
+        size_t lineEnd = text.find('\n', lineStart);
+        lineEnd = lineEnd == std::string::npos ? text.size() : lineEnd + 1;
+        std::string line = text.substr(lineStart, lineEnd - lineStart);
+        lineStart = lineEnd;
+        if (line.compare(0, 8, "#include") != 0) {
+            source += line;
+            continue;
+        }
+        size_t open = line.find('"');
+        size_t close = line.find('"', open + 1);
+        if (open == std::string::npos || close == std::string::npos) {
+            std::cerr << "Malformed #include in " << file << ": " << line << std::endl;
+            return false;
+        }
+        std::string included;
+        if (!readShaderFile(directory + line.substr(open + 1, close - open - 1), included, depth + 1)) {
+            return false;
+        }
+        source += included;
+        source += '\n';
+    }
+    return true;
+}
+
+static std::string shaderName(const std::string& file) {
+    return file.substr(file.find_last_of("/\\") + 1);
+}
+
+Shader::Shader()
+    : _handle(0)
+    , _vs("")
+    , _fs("")
+    , _useFileAsSource(false) {
+    _handle = loadShaders();
+    bindUniformBlocks();
+}
+
+Shader::Shader(std::string vs, std::string fs)
+    : _handle(0)
+    , _vs(vs)
+    , _fs(fs)
+    , _useFileAsSource(true) {
+    _handle = loadShaders();
+    bindUniformBlocks();
+}
+
+Shader::~Shader() {
+    glDeleteProgram(_handle);
+    GLState::instance().forgetProgram(_handle);
+}
+
+void Shader::use() const {
+    GLState::instance().useProgram(_handle);
+}
+
+void Shader::unuse() const {
+    GLState::instance().useProgram(0);
+}
+
+GLuint Shader::loadShaders() {
+    std::string vsSource = DEFAULT_VERTEX_SHADER;
+    std::string fsSource = DEFAULT_FRAGMENT_SHADER;
+    std::string name = "default shader";
+    if (_useFileAsSource) {
+        if (_vs.empty() || _fs.empty()) {
+            EXIT_WITH_ERROR("Shader must contain at least a vertex and fragment shader");
+        }
+        if (!readShaderFile(_vs, vsSource) || !readShaderFile(_fs, fsSource)) {
+            EXIT_WITH_ERROR("Failed to load shader " << _vs << " / " << _fs);
+        }
+        name = shaderName(_vs) + "/" + shaderName(_fs);
+    }
+
+    auto start = AssetClock::now();
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    uint64_t key = binaryFormats > 0 ? programCacheKey(vsSource, fsSource) : 0;
+
+    float coldMs = 0.0f;
+    if (key != 0 && loadProgramBinary(key, coldMs)) {
+        std::cout << "[ShaderCache] " << name << ": binary load " << assetMsSince(start) << " ms, compile " << coldMs << " ms" << std::endl;
+        return _handle;
+    }
+
+    if (!buildProgram(vsSource, fsSource)) {
+        EXIT_WITH_ERROR("Failed to create " << name);
+    }
+    coldMs = static_cast<float>(assetMsSince(start));
+    if (key != 0) {
+        storeProgramBinary(key, coldMs);
+    }
+    std::cout << "[ShaderCache] " << name << ": compiled in " << coldMs << " ms" << std::endl;
+    return _handle;
+}
+
+void Shader::bindUniformBlocks() {
+    // block bindings are not part of a program binary, so this runs after either load path
+    GLuint index = glGetUniformBlockIndex(_handle, FrameUniforms::BLOCK_NAME);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(_handle, index, FrameUniforms::BINDING);
+        GLint size = 0;
+        glGetActiveUniformBlockiv(_handle, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if (size > GLint(sizeof(FrameUniforms::Block))) {
+            std::cout << "[FrameUniforms] " << _vs << " expects " << size << " bytes, FrameUniforms::Block has " << sizeof(FrameUniforms::Block) << std::endl;
+        }
+    }
+
+    index = glGetProgramResourceIndex(_handle, GL_SHADER_STORAGE_BLOCK, BonePalette::BLOCK_NAME);
+    if (index != GL_INVALID_INDEX) {
+        glShaderStorageBlockBinding(_handle, index, BonePalette::BINDING);
+    }
+
+    index = glGetProgramResourceIndex(_handle, GL_SHADER_STORAGE_BLOCK, InstanceBuffer::BLOCK_NAME);
+    if (index != GL_INVALID_INDEX) {
+        glShaderStorageBlockBinding(_handle, index, InstanceBuffer::BINDING);
+    }
+}
+
+bool Shader::loadShader(std::string file, GLenum shaderType, GLuint& handle) {
+    std::string source;
+    if (!readShaderFile(file, source)) {
+        return false;
+    }
+    std::cout << "Read shader: " << file << std::endl;
+    return compileShader(source, shaderType, shaderName(file), handle);
+}
+
+bool Shader::compileShader(const std::string& source, GLenum shaderType, const std::string& name, GLuint& handle) {
+    handle = glCreateShader(shaderType);
+    if (handle == 0) {
+        std::cerr << "Failed to create " << name << std::endl;
+        return false;
+    }
+
+    const char* code = source.c_str();
+    glShaderSource(handle, 1, &code, nullptr);
+    glCompileShader(handle);
+
+    GLint succeeded;
+    glGetShaderiv(handle, GL_COMPILE_STATUS, &succeeded);
+    if (succeeded == GL_FALSE) {
+        GLint logSize;
+        glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &logSize);
+        std::vector<GLchar> message(std::max(logSize, 1));
+        glGetShaderInfoLog(handle, logSize, nullptr, message.data());
+        std::cerr << "Failed to compile shader: " << name << "\n" << message.data() << std::endl;
+        glDeleteShader(handle);
+        handle = 0;
+        return false;
+    }
+    return true;
+}
+
+bool Shader::buildProgram(const std::string& vsSource, const std::string& fsSource) {
+    GLuint vertexShader = 0;
+    GLuint fragmentShader = 0;
+    std::string vsName = _useFileAsSource ? shaderName(_vs) : "default vertex shader";
+    std::string fsName = _useFileAsSource ? shaderName(_fs) : "default fragment shader";
+    if (!compileShader(vsSource, GL_VERTEX_SHADER, vsName, vertexShader)) {
+        return false;
+    }
+    if (!compileShader(fsSource, GL_FRAGMENT_SHADER, fsName, fragmentShader)) {
+        glDeleteShader(vertexShader);
+        return false;
+    }
+
+    _handle = glCreateProgram();
+    glAttachShader(_handle, vertexShader);
+    glAttachShader(_handle, fragmentShader);
+    // must be set before linking, otherwise the driver may not keep the binary around
+    glProgramParameteri(_handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(_handle);
+
+    glDetachShader(_handle, vertexShader);
+    glDetachShader(_handle, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint succeeded;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &succeeded);
+    if (succeeded == GL_FALSE) {
+        GLint logSize;
+        glGetProgramiv(_handle, GL_INFO_LOG_LENGTH, &logSize);
+        std::vector<GLchar> message(std::max(logSize, 1));
+        glGetProgramInfoLog(_handle, logSize, nullptr, message.data());
+        std::cerr << "Failed to link shader program: " << vsName << "/" << fsName << "\n" << message.data() << std::endl;
+        glDeleteProgram(_handle);
+        _handle = 0;
+        return false;
+    }
+    return true;
+}
+
+uint64_t Shader::programCacheKey(const std::string& vsSource, const std::string& fsSource) {
+    uint64_t seed = assetHash(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const GLubyte* value = glGetString(name);
+        seed = assetHash(std::string(value ? reinterpret_cast<const char*>(value) : ""), seed);
+    }
+    // the sources carry their own #defines, so hashing the full text covers them as well
+    uint64_t vsLength = vsSource.size();
+    seed = assetHash(&vsLength, sizeof(vsLength), seed);
+    seed = assetHash(vsSource, seed);
+    return assetHash(fsSource, seed);
+}
+
+bool Shader::loadProgramBinary(uint64_t key, float& coldMs) {
+    std::string path = assetCachePath(key, ".glprog");
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    BinaryReader reader(file.data(), file.size());
+    if (reader.read<uint32_t>() != PROGRAM_CACHE_MAGIC || reader.read<uint32_t>() != PROGRAM_CACHE_VERSION || reader.read<uint64_t>() != key) {
+        std::cout << "[ShaderCache] ignoring outdated cache entry " << path << std::endl;
+        return false;
+    }
+    coldMs = reader.read<float>();
+    GLenum format = reader.read<uint32_t>();
+    uint32_t size = reader.read<uint32_t>();
+    const char* binary = reader.view<char>(size);
+    if (!reader.ok()) {
+        std::cout << "[ShaderCache] ignoring truncated cache entry " << path << std::endl;
+        return false;
+    }
+
+    _handle = glCreateProgram();
+    glProgramBinary(_handle, format, binary, GLsizei(size));
+    GLint succeeded;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &succeeded);
+    if (succeeded == GL_FALSE) {
+        std::cout << "[ShaderCache] driver rejected cached binary " << path << ", recompiling" << std::endl;
+        glDeleteProgram(_handle);
+        _handle = 0;
+        return false;
+    }
+    return true;
+}
+
+void Shader::storeProgramBinary(uint64_t key, float coldMs) {
+    GLint length = 0;
+    glGetProgramiv(_handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(_handle, length, &length, &format, binary.data());
+
+    std::string path = assetCachePath(key, ".glprog");
+    BinaryWriter writer(path);
+    writer.write(PROGRAM_CACHE_MAGIC);
+    writer.write(PROGRAM_CACHE_VERSION);
+    writer.write(key);
+    writer.write(coldMs);
+    writer.write(static_cast<uint32_t>(format));
+    writer.write(static_cast<uint32_t>(length));
+    writer.writeArray(binary.data(), static_cast<size_t>(length));
+    if (!writer.commit()) {
+        std::cout << "[ShaderCache] failed to write cache entry " << path << std::endl;
+    }
+}
+
+GLint Shader::getUniformLocation(UniformName uniform) {
+    auto it = _locations.find(uniform.hash);
+    if (it != _locations.end()) {
+        if (it->second.name == uniform.name) {
+            return it->second.location;
+        }
+        // two names with the same hash, the first one keeps the slot and the other asks GL every time
+        if (!it->second.collided) {
+            it->second.collided = true;
+            std::cout << "[Shader] uniforms " << it->second.name << " and " << uniform.name << " have the same hash" << std::endl;
+        }
+        return glGetUniformLocation(_handle, uniform.name);
+    }
+    GLint location = glGetUniformLocation(_handle, uniform.name);
+    _locations.emplace(uniform.hash, UniformSlot{ location, uniform.name, false });
+    return location;
+}
+
+bool Shader::uniformChanged(GLint location, UniformValue::Type type, const void* value, size_t size) {
+    if (location < 0) {
+        return false;
+    }
+    if (size_t(location) >= _values.size()) {
+        _values.resize(size_t(location) + 1);
+    }
+    UniformValue& cached = _values[location];
+    if (cached.size == size && std::memcmp(cached.data, value, size) == 0
+        && !(GLState::instance().validating() && staleUniform(location, cached))) {
+        return false;
+    }
+    cached.type = type;
+    cached.size = uint8_t(size);
+    std::memcpy(cached.data, value, size);
+    return true;
+}
+
+bool Shader::staleUniform(GLint location, const UniformValue& cached) const {
+    float actual[16] = {};
+    switch (cached.type) {
+    case UniformValue::INT:
+        glGetUniformiv(_handle, location, reinterpret_cast<GLint*>(actual));
+        break;
+    case UniformValue::UINT:
+        glGetUniformuiv(_handle, location, reinterpret_cast<GLuint*>(actual));
+        break;
+    case UniformValue::FLOAT:
+        glGetUniformfv(_handle, location, actual);
+        break;
+    }
+    if (std::memcmp(actual, cached.data, cached.size) == 0) {
+        return false;
+    }
+    std::cout << "[GLState] stale uniform at location " << location << " of " << _vs << " / " << _fs << std::endl;
+    return true;
+}
+
+void Shader::setUniform(UniformName uniform, const int i) {
+    setUniform(getUniformLocation(uniform), i);
+}
+
+void Shader::setUniform(GLint location, const int i) {
+    if (uniformChanged(location, UniformValue::INT, &i, sizeof(i))) {
+        glProgramUniform1i(_handle, location, i);
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const unsigned int i) {
+    setUniform(getUniformLocation(uniform), i);
+}
+
+void Shader::setUniform(GLint location, const unsigned int i) {
+    if (uniformChanged(location, UniformValue::UINT, &i, sizeof(i))) {
+        glProgramUniform1ui(_handle, location, i);
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const float f) {
+    setUniform(getUniformLocation(uniform), f);
+}
+
+void Shader::setUniform(GLint location, const float f) {
+    if (uniformChanged(location, UniformValue::FLOAT, &f, sizeof(f))) {
+        glProgramUniform1f(_handle, location, f);
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const glm::mat4& mat) {
+    setUniform(getUniformLocation(uniform), mat);
+}
+
+void Shader::setUniform(GLint location, const glm::mat4& mat) {
+    if (uniformChanged(location, UniformValue::FLOAT, glm::value_ptr(mat), sizeof(mat))) {
+        glProgramUniformMatrix4fv(_handle, location, 1, GL_FALSE, glm::value_ptr(mat));
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const glm::mat3& mat) {
+    setUniform(getUniformLocation(uniform), mat);
+}
+
+void Shader::setUniform(GLint location, const glm::mat3& mat) {
+    if (uniformChanged(location, UniformValue::FLOAT, glm::value_ptr(mat), sizeof(mat))) {
+        glProgramUniformMatrix3fv(_handle, location, 1, GL_FALSE, glm::value_ptr(mat));
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const glm::vec2& vec) {
+    setUniform(getUniformLocation(uniform), vec);
+}
+
+void Shader::setUniform(GLint location, const glm::vec2& vec) {
+    if (uniformChanged(location, UniformValue::FLOAT, glm::value_ptr(vec), sizeof(vec))) {
+        glProgramUniform2f(_handle, location, vec.x, vec.y);
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const glm::vec3& vec) {
+    setUniform(getUniformLocation(uniform), vec);
+}
+
+void Shader::setUniform(GLint location, const glm::vec3& vec) {
+    if (uniformChanged(location, UniformValue::FLOAT, glm::value_ptr(vec), sizeof(vec))) {
+        glProgramUniform3f(_handle, location, vec.x, vec.y, vec.z);
+    }
+}
+
+void Shader::setUniform(UniformName uniform, const glm::vec4& vec) {
+    setUniform(getUniformLocation(uniform), vec);
+}
+
+void Shader::setUniform(GLint location, const glm::vec4& vec) {
+    if (uniformChanged(location, UniformValue::FLOAT, glm::value_ptr(vec), sizeof(vec))) {
+        glProgramUniform4f(_handle, location, vec.x, vec.y, vec.z, vec.w);
+    }
+}
+
+void Shader::setUniformArr(std::string arr, unsigned int i, std::string prop, const glm::vec3& vec) {
+    setUniform(UniformName(arr + "[" + std::to_string(i) + "]." + prop), vec);
+}
+
+void Shader::setUniformArr(std::string arr, unsigned int i, std::string prop, const float f) {
+    setUniform(UniformName(arr + "[" + std::to_string(i) + "]." + prop), f);
+}
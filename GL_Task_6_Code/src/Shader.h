@@ -6,15 +6,58 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <cstdint>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include "Utils.h"
 
+/*!
+ * Name of a uniform together with its FNV-1a hash. String literals convert implicitly and the
+ * compiler folds their hash, names built at runtime have to be converted explicitly.
+ */
+struct UniformName {
+    const char* name;
+    uint32_t hash;
+
+    template <size_t N>
+    constexpr UniformName(const char (&text)[N])
+        : name(text)
+        , hash(hashOf(text, N - 1)) {}
+
+    explicit UniformName(const std::string& text)
+        : name(text.c_str())
+        , hash(hashOf(text.c_str(), text.size())) {}
+
+    // for names whose hash was computed once up front
+    constexpr UniformName(const char* text, uint32_t hash)
+        : name(text)
+        , hash(hash) {}
+
+    static constexpr uint32_t hashOf(const char* text, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ uint8_t(text[i])) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+/*!
+ * Resolved uniform location of a given type, see Shader::uniform and Shader::set
+ */
+template <typename T>
+struct Uniform {
+    GLint location = -1;
+
+    bool valid() const { return location >= 0; }
+};
 
 /*!
  * Shader class that encapsulates all shader access
@@ -37,9 +80,34 @@ class Shader {
     bool _useFileAsSource;
 
     /*!
-     * Stores the shader location names with their location IDs
+     * Location of a uniform and the name it was resolved from (to catch hash collisions)
+     */
+    struct UniformSlot {
+        GLint location;
+        std::string name;
+        // another name with the same hash was looked up and reported
+        bool collided;
+    };
+
+    /*!
+     * Stores the uniform locations by the hash of their names, the name is compared on every hit
+     */
+    std::unordered_map<uint32_t, UniformSlot> _locations;
+
+    /*!
+     * Last value written to a uniform location, the type tells validation which glGetUniform to use
      */
-    std::unordered_map<std::string, GLint> _locations;
+    struct UniformValue {
+        enum Type : uint8_t { INT, UINT, FLOAT };
+        Type type = FLOAT;
+        uint8_t size = 0;
+        float data[16];
+    };
+
+    /*!
+     * Stores the last written values by location, writes of the same value are skipped
+     */
+    std::vector<UniformValue> _values;
 
     /*!
      * Loads the specified vertex and fragment shaders
@@ -47,6 +115,11 @@ class Shader {
      */
     GLuint loadShaders();
 
+    /*!
+     * Binds the uniform blocks the program declares to their fixed binding points
+     */
+    void bindUniformBlocks();
+
     /*!
      * Loads a shader from a given file and compiles it
      * @param file: path to the shader
@@ -57,10 +130,55 @@ class Shader {
     bool loadShader(std::string file, GLenum shaderType, GLuint& handle);
 
     /*!
-     * @param uniform: uniform string in shader
+     * Compiles shader source code
+     * @param source: GLSL source
+     * @param shaderType: type of the shader (e.g. GL_VERTEX_SHADER or GL_FRAGMENT_SHADER)
+     * @param name: name used in error messages
+     * @param handle: shader handle
+     * @return if the shader could be compiled
+     */
+    bool compileShader(const std::string& source, GLenum shaderType, const std::string& name, GLuint& handle);
+
+    /*!
+     * Compiles and links the given sources into _handle
+     * @return if the program could be linked
+     */
+    bool buildProgram(const std::string& vsSource, const std::string& fsSource);
+
+    /*!
+     * Creates _handle from a cached program binary
+     * @param key: key of the cache entry (see programCacheKey)
+     * @param coldMs: receives the compile and link time stored with the binary
+     * @return false if there is no entry or the driver rejected the binary
+     */
+    bool loadProgramBinary(uint64_t key, float& coldMs);
+
+    /*!
+     * Writes the linked program in _handle to the cache
+     */
+    void storeProgramBinary(uint64_t key, float coldMs);
+
+    /*!
+     * @return the cache key of a program, covering both sources and the driver (vendor, renderer, version)
+     */
+    static uint64_t programCacheKey(const std::string& vsSource, const std::string& fsSource);
+
+    /*!
+     * @param uniform: name of the uniform in the shader
      * @return the location ID of the uniform
      */
-    GLint getUniformLocation(std::string uniform);
+    GLint getUniformLocation(UniformName uniform);
+
+    /*!
+     * Compares a write with the last value written to the location and records it
+     * @return if the value has to be sent to GL
+     */
+    bool uniformChanged(GLint location, UniformValue::Type type, const void* value, size_t size);
+
+    /*!
+     * @return if GL holds a different value than the cache for the location (validation mode)
+     */
+    bool staleUniform(GLint location, const UniformValue& cached) const;
 
   public:
     /*!
@@ -79,7 +197,7 @@ class Shader {
     ~Shader();
 
     /*!
-     * Uses the shader with glUseProgram
+     * Uses the shader with glUseProgram, skipped if it already is in use
      */
     void use() const;
 
@@ -88,12 +206,19 @@ class Shader {
      */
     void unuse() const;
 
+    /*!
+     * Forgets the cached uniform values, needed after writing uniforms with glUniform directly
+     */
+    void forgetUniformValues() {
+        _values.clear();
+    }
+
     /*!
      * Sets an integer uniform in the shader
      * @param uniform: the name of the uniform
      * @param i: the value to be set
      */
-    void setUniform(std::string uniform, const int i);
+    void setUniform(UniformName uniform, const int i);
     /*!
      * Sets an integer uniform in the shader
      * @param location: location ID of the uniform
@@ -105,7 +230,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param i: the value to be set
      */
-    void setUniform(std::string uniform, const unsigned int i);
+    void setUniform(UniformName uniform, const unsigned int i);
     /*!
      * Sets an unsigned integer uniform in the shader
      * @param location: location ID of the uniform
@@ -117,7 +242,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param f: the value to be set
      */
-    void setUniform(std::string uniform, const float f);
+    void setUniform(UniformName uniform, const float f);
     /*!
      * Sets a float uniform in the shader
      * @param location: location ID of the uniform
@@ -129,7 +254,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param mat: the value to be set
      */
-    void setUniform(std::string uniform, const glm::mat4& mat);
+    void setUniform(UniformName uniform, const glm::mat4& mat);
     /*!
      * Sets a 4x4 matrix uniform in the shader
      * @param location: location ID of the uniform
@@ -141,7 +266,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param mat: the value to be set
      */
-    void setUniform(std::string uniform, const glm::mat3& mat);
+    void setUniform(UniformName uniform, const glm::mat3& mat);
     /*!
      * Sets a 3x3 matrix uniform in the shader
      * @param location: location ID of the uniform
@@ -153,7 +278,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param vec: the value to be set
      */
-    void setUniform(std::string uniform, const glm::vec2& vec);
+    void setUniform(UniformName uniform, const glm::vec2& vec);
     /*!
      * Sets a 2D vector uniform in the shader
      * @param location: location ID of the uniform
@@ -165,7 +290,7 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param vec: the value to be set
      */
-    void setUniform(std::string uniform, const glm::vec3& vec);
+    void setUniform(UniformName uniform, const glm::vec3& vec);
     /*!
      * Sets a 3D vector uniform in the shader
      * @param location: location ID of the uniform
@@ -177,13 +302,31 @@ class Shader {
      * @param uniform: the name of the uniform
      * @param vec: the value to be set
      */
-    void setUniform(std::string uniform, const glm::vec4& vec);
+    void setUniform(UniformName uniform, const glm::vec4& vec);
     /*!
      * Sets a 4D vector uniform in the shader
      * @param location: location ID of the uniform
      * @param vec: the value to be set
      */
     void setUniform(GLint location, const glm::vec4& vec);
+    /*!
+     * Resolves a uniform once, the handle stays valid as long as the shader lives
+     * @param uniform: the name of the uniform
+     * @return handle for set(), invalid if the shader has no such uniform
+     */
+    template <typename T>
+    Uniform<T> uniform(UniformName uniform) {
+        return Uniform<T>{ getUniformLocation(uniform) };
+    }
+    /*!
+     * Sets a uniform through a handle
+     * @param uniform: handle from uniform()
+     * @param value: the value to be set
+     */
+    template <typename T>
+    void set(Uniform<T> uniform, const std::common_type_t<T>& value) {
+        setUniform(uniform.location, value);
+    }
     /*!
      * Sets a uniform array property
      * @param arr: name of the uniform array
@@ -8,6 +8,8 @@
 #include <memory>
 #include <vector>
 #include "Model.h"
+#include "AssetLoader.h"
+#include "GLState.h"
 
 class Skybox {
 
@@ -17,9 +19,9 @@ private:
                  skyboxEBO, 
                  cubemapTexture;
 
-public:
+    TextureRef cubemap;
 
-    Skybox::Skybox() {
+    void createBuffers() {
         float skyboxVertices[] =
         {
             -100.0f, -100.0f,  100.0f,
@@ -56,7 +58,7 @@ public:
         glGenVertexArrays(1, &skyboxVAO);
         glGenBuffers(1, &skyboxVBO);
         glGenBuffers(1, &skyboxEBO);
-        glBindVertexArray(skyboxVAO);
+        GLState::instance().bindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skyboxEBO);
@@ -64,67 +66,45 @@ public:
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::instance().bindVertexArray(0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
 
-        std::string facesCubemap[6] =
-        {
-            gcgFindTextureFile("assets/geometry/cubemap/right.png"),
-            gcgFindTextureFile("assets/geometry/cubemap/left.png"),
-            gcgFindTextureFile("assets/geometry/cubemap/top.png"),
-            gcgFindTextureFile("assets/geometry/cubemap/bottom.png"),
-            gcgFindTextureFile("assets/geometry/cubemap/front.png"),
-            gcgFindTextureFile("assets/geometry/cubemap/back.png")
-        };
-
-        glGenTextures(1, &cubemapTexture);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+public:
 
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    Skybox::Skybox() {
+        createBuffers();
+        decodeFaces();
+        uploadFaces();
+    }
 
-        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    // schedules face decoding on the loader's workers, the upload follows on the GL thread
+    Skybox(AssetLoader& loader) {
+        createBuffers();
+        loader.add("cubemap", [this] { decodeFaces(); }, [this] { uploadFaces(); });
+    }
 
-        for (unsigned int i = 0; i < 6; i++)
-        {
-            int width, height, nrChannels;
-            unsigned char* data = stbi_load(facesCubemap[i].c_str(), &width, &height, &nrChannels, 0);
-            if (data)
-            {
-                stbi_set_flip_vertically_on_load(false);
-                glTexImage2D
-                (
-                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                    0,
-                    GL_RGB,
-                    width,
-                    height,
-                    0,
-                    GL_RGB,
-                    GL_UNSIGNED_BYTE,
-                    data
-                );
-                stbi_image_free(data);
-            }
-            else
-            {
-                std::cout << "Failed to load texture: " << facesCubemap[i] << std::endl;
-                stbi_image_free(data);
-            }
-        }
+    void decodeFaces() {
+        cubemap = TextureRegistry::instance().acquireCube({
+            "assets/geometry/cubemap/right.png",
+            "assets/geometry/cubemap/left.png",
+            "assets/geometry/cubemap/top.png",
+            "assets/geometry/cubemap/bottom.png",
+            "assets/geometry/cubemap/front.png",
+            "assets/geometry/cubemap/back.png"
+        });
+    }
 
+    void uploadFaces() {
+        cubemapTexture = cubemap->id();
     }
 
     void Skybox::draw() {
-        glDepthFunc(GL_LEQUAL);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0 + 1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        GLState& state = GLState::instance();
+        state.depthFunc(GL_LEQUAL);
+        state.bindVertexArray(skyboxVAO);
+        state.bindTexture(1, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+        state.depthFunc(GL_LESS);
     }
 };
\ No newline at end of file
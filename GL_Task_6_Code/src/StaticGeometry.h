@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "FrustumCuller.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+#include "Material.h"
+#include "MeshLod.h"
+#include "Mesh.h"
+#include "OcclusionCuller.h"
+#include "Pvs.h"
+#include "RenderQueue.h"
+#include "VertexFormat.h"
+
+/*!
+ * Meshes that never move, packed into one vertex and one index arena and drawn with
+ * glMultiDrawElementsIndirect. Every added mesh becomes a draw with its own instance (transform)
+ * in an InstanceBuffer; build() sorts the draws of a pass by program, material and texture set
+ * like RenderQueue does, and each run that shares that state is one indirect call. Passes whose
+ * shader samples no textures, like the shadow pass, are a single call.
+ *
+ * Levels of detail, enabled objects, frustum culling and software occlusion culling are applied
+ * when the commands are written, once per pass and frame; the potentially visible set of the camera
+ * cell only to the camera passes, the shadow pass keeps casters outside the set. The world space
+ * bounds of the draws are fixed, so the culler is filled and the occlusion queries are registered once.
+ */
+class StaticGeometry {
+public:
+    StaticGeometry() = default;
+    StaticGeometry(const StaticGeometry&) = delete;
+    StaticGeometry& operator=(const StaticGeometry&) = delete;
+
+    ~StaticGeometry() {
+        if (_vao != 0) {
+            glDeleteBuffers(1, &_vbo);
+            glDeleteBuffers(1, &_ebo);
+            glDeleteBuffers(1, &_commandBuffer);
+            glDeleteVertexArrays(1, &_vao);
+            GLState::instance().forgetVertexArray(_vao);
+        }
+    }
+
+    /*!
+     * Adds the meshes of an object to a pass, before build()
+     * @return id of the object for setEnabled
+     */
+    size_t add(RenderPass pass, const std::vector<Mesh>& meshes, Material& material, const glm::mat4& modelMatrix) {
+        size_t object = _enabled.size();
+        _enabled.push_back(true);
+        for (const Mesh& mesh : meshes) {
+            if (mesh.VertexFlags() & VERTEX_SKINNED) {
+                std::cout << "[StaticGeometry] skipping a skinned mesh, it has to be drawn on its own" << std::endl;
+                continue;
+            }
+            bool textured = mesh.SamplesTextures(*material.getShader());
+            _draws.push_back({ &mesh, &material, pass, object, modelMatrix, glm::vec3(0.0f), glm::vec3(0.0f), textured, textured ? mesh.TextureSet() : 0, 0, 0, 0 });
+        }
+        return object;
+    }
+
+    void setEnabled(size_t object, bool enabled) {
+        _enabled[object] = enabled;
+    }
+
+    /*!
+     * Copies the meshes into the arenas, uploads the instances and sorts the draws into groups
+     */
+    void build() {
+        uint32_t flags = 0;
+        for (const Draw& draw : _draws) {
+            flags |= draw.mesh->VertexFlags() & VERTEX_WIDE_UV;
+        }
+        VertexLayout layout(flags);
+
+        // meshes drawn in several passes or with several materials are stored once
+        std::vector<unsigned char> vertices;
+        std::vector<GLuint> indices;
+        std::unordered_map<const Mesh*, std::pair<GLint, GLuint>> ranges;
+        std::vector<unsigned char> meshVertices;
+        std::vector<unsigned char> meshIndices;
+        for (const Draw& draw : _draws) {
+            if (ranges.count(draw.mesh)) {
+                continue;
+            }
+            GLint baseVertex = GLint(vertices.size() / layout.stride);
+            ranges[draw.mesh] = { baseVertex, GLuint(indices.size()) };
+            draw.mesh->ReadBack(meshVertices, meshIndices);
+            appendVertices(meshVertices, VertexLayout(draw.mesh->VertexFlags()), layout, vertices);
+            appendIndices(meshIndices, draw.mesh->VertexFlags() & INDEX_16, indices);
+        }
+
+        std::stable_sort(_draws.begin(), _draws.end(), [](const Draw& a, const Draw& b) {
+            return std::make_tuple(a.pass, a.material->getShader()->getHandle(), a.material->getId(), a.textured, a.textureSet)
+                 < std::make_tuple(b.pass, b.material->getShader()->getHandle(), b.material->getId(), b.textured, b.textureSet);
+        });
+        _instances.begin();
+        _culler.clear();
+        _cellVisible.clear();
+        _cell = -1;
+        _groups.clear();
+        for (size_t i = 0; i < _draws.size(); i++) {
+            Draw& draw = _draws[i];
+            draw.baseVertex = ranges[draw.mesh].first;
+            draw.firstIndex = ranges[draw.mesh].second;
+            draw.instance = _instances.add(draw.modelMatrix, glm::vec4(1.0f));
+            _culler.add(draw.mesh->Bounds(), draw.mesh->BoxMin(), draw.mesh->BoxMax(), draw.modelMatrix);
+            glm::vec3 center;
+            glm::vec3 extent;
+            FrustumCuller::worldBox(draw.mesh->BoxMin(), draw.mesh->BoxMax(), draw.modelMatrix, center, extent);
+            draw.worldMin = center - extent;
+            draw.worldMax = center + extent;
+            if (_groups.empty() || _groups.back().pass != draw.pass || _groups.back().material != draw.material
+                || !sameTextures(_draws[_groups.back().first], draw)) {
+                _groups.push_back({ draw.pass, draw.material, i, i });
+            }
+            _groups.back().end = i + 1;
+        }
+        _instances.upload(GL_STATIC_DRAW);
+
+        GLState& state = GLState::instance();
+        glGenVertexArrays(1, &_vao);
+        glGenBuffers(1, &_vbo);
+        glGenBuffers(1, &_ebo);
+        glGenBuffers(1, &_commandBuffer);
+        state.bindVertexArray(_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        layout.apply();
+        InstanceBuffer::setupIndexAttribute();
+        state.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        std::cout << "[StaticGeometry] " << ranges.size() << " meshes, " << vertices.size() / layout.stride << " vertices, "
+                  << indices.size() << " indices; " << _draws.size() << " draws in " << _groups.size() << " groups" << std::endl;
+    }
+
+    /*!
+     * Skips the draws outside the potentially visible set of cell from now on, -1 draws everything.
+     * The shadow pass ignores the set, hidden walls still cast shadows into visible cells.
+     */
+    void setVisibleCells(const Pvs& pvs, int cell) {
+        if (cell == _cell) {
+            return;
+        }
+        _cell = cell;
+        _cellVisible.resize(_draws.size());
+        for (size_t i = 0; i < _draws.size(); i++) {
+            _cellVisible[i] = pvs.visible(cell, _draws[i].worldMin, _draws[i].worldMax);
+        }
+    }
+
+    /*!
+     * Registers the bounds of every draw as a query of occlusion, after build()
+     */
+    void addOcclusionQueries(OcclusionCuller& occlusion) {
+        for (size_t i = 0; i < _draws.size(); i++) {
+            size_t query = occlusion.addQuery(_draws[i].worldMin, _draws[i].worldMax);
+            if (i == 0) {
+                _firstQuery = query;
+            }
+        }
+    }
+
+    // calls function(worldMin, worldMax, full detail triangles) for the enabled draws of a pass
+    template <typename Function>
+    void forEachDraw(RenderPass pass, Function function) const {
+        for (const Draw& draw : _draws) {
+            if (draw.pass == pass && _enabled[draw.object]) {
+                function(draw.worldMin, draw.worldMax, size_t(draw.mesh->Lod(0).indexCount / 3));
+            }
+        }
+    }
+
+    /*!
+     * Draws the enabled objects of a pass, one indirect call per group
+     * @param view: picks the level of detail of each draw
+     * @param frustum: if set, draws whose bounds lie outside are skipped
+     * @param occlusion: if set, draws its last render() found hidden are skipped; needs addOcclusionQueries()
+     */
+    void draw(RenderPass pass, const LodView& view, const Frustum* frustum = nullptr, const OcclusionCuller* occlusion = nullptr) {
+        _commands.clear();
+        _groupCommands.clear();
+        if (frustum) {
+            _culler.cull(*frustum, _visible);
+        }
+        size_t meshes = 0;
+        size_t visibleMeshes = 0;
+        size_t triangles = 0;
+        size_t visibleTriangles = 0;
+        size_t occludedMeshes = 0;
+        size_t occludedTriangles = 0;
+        for (const Group& group : _groups) {
+            if (group.pass != pass) {
+                continue;
+            }
+            GroupCommands commands = { &group, _commands.size(), 0, 0, 0 };
+            for (size_t i = group.first; i < group.end; i++) {
+                const Draw& draw = _draws[i];
+                if (!_enabled[draw.object]) {
+                    continue;
+                }
+                size_t meshTriangles = draw.mesh->Lod(0).indexCount / 3;
+                meshes++;
+                triangles += meshTriangles;
+                if ((frustum && !_visible[i]) || (pass != RENDER_PASS_SHADOW && !_cellVisible.empty() && !_cellVisible[i])) {
+                    continue;
+                }
+                if (occlusion && !occlusion->queryVisible(_firstQuery + i)) {
+                    occludedMeshes++;
+                    occludedTriangles += meshTriangles;
+                    continue;
+                }
+                visibleMeshes++;
+                visibleTriangles += meshTriangles;
+                const MeshLod& level = draw.mesh->Lod(draw.mesh->selectLod(view, draw.modelMatrix));
+                _commands.push_back({ level.indexCount, 1, draw.firstIndex + level.indexOffset, draw.baseVertex, draw.instance });
+                commands.triangles += level.indexCount / 3;
+                commands.fullDetailTriangles += meshTriangles;
+            }
+            commands.count = _commands.size() - commands.first;
+            if (commands.count > 0) {
+                _groupCommands.push_back(commands);
+            }
+        }
+        if (frustum) {
+            RenderStats::instance().addCulling(visibleMeshes, meshes, visibleTriangles, triangles);
+        }
+        if (occlusion) {
+            RenderStats::instance().addOcclusion(occludedMeshes, occludedTriangles);
+        }
+        if (_commands.empty()) {
+            return;
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, _commands.size() * sizeof(Command), _commands.data(), GL_STREAM_DRAW);
+        GLState::instance().bindVertexArray(_vao);
+        _instances.bind();
+        for (const GroupCommands& commands : _groupCommands) {
+            const Group& group = *commands.group;
+            Shader* shader = group.material->getShader();
+            shader->use();
+            group.material->setUniforms();
+            if (_draws[group.first].textured) {
+                _draws[group.first].mesh->BindTextures(*shader);
+            }
+            group.material->setInstanced(true);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(commands.first * sizeof(Command)), GLsizei(commands.count), 0);
+            RenderStats::instance().addDraw(commands.triangles, commands.fullDetailTriangles);
+        }
+        for (const GroupCommands& commands : _groupCommands) {
+            commands.group->material->setInstanced(false);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+private:
+    // layout glMultiDrawElementsIndirect reads
+    struct Command {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Draw {
+        const Mesh* mesh;
+        Material* material;
+        RenderPass pass;
+        size_t object;
+        glm::mat4 modelMatrix;
+        glm::vec3 worldMin;
+        glm::vec3 worldMax;
+        // if the shader samples any of the mesh's textures
+        bool textured;
+        // hash of the textures for sorting, 0 if untextured
+        uint32_t textureSet;
+        GLint baseVertex;
+        GLuint firstIndex;
+        uint32_t instance;
+    };
+
+    // draws first..end-1 share pass, material and textures
+    struct Group {
+        RenderPass pass;
+        Material* material;
+        size_t first;
+        size_t end;
+    };
+
+    struct GroupCommands {
+        const Group* group;
+        size_t first;
+        size_t count;
+        size_t triangles;
+        size_t fullDetailTriangles;
+    };
+
+    // a group binds the textures of its first draw for all of them, so the lists have to match, not only their hashes
+    static bool sameTextures(const Draw& a, const Draw& b) {
+        return a.textured == b.textured && (!a.textured || a.mesh->SameTextures(*b.mesh));
+    }
+
+    // converts to the arena layout, which only differs in the precision of the uvs
+    static void appendVertices(const std::vector<unsigned char>& source, const VertexLayout& from, const VertexLayout& to, std::vector<unsigned char>& arena) {
+        size_t count = source.size() / from.stride;
+        size_t start = arena.size();
+        arena.resize(start + count * to.stride);
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char* in = source.data() + i * from.stride;
+            unsigned char* out = arena.data() + start + i * to.stride;
+            // position and normal
+            std::memcpy(out, in, 16);
+            if ((to.flags & VERTEX_WIDE_UV) && !(from.flags & VERTEX_WIDE_UV)) {
+                uint32_t half;
+                std::memcpy(&half, in + from.uvOffset, sizeof(half));
+                glm::vec2 uv = glm::unpackHalf2x16(half);
+                std::memcpy(out + to.uvOffset, &uv, sizeof(uv));
+            } else {
+                std::memcpy(out + to.uvOffset, in + from.uvOffset, to.stride - to.uvOffset);
+            }
+        }
+    }
+
+    // the arena indexes with 32 bits, the base vertex of each draw keeps the indices local
+    static void appendIndices(const std::vector<unsigned char>& source, bool shortIndices, std::vector<GLuint>& arena) {
+        if (shortIndices) {
+            const uint16_t* in = reinterpret_cast<const uint16_t*>(source.data());
+            arena.insert(arena.end(), in, in + source.size() / sizeof(uint16_t));
+        } else {
+            const GLuint* in = reinterpret_cast<const GLuint*>(source.data());
+            arena.insert(arena.end(), in, in + source.size() / sizeof(GLuint));
+        }
+    }
+
+    std::vector<Draw> _draws;
+    std::vector<Group> _groups;
+    std::vector<bool> _enabled;
+    InstanceBuffer _instances;
+    FrustumCuller _culler;
+    std::vector<uint8_t> _visible;
+    std::vector<uint8_t> _cellVisible;
+    int _cell = -1;
+    size_t _firstQuery = 0;
+
+    GLuint _vao = 0;
+    GLuint _vbo = 0;
+    GLuint _ebo = 0;
+    GLuint _commandBuffer = 0;
+    std::vector<Command> _commands;
+    std::vector<GroupCommands> _groupCommands;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "GLState.h"
+#include "Shader.h"
+
+/*!
+ * The ASCII glyphs of one font face packed into a single GL_R8 texture (shelf packing, rows of
+ * glyphs sorted by height). Metrics are in pixels of the rasterized size, uv rectangles in atlas space.
+ */
+class GlyphAtlas {
+public:
+    struct Glyph {
+        glm::ivec2 size;     // size of the glyph bitmap
+        glm::ivec2 bearing;  // offset from the baseline to the left/top of the bitmap
+        float advance = 0;   // horizontal offset to the next glyph
+        glm::vec2 uvMin;     // top left corner in the atlas
+        glm::vec2 uvMax;     // bottom right corner in the atlas
+    };
+
+    GlyphAtlas() = default;
+    GlyphAtlas(const GlyphAtlas&) = delete;
+    GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+    ~GlyphAtlas() {
+        if (_texture != 0) {
+            glDeleteTextures(1, &_texture);
+            GLState::instance().forgetTexture(_texture);
+        }
+    }
+
+    /*!
+     * Rasterizes the first 128 characters of the face (its pixel size has to be set) into the atlas
+     * @param width: atlas width, the height is chosen to fit
+     */
+    bool build(FT_Face face, int width = 512) {
+        struct Bitmap {
+            unsigned char c;
+            int width;
+            int rows;
+            std::vector<unsigned char> pixels;
+        };
+        std::vector<Bitmap> bitmaps;
+        for (unsigned char c = 0; c < GLYPH_COUNT; c++) {
+            if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
+                std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+                continue;
+            }
+            const FT_Bitmap& bitmap = face->glyph->bitmap;
+            Glyph& glyph = _glyphs[c];
+            glyph.size = glm::ivec2(bitmap.width, bitmap.rows);
+            glyph.bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+            glyph.advance = float(face->glyph->advance.x >> 6);
+
+            Bitmap copy{ c, int(bitmap.width), int(bitmap.rows), {} };
+            copy.pixels.resize(size_t(copy.width) * copy.rows);
+            for (int row = 0; row < copy.rows; row++) {
+                std::copy_n(bitmap.buffer + row * bitmap.pitch, copy.width, copy.pixels.begin() + size_t(row) * copy.width);
+            }
+            bitmaps.push_back(std::move(copy));
+        }
+
+        // tallest glyphs first keeps the shelves tight
+        std::sort(bitmaps.begin(), bitmaps.end(), [](const Bitmap& a, const Bitmap& b) { return a.rows > b.rows; });
+        std::vector<glm::ivec2> positions(bitmaps.size());
+        int x = PADDING;
+        int y = PADDING;
+        int shelfHeight = 0;
+        for (size_t i = 0; i < bitmaps.size(); i++) {
+            if (x + bitmaps[i].width + PADDING > width) {
+                x = PADDING;
+                y += shelfHeight + PADDING;
+                shelfHeight = 0;
+            }
+            positions[i] = glm::ivec2(x, y);
+            x += bitmaps[i].width + PADDING;
+            shelfHeight = std::max(shelfHeight, bitmaps[i].rows);
+        }
+        int height = 1;
+        while (height < y + shelfHeight + PADDING) {
+            height *= 2;
+        }
+
+        std::vector<unsigned char> pixels(size_t(width) * height, 0);
+        for (size_t i = 0; i < bitmaps.size(); i++) {
+            const Bitmap& bitmap = bitmaps[i];
+            for (int row = 0; row < bitmap.rows; row++) {
+                std::copy_n(bitmap.pixels.begin() + size_t(row) * bitmap.width, bitmap.width,
+                            pixels.begin() + size_t(positions[i].y + row) * width + positions[i].x);
+            }
+            Glyph& glyph = _glyphs[bitmap.c];
+            glyph.uvMin = glm::vec2(positions[i]) / glm::vec2(width, height);
+            glyph.uvMax = glm::vec2(positions[i] + glm::ivec2(bitmap.width, bitmap.rows)) / glm::vec2(width, height);
+        }
+
+        glGenTextures(1, &_texture);
+        GLState::instance().bindTexture(GL_TEXTURE_2D, _texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        std::cout << "[GlyphAtlas] " << bitmaps.size() << " glyphs in one " << width << "x" << height << " texture" << std::endl;
+        return true;
+    }
+
+    const Glyph& glyph(char c) const { return _glyphs[static_cast<unsigned char>(c) % GLYPH_COUNT]; }
+    GLuint texture() const { return _texture; }
+
+private:
+    static const int GLYPH_COUNT = 128;
+    static const int PADDING = 1;
+
+    Glyph _glyphs[GLYPH_COUNT];
+    GLuint _texture = 0;
+};
+
+/*!
+ * Collects the glyph quads of any number of strings into one streaming vertex buffer and draws
+ * them with a single call. Vertices carry their color, so strings of different colors share the batch.
+ */
+class TextBatch {
+public:
+    TextBatch() = default;
+    TextBatch(const TextBatch&) = delete;
+    TextBatch& operator=(const TextBatch&) = delete;
+
+    ~TextBatch() {
+        if (_vbo != 0) {
+            glDeleteBuffers(1, &_vbo);
+            glDeleteVertexArrays(1, &_vao);
+            GLState::instance().forgetVertexArray(_vao);
+        }
+    }
+
+    void init(const GlyphAtlas* atlas) {
+        _atlas = atlas;
+        glGenVertexArrays(1, &_vao);
+        glGenBuffers(1, &_vbo);
+        GLState::instance().bindVertexArray(_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, color));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /*!
+     * Appends a string
+     * @param x, y: baseline origin in pixels
+     * @param scale: factor applied to the rasterized glyph size
+     */
+    void add(const std::string& text, float x, float y, float scale, glm::vec3 color) {
+        for (char c : text) {
+            const GlyphAtlas::Glyph& glyph = _atlas->glyph(c);
+            float xpos = x + glyph.bearing.x * scale;
+            float ypos = y - (glyph.size.y - glyph.bearing.y) * scale;
+            float w = glyph.size.x * scale;
+            float h = glyph.size.y * scale;
+            x += glyph.advance * scale;
+            if (glyph.size.x == 0 || glyph.size.y == 0) {
+                continue;
+            }
+
+            TextVertex topLeft = { glm::vec4(xpos, ypos + h, glyph.uvMin.x, glyph.uvMin.y), color };
+            TextVertex bottomLeft = { glm::vec4(xpos, ypos, glyph.uvMin.x, glyph.uvMax.y), color };
+            TextVertex bottomRight = { glm::vec4(xpos + w, ypos, glyph.uvMax.x, glyph.uvMax.y), color };
+            TextVertex topRight = { glm::vec4(xpos + w, ypos + h, glyph.uvMax.x, glyph.uvMin.y), color };
+            _vertices.insert(_vertices.end(), { topLeft, bottomLeft, bottomRight, topLeft, bottomRight, topRight });
+        }
+    }
+
+    bool empty() const { return _vertices.empty(); }
+
+    /*!
+     * Draws everything added since the last call and clears the batch
+     * @param shader: the font shader, its projection has to be set
+     */
+    void draw(Shader* shader) {
+        if (_vertices.empty()) {
+            return;
+        }
+        shader->use();
+        shader->setUniform("text", 0);
+        GLState::instance().bindTexture(0, GL_TEXTURE_2D, _atlas->texture());
+        GLState::instance().bindVertexArray(_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+
+        // orphan the previous storage so the driver does not wait for last frame's draw
+        size_t bytes = _vertices.size() * sizeof(TextVertex);
+        if (bytes > _capacity) {
+            _capacity = std::max(bytes, _capacity * 2);
+        }
+        glBufferData(GL_ARRAY_BUFFER, _capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, _vertices.data());
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(_vertices.size()));
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _vertices.clear();
+    }
+
+private:
+    struct TextVertex {
+        glm::vec4 position; // xy position, zw texture coordinates
+        glm::vec3 color;
+    };
+
+    const GlyphAtlas* _atlas = nullptr;
+    GLuint _vao = 0;
+    GLuint _vbo = 0;
+    size_t _capacity = 0;
+    std::vector<TextVertex> _vertices;
+};
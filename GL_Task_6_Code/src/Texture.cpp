@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023 Vienna University of Technology.
+ * Institute of Computer Graphics and Algorithms.
+ * This file is part of the GCG Lab Framework and must not be redistributed.
+ */
+#include "Texture.h"
+
+#include <gli/gl.hpp>
+#include <gli/load_dds.hpp>
+#include <gli/texture.hpp>
+
+#include "AssetPack.h"
+#include "GLState.h"
+
+Texture::Texture(std::string file)
+    : _handle(0)
+    , _init(false) {
+    // the DDS is parsed in place from the package (or the mapped loose file)
+    AssetView view = Vfs::instance().open(file);
+    gli::texture image = view.empty() ? gli::texture() : gli::load_dds(view.data, view.size);
+    if (image.empty()) {
+        std::cout << "Texture failed to load at path: " << file << std::endl;
+        return;
+    }
+
+    gli::gl gl(gli::gl::PROFILE_GL33);
+    gli::gl::format format = gl.translate(image.format(), image.swizzles());
+    bool compressed = gli::is_compressed(image.format());
+
+    glGenTextures(1, &_handle);
+    GLState::instance().bindTexture(GL_TEXTURE_2D, _handle);
+    for (size_t level = 0; level < image.levels(); level++) {
+        gli::extent3d extent = image.extent(level);
+        if (compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), format.Internal, extent.x, extent.y, 0, GLsizei(image.size(level)), image.data(0, 0, level));
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, GLint(level), format.Internal, extent.x, extent.y, 0, format.External, format.Type, image.data(0, 0, level));
+        }
+    }
+    // files without a prebuilt chain get theirs from the driver
+    if (image.levels() == 1) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels() - 1));
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    _init = true;
+}
+
+Texture::~Texture() {
+    if (_init) {
+        glDeleteTextures(1, &_handle);
+        GLState::instance().forgetTexture(_handle);
+    }
+}
+
+void Texture::bind(unsigned int unit) {
+    GLState::instance().bindTexture(unit, GL_TEXTURE_2D, _handle);
+}
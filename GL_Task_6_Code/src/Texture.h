@@ -31,5 +31,13 @@ class Texture {
      * @param unit: the texture unit
      */
     void bind(unsigned int unit);
+
+    /*!
+     * Gets the handle of the texture
+     * @return the handle of the texture
+     */
+    GLuint getHandle() const {
+        return _handle;
+    }
 };
 
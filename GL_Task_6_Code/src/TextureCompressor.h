@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gli/gl.hpp>
+#include <gli/levels.hpp>
+#include <gli/load_dds.hpp>
+#include <gli/save_dds.hpp>
+#include <gli/texture.hpp>
+
+// BC1/BC3 (DXT1/DXT5) encoder used to transcode source images into block compressed DDS files.
+// Blocks are encoded with the bounding box method: the endpoints are the per channel minimum and
+// maximum of the block, inset by 1/16 of the range, and each pixel picks the closest palette entry.
+// That is far from an offline quality encoder but fast enough to run on first start.
+
+namespace TextureCompressor {
+
+    inline uint16_t pack565(const uint8_t* c) {
+        return uint16_t(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+    }
+
+    inline void unpack565(uint16_t v, uint8_t* c) {
+        uint8_t r = (v >> 11) & 31;
+        uint8_t g = (v >> 5) & 63;
+        uint8_t b = v & 31;
+        c[0] = uint8_t((r << 3) | (r >> 2));
+        c[1] = uint8_t((g << 2) | (g >> 4));
+        c[2] = uint8_t((b << 3) | (b >> 2));
+    }
+
+    // block: 16 RGBA pixels, out: 8 bytes
+    inline void encodeColorBlock(const uint8_t* block, uint8_t* out) {
+        uint8_t mn[3] = { 255, 255, 255 };
+        uint8_t mx[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                mn[c] = std::min(mn[c], block[i * 4 + c]);
+                mx[c] = std::max(mx[c], block[i * 4 + c]);
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            int inset = (mx[c] - mn[c]) >> 4;
+            mn[c] = uint8_t(std::min(255, mn[c] + inset));
+            mx[c] = uint8_t(std::max(0, mx[c] - inset));
+        }
+
+        // mx >= mn per channel, so c0 >= c1 and the block always uses the four color mode
+        uint16_t c0 = pack565(mx);
+        uint16_t c1 = pack565(mn);
+        out[0] = uint8_t(c0 & 0xFF);
+        out[1] = uint8_t(c0 >> 8);
+        out[2] = uint8_t(c1 & 0xFF);
+        out[3] = uint8_t(c1 >> 8);
+
+        uint32_t indices = 0;
+        if (c0 != c1) {
+            uint8_t palette[4][3];
+            unpack565(c0, palette[0]);
+            unpack565(c1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c]) / 3);
+                palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c]) / 3);
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                int bestDist = INT32_MAX;
+                for (int p = 0; p < 4; p++) {
+                    int dr = block[i * 4 + 0] - palette[p][0];
+                    int dg = block[i * 4 + 1] - palette[p][1];
+                    int db = block[i * 4 + 2] - palette[p][2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < bestDist) {
+                        bestDist = dist;
+                        best = p;
+                    }
+                }
+                indices |= uint32_t(best) << (2 * i);
+            }
+        }
+        std::memcpy(out + 4, &indices, 4);
+    }
+
+    // block: 16 RGBA pixels, out: 8 bytes of BC3 alpha
+    inline void encodeAlphaBlock(const uint8_t* block, uint8_t* out) {
+        uint8_t mn = 255;
+        uint8_t mx = 0;
+        for (int i = 0; i < 16; i++) {
+            mn = std::min(mn, block[i * 4 + 3]);
+            mx = std::max(mx, block[i * 4 + 3]);
+        }
+        out[0] = mx;
+        out[1] = mn;
+
+        uint64_t indices = 0;
+        if (mx != mn) {
+            // a0 > a1 selects the eight value mode
+            uint8_t palette[8];
+            palette[0] = mx;
+            palette[1] = mn;
+            for (int p = 1; p < 7; p++) {
+                palette[p + 1] = uint8_t(((7 - p) * mx + p * mn) / 7);
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                int bestDist = 256;
+                for (int p = 0; p < 8; p++) {
+                    int dist = std::abs(int(block[i * 4 + 3]) - palette[p]);
+                    if (dist < bestDist) {
+                        bestDist = dist;
+                        best = p;
+                    }
+                }
+                indices |= uint64_t(best) << (3 * i);
+            }
+        }
+        for (int b = 0; b < 6; b++) {
+            out[2 + b] = uint8_t(indices >> (8 * b));
+        }
+    }
+
+    // compresses one RGBA8 image into the given level storage, edge blocks repeat the border pixels
+    inline void encodeImage(const uint8_t* rgba, int width, int height, bool alpha, uint8_t* out) {
+        uint8_t block[64];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                for (int y = 0; y < 4; y++) {
+                    int sy = std::min(by + y, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        int sx = std::min(bx + x, width - 1);
+                        std::memcpy(block + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+                    }
+                }
+                if (alpha) {
+                    encodeAlphaBlock(block, out);
+                    out += 8;
+                }
+                encodeColorBlock(block, out);
+                out += 8;
+            }
+        }
+    }
+
+    // 2x2 box filter, sRGB images are filtered in linear space
+    inline std::vector<uint8_t> downsample(const std::vector<uint8_t>& src, int width, int height, bool srgb) {
+        static float toLinear[256];
+        static bool initialized = [] {
+            for (int i = 0; i < 256; i++) {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return true;
+        }();
+        (void)initialized;
+
+        int w = std::max(1, width / 2);
+        int h = std::max(1, height / 2);
+        std::vector<uint8_t> dst(size_t(w) * h * 4);
+        for (int y = 0; y < h; y++) {
+            int y0 = std::min(y * 2, height - 1);
+            int y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < w; x++) {
+                int x0 = std::min(x * 2, width - 1);
+                int x1 = std::min(x * 2 + 1, width - 1);
+                const uint8_t* p[4] = {
+                    &src[(size_t(y0) * width + x0) * 4], &src[(size_t(y0) * width + x1) * 4],
+                    &src[(size_t(y1) * width + x0) * 4], &src[(size_t(y1) * width + x1) * 4]
+                };
+                uint8_t* d = &dst[(size_t(y) * w + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    if (srgb && c < 3) {
+                        float l = (toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]]) * 0.25f;
+                        float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                        d[c] = uint8_t(std::min(255.0f, s * 255.0f + 0.5f));
+                    } else {
+                        d[c] = uint8_t((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                    }
+                }
+            }
+        }
+        return dst;
+    }
+
+    /*!
+     * Builds a block compressed texture from RGBA8 images
+     * @param faces: one image for a 2D texture, six (+X, -X, +Y, -Y, +Z, -Z) for a cubemap
+     * @param mipmaps: generate the full mip chain on the CPU
+     * @param alpha: BC3 instead of BC1
+     */
+    inline gli::texture compress(const std::vector<std::vector<uint8_t>>& faces, int width, int height, bool cube, bool mipmaps, bool srgb, bool alpha) {
+        gli::format format = alpha
+            ? (srgb ? gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16 : gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16)
+            : (srgb ? gli::FORMAT_RGB_DXT1_SRGB_BLOCK8 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8);
+        gli::extent2d extent(width, height);
+        size_t levels = mipmaps ? size_t(gli::levels(extent)) : 1;
+
+        gli::texture texture(cube ? gli::TARGET_CUBE : gli::TARGET_2D, format, gli::extent3d(width, height, 1), 1, cube ? 6 : 1, levels);
+        for (size_t face = 0; face < faces.size(); face++) {
+            std::vector<uint8_t> level = faces[face];
+            int w = width;
+            int h = height;
+            for (size_t l = 0; l < levels; l++) {
+                if (l > 0) {
+                    level = downsample(level, w, h, srgb);
+                    w = std::max(1, w / 2);
+                    h = std::max(1, h / 2);
+                }
+                encodeImage(level.data(), w, h, alpha, texture.data<uint8_t>(0, face, l));
+            }
+        }
+        return texture;
+    }
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "GLState.h"
+#include "stb/stb_image.h"
+#include "TextureCompressor.h"
+#include "TextureStreamer.h"
+#include "Trace.h"
+
+class TextureEntry;
+using TextureRef = std::shared_ptr<TextureEntry>;
+
+/*!
+ * A decoded (and later uploaded) texture shared by everything that references the same image.
+ * Source images are transcoded once into block compressed DDS files with a prebuilt mip chain and
+ * kept in the asset cache; later runs load those directly. Loading happens on the thread that
+ * acquired the texture, the GL texture is created lazily by the first id() call, which therefore
+ * has to happen on the GL thread.
+ */
+class TextureEntry : public std::enable_shared_from_this<TextureEntry> {
+public:
+    // bump to invalidate all transcoded textures in the cache
+    static const uint32_t VERSION = 1;
+    // largest mip level uploaded synchronously while the streamer is active
+    static const int PLACEHOLDER_SIZE = 64;
+
+    TextureEntry(GLenum target, bool srgb)
+        : _target(target)
+        , _srgb(srgb) {}
+
+    TextureEntry(const TextureEntry&) = delete;
+    TextureEntry& operator=(const TextureEntry&) = delete;
+
+    ~TextureEntry() {
+        if (_id != 0) {
+            glDeleteTextures(1, &_id);
+            GLState::instance().forgetTexture(_id);
+        }
+    }
+
+    // GL name of the texture, uploads the compressed levels on first use
+    GLuint id() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_id == 0) {
+            upload();
+        }
+        return _id;
+    }
+
+    GLenum target() const { return _target; }
+    bool valid() const { return _valid; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+
+    // size on the GPU including the mip chain
+    size_t vramBytes() const { return _vramBytes; }
+    // what the same texture would take as uncompressed RGBA8
+    size_t rawBytes() const { return _rawBytes; }
+
+private:
+    friend class TextureRegistry;
+
+    void load(const std::vector<AssetView>& files, const std::vector<std::string>& paths, uint64_t cacheKey) {
+        _faces = files.size();
+        TRACE_SCOPE("texture " + paths[0].substr(paths[0].find_last_of("/\\") + 1));
+        std::string cachePath = assetCachePath(cacheKey, ".dds");
+        MappedFile cached;
+        if (cached.open(cachePath)) {
+            _texture = gli::load_dds(cached.data(), cached.size());
+            _fromCache = !_texture.empty();
+        }
+        if (!_fromCache) {
+            transcode(files, paths, cachePath);
+        }
+
+        _valid = !_texture.empty();
+        if (_valid) {
+            _width = _texture.extent().x;
+            _height = _texture.extent().y;
+            _vramBytes = _texture.size();
+            for (size_t level = 0; level < _texture.levels(); level++) {
+                gli::extent3d extent = _texture.extent(level);
+                _rawBytes += size_t(extent.x) * extent.y * 4 * _texture.faces();
+            }
+        }
+    }
+
+    void transcode(const std::vector<AssetView>& files, const std::vector<std::string>& paths, const std::string& cachePath) {
+        TRACE_SCOPE("transcode");
+        auto start = AssetClock::now();
+        std::vector<std::vector<uint8_t>> faces(files.size());
+        int width = 0;
+        int height = 0;
+        bool alpha = false;
+
+        for (size_t i = 0; i < files.size(); i++) {
+            int w, h, components;
+            stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(files[i].data), static_cast<int>(files[i].size),
+                                                    &w, &h, &components, 4);
+            if (!pixels) {
+                std::cout << "Texture failed to load at path: " << paths[i] << std::endl;
+                return;
+            }
+            if (i > 0 && (w != width || h != height)) {
+                std::cout << "Texture face size mismatch at path: " << paths[i] << std::endl;
+                stbi_image_free(pixels);
+                return;
+            }
+            width = w;
+            height = h;
+            faces[i].assign(pixels, pixels + size_t(w) * h * 4);
+            stbi_image_free(pixels);
+
+            if (components == 2 || components == 4) {
+                for (size_t p = 3; p < faces[i].size() && !alpha; p += 4) {
+                    alpha = faces[i][p] != 255;
+                }
+            }
+        }
+
+        // the skybox is sampled without mipmaps, so only 2D textures get a chain
+        bool cube = _target == GL_TEXTURE_CUBE_MAP;
+        _texture = TextureCompressor::compress(faces, width, height, cube, !cube, _srgb, alpha);
+
+        std::vector<char> dds;
+        if (!gli::save_dds(_texture, dds)) {
+            std::cout << "[TextureRegistry] failed to encode " << cachePath << std::endl;
+        } else {
+            BinaryWriter writer(cachePath);
+            writer.writeArray(dds.data(), dds.size());
+            if (!writer.commit()) {
+                std::cout << "[TextureRegistry] failed to write cache entry " << cachePath << std::endl;
+            }
+        }
+
+        std::string name = paths[0].substr(paths[0].find_last_of("/\\") + 1);
+        std::cout << "[TextureRegistry] transcoded " << name << (cube ? " (cube)" : "") << " " << width << "x" << height
+                  << " to " << (alpha ? "BC3" : "BC1") << ", " << _texture.levels() << " levels in " << assetMsSince(start) << " ms" << std::endl;
+    }
+
+    void upload() {
+        TRACE_SCOPE("texture upload");
+        glGenTextures(1, &_id);
+        GLState::instance().bindTexture(_target, _id);
+        if (_texture.empty()) {
+            return;
+        }
+
+        gli::gl GL(gli::gl::PROFILE_GL33);
+        gli::gl::format format = GL.translate(_texture.format(), _texture.swizzles());
+        GLint levels = GLint(_texture.levels());
+        glTexStorage2D(_target, levels, format.Internal, _texture.extent().x, _texture.extent().y);
+        glTexParameteri(_target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        if (_target == GL_TEXTURE_CUBE_MAP) {
+            glTexParameteri(_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(_target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(_target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(_target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        } else {
+            glTexParameteri(_target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(_target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(_target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+
+        // with the streamer running only the small tail of the mip chain is uploaded here and
+        // serves as placeholder, the larger levels follow over the next frames
+        GLint firstStreamed = 0;
+        if (TextureStreamer::instance().enabled()) {
+            while (firstStreamed < levels - 1) {
+                gli::extent3d extent = _texture.extent(firstStreamed);
+                if (std::max(extent.x, extent.y) <= PLACEHOLDER_SIZE) {
+                    break;
+                }
+                firstStreamed++;
+            }
+        }
+
+        for (size_t face = 0; face < _texture.faces(); face++) {
+            for (GLint level = firstStreamed; level < levels; level++) {
+                gli::extent3d extent = _texture.extent(level);
+                glCompressedTexSubImage2D(faceTarget(face), level, 0, 0, extent.x, extent.y, format.Internal,
+                                          GLsizei(_texture.size(level)), _texture.data(0, face, level));
+            }
+        }
+        glTexParameteri(_target, GL_TEXTURE_BASE_LEVEL, firstStreamed);
+
+        if (firstStreamed == 0) {
+            // the compressed copy is only needed until it is resident
+            _texture = gli::texture();
+            return;
+        }
+
+        std::vector<TextureStreamer::Upload> uploads;
+        for (GLint level = firstStreamed - 1; level >= 0; level--) {
+            gli::extent3d extent = _texture.extent(level);
+            for (size_t face = 0; face < _texture.faces(); face++) {
+                uploads.push_back({ faceTarget(face), level, extent.x, extent.y, format.Internal,
+                                    _texture.data(0, face, level), GLsizei(_texture.size(level)) });
+            }
+        }
+        TextureRef self = shared_from_this();
+        TextureStreamer::instance().enqueue(_id, _target, firstStreamed, std::move(uploads), [self] {
+            self->_texture = gli::texture();
+        });
+    }
+
+    GLenum faceTarget(size_t face) const {
+        return _target == GL_TEXTURE_CUBE_MAP ? GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : _target;
+    }
+
+    GLenum _target;
+    bool _srgb;
+    bool _fromCache = false;
+    bool _valid = false;
+    int _width = 0;
+    int _height = 0;
+    GLuint _id = 0;
+    size_t _faces = 0;
+    size_t _vramBytes = 0;
+    size_t _rawBytes = 0;
+    gli::texture _texture;
+    // held by the loading thread until the texture is ready, id() waits on it
+    std::mutex _mutex;
+};
+
+/*!
+ * Process-wide texture cache.
+ * Lookups go by resolved path first and by file contents second, so the same image shipped under
+ * two names (e.g. the wood texture of the key and the lava models) is decoded and uploaded once.
+ * The registry only keeps weak references; a texture is freed when the last handle goes away.
+ */
+class TextureRegistry {
+public:
+    static TextureRegistry& instance() {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    /*!
+     * Returns the shared 2D texture for an image file, decoding it if nobody holds it yet
+     * @param path: path of the image, relative paths are resolved against the working directory
+     * @param srgb: upload with an sRGB internal format
+     */
+    TextureRef acquire(const std::string& path, bool srgb) {
+        return acquire(std::vector<std::string>{ path }, GL_TEXTURE_2D, srgb);
+    }
+
+    /*!
+     * Returns the shared cubemap for six face images in +X, -X, +Y, -Y, +Z, -Z order
+     */
+    TextureRef acquireCube(const std::vector<std::string>& faces) {
+        return acquire(faces, GL_TEXTURE_CUBE_MAP, false);
+    }
+
+    void printStats() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::ios::fmtflags flags = std::cout.flags();
+        std::streamsize precision = std::cout.precision();
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "[TextureRegistry] " << _decodes << " decodes, " << _cacheLoads << " loaded from the DDS cache, "
+                  << _decodesSaved << " decodes saved, " << _bytesSaved / (1024.0 * 1024.0) << " MB VRAM saved" << std::endl;
+        std::cout << "[TextureRegistry] " << _vramBytes / (1024.0 * 1024.0) << " MB block compressed VRAM, "
+                  << _rawBytes / (1024.0 * 1024.0) << " MB as RGBA8" << std::endl;
+        std::cout.flags(flags);
+        std::cout.precision(precision);
+    }
+
+private:
+    TextureRegistry() = default;
+
+    TextureRef acquire(const std::vector<std::string>& paths, GLenum target, bool srgb) {
+        std::string pathKey = srgb ? "srgb" : "linear";
+        for (const std::string& path : paths) {
+            pathKey += '|' + std::filesystem::path(path).lexically_normal().generic_string();
+        }
+
+        if (TextureRef hit = lookup(pathKey)) {
+            return reuse(hit);
+        }
+
+        std::vector<AssetView> files(paths.size());
+        uint64_t contentKey = assetHash(pathKey.substr(0, pathKey.find('|')));
+        contentKey = assetHash(&target, sizeof(target), contentKey);
+        for (size_t i = 0; i < paths.size(); i++) {
+            files[i] = Vfs::instance().open(paths[i]);
+            contentKey = assetHash(files[i].data, files[i].size, contentKey);
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto found = _byContent.find(contentKey);
+        if (found != _byContent.end()) {
+            if (TextureRef hit = found->second.lock()) {
+                _byPath[pathKey] = hit;
+                lock.unlock();
+                return reuse(hit);
+            }
+        }
+
+        TextureRef entry = std::make_shared<TextureEntry>(target, srgb);
+        std::unique_lock<std::mutex> decoding(entry->_mutex);
+        _byPath[pathKey] = entry;
+        _byContent[contentKey] = entry;
+        lock.unlock();
+
+        entry->load(files, paths, assetHash(&TextureEntry::VERSION, sizeof(TextureEntry::VERSION), contentKey));
+        decoding.unlock();
+
+        lock.lock();
+        if (entry->_fromCache) {
+            _cacheLoads++;
+        } else {
+            _decodes += static_cast<unsigned int>(paths.size());
+        }
+        _vramBytes += entry->vramBytes();
+        _rawBytes += entry->rawBytes();
+        return entry;
+    }
+
+    TextureRef lookup(const std::string& pathKey) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _byPath.find(pathKey);
+        return found != _byPath.end() ? found->second.lock() : nullptr;
+    }
+
+    // waits until a concurrent decode of the entry finished, then books what was saved
+    TextureRef reuse(const TextureRef& hit) {
+        size_t images;
+        size_t bytes;
+        {
+            std::lock_guard<std::mutex> decoding(hit->_mutex);
+            images = hit->_faces;
+            bytes = hit->_vramBytes;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _decodesSaved += static_cast<unsigned int>(images);
+        _bytesSaved += bytes;
+        return hit;
+    }
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, std::weak_ptr<TextureEntry>> _byPath;
+    std::unordered_map<uint64_t, std::weak_ptr<TextureEntry>> _byContent;
+    unsigned int _decodes = 0;
+    unsigned int _decodesSaved = 0;
+    unsigned int _cacheLoads = 0;
+    size_t _vramBytes = 0;
+    size_t _rawBytes = 0;
+    size_t _bytesSaved = 0;
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLState.h"
+
+/*!
+ * Time-sliced texture uploads.
+ * Levels are copied into a ring of pixel unpack buffer memory and handed to GL from there, at most
+ * budget bytes per frame. The ring is persistently mapped when ARB_buffer_storage is available and
+ * mapped per upload (unsynchronized) otherwise; fences keep the CPU from overwriting ring memory the
+ * GPU has not consumed yet. Textures are queued smallest level first and GL_TEXTURE_BASE_LEVEL is
+ * lowered whenever the next larger level is complete, so a texture is usable right away and sharpens
+ * over the following frames.
+ */
+class TextureStreamer {
+public:
+    struct Upload {
+        GLenum face;        // GL_TEXTURE_2D or one of the cube map faces
+        GLint level;
+        GLsizei width;
+        GLsizei height;
+        GLenum format;      // compressed internal format
+        const void* data;
+        GLsizei size;
+    };
+
+    static TextureStreamer& instance() {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    // needs a current context, before init() textures are uploaded synchronously
+    void init(size_t ringBytes, size_t budgetBytes) {
+        _budget = budgetBytes;
+        _ringSize = ringBytes;
+        _persistent = GLEW_ARB_buffer_storage != 0;
+
+        glGenBuffers(1, &_pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+        if (_persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _ringSize, nullptr, flags);
+            _mapped = static_cast<char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _ringSize, flags));
+            _persistent = _mapped != nullptr;
+        }
+        if (!_persistent) {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, _ringSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        _enabled = true;
+
+        std::cout << "[TextureStreamer] " << _ringSize / (1024 * 1024) << " MB ring ("
+                  << (_persistent ? "persistently mapped" : "mapped per upload") << "), "
+                  << _budget / 1024 << " KB per frame" << std::endl;
+    }
+
+    bool enabled() const { return _enabled; }
+
+    /*!
+     * Queues the levels of a texture whose storage is already allocated
+     * @param uploads: ordered from the smallest to the largest level
+     * @param onComplete: called once every level is resident, the place to release the CPU copy
+     */
+    void enqueue(GLuint texture, GLenum target, GLint residentLevel, std::vector<Upload> uploads, std::function<void()> onComplete) {
+        Job job;
+        job.texture = texture;
+        job.target = target;
+        job.residentLevel = residentLevel;
+        job.uploads = std::move(uploads);
+        job.onComplete = std::move(onComplete);
+        _jobs.push_back(std::move(job));
+    }
+
+    // call once per frame on the GL thread
+    void update() {
+        retireFences();
+        if (_jobs.empty()) {
+            return;
+        }
+
+        size_t budget = _budget;
+        bool uploadedAny = false;
+        while (!_jobs.empty()) {
+            Job& job = _jobs.front();
+            if (job.next == job.uploads.size()) {
+                finish(job);
+                _jobs.pop_front();
+                continue;
+            }
+
+            const Upload& upload = job.uploads[job.next];
+            size_t size = size_t(upload.size);
+            // always allow one upload per frame so levels larger than the budget still make progress
+            if (uploadedAny && size > budget) {
+                break;
+            }
+            if (!submit(job, upload)) {
+                break;
+            }
+            uploadedAny = true;
+            budget = size > budget ? 0 : budget - size;
+            _bytesUploaded += size;
+            _uploads++;
+            job.next++;
+
+            // the level is complete once all of its faces are in
+            if (job.next == job.uploads.size() || job.uploads[job.next].level != upload.level) {
+                job.residentLevel = upload.level;
+                GLState::instance().bindTexture(job.target, job.texture);
+                glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, job.residentLevel);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        _frames++;
+
+        if (_jobs.empty()) {
+            std::cout << "[TextureStreamer] queue drained: " << _uploads << " uploads, "
+                      << _bytesUploaded / (1024 * 1024) << " MB over " << _frames << " frames" << std::endl;
+        }
+    }
+
+    size_t pendingTextures() const { return _jobs.size(); }
+
+private:
+    struct Job {
+        GLuint texture = 0;
+        GLenum target = GL_TEXTURE_2D;
+        GLint residentLevel = 0;
+        std::vector<Upload> uploads;
+        size_t next = 0;
+        std::function<void()> onComplete;
+    };
+
+    struct Fence {
+        GLsync sync;
+        size_t begin;
+        size_t end;
+    };
+
+    TextureStreamer() = default;
+
+    void finish(Job& job) {
+        if (job.onComplete) {
+            job.onComplete();
+        }
+    }
+
+    // returns false if the ring has no free space this frame
+    bool submit(Job& job, const Upload& upload) {
+        size_t size = size_t(upload.size);
+        GLState::instance().bindTexture(job.target, job.texture);
+
+        if (size > _ringSize) {
+            // does not fit the ring at all, upload from client memory
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glCompressedTexSubImage2D(upload.face, upload.level, 0, 0, upload.width, upload.height, upload.format, upload.size, upload.data);
+            return true;
+        }
+
+        size_t offset = _head;
+        if (offset + size > _ringSize) {
+            offset = 0;
+        }
+        if (!regionFree(offset, offset + size)) {
+            return false;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+        if (_persistent) {
+            std::memcpy(_mapped + offset, upload.data, size);
+        } else {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size, flags);
+            if (!ptr) {
+                return false;
+            }
+            std::memcpy(ptr, upload.data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glCompressedTexSubImage2D(upload.face, upload.level, 0, 0, upload.width, upload.height, upload.format,
+                                  upload.size, reinterpret_cast<const void*>(offset));
+
+        _fences.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), offset, offset + size });
+        _head = offset + size;
+        return true;
+    }
+
+    bool regionFree(size_t begin, size_t end) {
+        for (const Fence& fence : _fences) {
+            if (fence.begin < end && begin < fence.end) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // drops the fences the GPU has passed, never blocks
+    void retireFences() {
+        while (!_fences.empty()) {
+            GLenum state = glClientWaitSync(_fences.front().sync, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+                break;
+            }
+            glDeleteSync(_fences.front().sync);
+            _fences.pop_front();
+        }
+    }
+
+    bool _enabled = false;
+    bool _persistent = false;
+    GLuint _pbo = 0;
+    char* _mapped = nullptr;
+    size_t _ringSize = 0;
+    size_t _head = 0;
+    size_t _budget = 0;
+    std::deque<Job> _jobs;
+    std::deque<Fence> _fences;
+    size_t _bytesUploaded = 0;
+    size_t _uploads = 0;
+    size_t _frames = 0;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PathUtils.h"
+
+/*!
+ * Startup timeline, written as Chrome trace event JSON (open it in chrome://tracing or ui.perfetto.dev).
+ * Zones are complete ("X") events tagged with the thread they ran on, so nesting follows from the
+ * timestamps and parallel asset loading shows up as separate tracks. Recording is off unless the
+ * executable was started with --trace; a disabled zone costs one atomic load.
+ */
+class Trace {
+public:
+    static Trace& instance() {
+        static Trace trace;
+        return trace;
+    }
+
+    static bool enabled() { return instance()._enabled.load(std::memory_order_relaxed); }
+
+    /*!
+     * Looks for --trace or --trace=<file> and removes it from argv, the remaining arguments are
+     * left for gcgParseArgs
+     */
+    void parseArgs(int& argc, char** argv) {
+        int kept = 0;
+        for (int i = 0; i < argc; i++) {
+            if (i > 0 && std::strncmp(argv[i], "--trace", 7) == 0 && (argv[i][7] == '\0' || argv[i][7] == '=')) {
+                _path = argv[i][7] == '=' ? std::string(argv[i] + 8) : (gcgGetExecutableDir() / "startup_trace.json").string();
+                _enabled = true;
+                continue;
+            }
+            argv[kept++] = argv[i];
+        }
+        argc = kept;
+        if (_enabled) {
+            setThreadName("main");
+        }
+    }
+
+    // shows up as the track name of the calling thread
+    void setThreadName(const std::string& name) {
+        if (!enabled()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _threadNames[threadIndex()] = name;
+    }
+
+    void record(std::string name, int64_t beginUs, int64_t endUs) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_enabled) {
+            return;
+        }
+        _events.push_back({ std::move(name), beginUs, endUs - beginUs, threadIndex() });
+    }
+
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    // writes every zone recorded so far and stops recording
+    void write() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_enabled) {
+            return;
+        }
+        _enabled = false;
+
+        std::ofstream file(_path, std::ios::trunc);
+        if (!file) {
+            std::cout << "[Trace] failed to write " << _path << std::endl;
+            return;
+        }
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"startup\"}}";
+        for (const auto& thread : _threadNames) {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+                 << ",\"args\":{\"name\":\"" << escape(thread.second) << "\"}}";
+        }
+        for (const Event& event : _events) {
+            file << ",\n{\"name\":\"" << escape(event.name) << "\",\"ph\":\"X\",\"ts\":" << event.begin
+                 << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":" << event.thread << "}";
+        }
+        file << "\n]}\n";
+        std::cout << "[Trace] " << _events.size() << " zones written to " << _path << std::endl;
+        _events.clear();
+    }
+
+private:
+    struct Event {
+        std::string name;
+        int64_t begin;
+        int64_t duration;
+        uint32_t thread;
+    };
+
+    Trace()
+        : _start(std::chrono::steady_clock::now()) {}
+
+    // small stable ids instead of the platform thread ids, callers hold _mutex
+    uint32_t threadIndex() {
+        auto it = _threadIds.find(std::this_thread::get_id());
+        if (it != _threadIds.end()) {
+            return it->second;
+        }
+        uint32_t index = uint32_t(_threadIds.size());
+        _threadIds.emplace(std::this_thread::get_id(), index);
+        return index;
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    std::atomic<bool> _enabled{ false };
+    std::string _path;
+    std::chrono::steady_clock::time_point _start;
+    std::mutex _mutex;
+    std::vector<Event> _events;
+    std::map<std::thread::id, uint32_t> _threadIds;
+    std::map<uint32_t, std::string> _threadNames;
+};
+
+/*!
+ * Records the time between construction and end() (or destruction) as one zone
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) {
+        if (Trace::enabled()) {
+            _name = name;
+            _begin = Trace::instance().now();
+            _active = true;
+        }
+    }
+
+    explicit TraceScope(const std::string& name) {
+        if (Trace::enabled()) {
+            _name = name;
+            _begin = Trace::instance().now();
+            _active = true;
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() { end(); }
+
+    // closes the zone early, for phases that do not map onto a C++ scope
+    void end() {
+        if (_active) {
+            _active = false;
+            Trace::instance().record(std::move(_name), _begin, Trace::instance().now());
+        }
+    }
+
+private:
+    std::string _name;
+    int64_t _begin = 0;
+    bool _active = false;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "AssetCache.h"
+#include "Shader.h"
+
+/*!
+ * Microbenchmark of the ways to set a uniform, started with --bench-uniforms after the shaders
+ * are loaded. Every variant ends in the same glUniform call, so the differences are the lookup:
+ *   string:  std::string name and a string keyed map, what Shader::setUniform used to do
+ *   mesh:    stringstream name and glGetUniformLocation, what Mesh::Draw used to do per texture
+ *   hashed:  Shader::setUniform with a literal, the name hash is folded by the compiler
+ *   handle:  Shader::set with a handle resolved once
+ * The value changes every iteration, so the shader's value cache never skips a write.
+ */
+class UniformBench {
+public:
+    static const int ITERATIONS = 100000;
+
+    static bool takeFlag(int& argc, char** argv) {
+        return gcgTakeFlag(argc, argv, "--bench-uniforms");
+    }
+
+    static void run(Shader& shader) {
+        shader.use();
+        glm::mat4 matrix(1.0f);
+        GLuint program = shader.getHandle();
+
+        std::unordered_map<std::string, GLint> locations;
+        report("string", measure([&](int i) {
+            std::string name = "modelMatrix";
+            auto found = locations.find(name);
+            GLint location = found != locations.end() ? found->second : (locations[name] = glGetUniformLocation(program, name.c_str()));
+            matrix[3][0] = float(i);
+            glUniformMatrix4fv(location, 1, GL_FALSE, &matrix[0][0]);
+        }));
+
+        report("mesh", measure([&](int i) {
+            std::stringstream ss;
+            ss << 1;
+            std::string name = "texture_diffuse" + ss.str();
+            glUniform1i(glGetUniformLocation(program, name.c_str()), i & 1);
+        }));
+        // the variants above went around the value cache of the shader
+        shader.forgetUniformValues();
+
+        report("hashed", measure([&](int i) {
+            matrix[3][0] = float(i);
+            shader.setUniform("modelMatrix", matrix);
+        }));
+
+        Uniform<glm::mat4> modelMatrix = shader.uniform<glm::mat4>("modelMatrix");
+        report("handle", measure([&](int i) {
+            matrix[3][0] = float(i);
+            shader.set(modelMatrix, matrix);
+        }));
+
+        shader.setUniform("modelMatrix", glm::mat4(1.0f));
+        shader.unuse();
+    }
+
+private:
+    // nanoseconds per set, glFinish keeps queued driver work out of the next variant
+    template <typename Function>
+    static double measure(Function function) {
+        glFinish();
+        auto start = AssetClock::now();
+        for (int i = 0; i < ITERATIONS; i++) {
+            function(i);
+        }
+        glFinish();
+        return assetMsSince(start) * 1.0e6 / ITERATIONS;
+    }
+
+    static void report(const char* variant, double ns) {
+        std::cout << "[UniformBench] " << variant << ": " << ns << " ns per set" << std::endl;
+    }
+};
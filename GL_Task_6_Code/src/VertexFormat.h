@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "MeshLod.h"
+
+#define MAX_BONE_INFLUENCE 4
+
+// what Model pulls out of Assimp per vertex, only used while importing
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// GPU vertex layouts, picked per mesh at import. Vertex stays the import format only.
+//
+//   offset  attribute                                   static  skinned
+//   0       position      3 x float                     x       x
+//   12      normal        10:10:10:2 snorm              x       x
+//   16      uv            2 x half (2 x float if wide)  x       x
+//   20/24   bone ids      4 x uint8                             x
+//   24/28   bone weights  4 x unorm8                            x
+//
+// Attribute locations match the model shaders (0 position, 1 normal, 2 uv, 3 bone ids, 4 weights).
+
+enum VertexFormatFlags : uint32_t {
+    VERTEX_SKINNED = 1 << 0,  // has bone ids and weights
+    VERTEX_WIDE_UV = 1 << 1,  // uvs do not survive half precision (heavily tiled textures)
+    INDEX_16 = 1 << 2         // fewer than 65536 vertices, GL_UNSIGNED_SHORT indices
+};
+
+struct VertexLayout {
+    uint32_t flags = 0;
+    uint32_t uvOffset = 16;
+    uint32_t boneOffset = 0;
+    uint32_t weightOffset = 0;
+    uint32_t stride = 0;
+
+    explicit VertexLayout(uint32_t flags)
+        : flags(flags) {
+        uint32_t uvSize = (flags & VERTEX_WIDE_UV) ? 8 : 4;
+        stride = uvOffset + uvSize;
+        if (flags & VERTEX_SKINNED) {
+            boneOffset = stride;
+            weightOffset = stride + 4;
+            stride += 8;
+        }
+    }
+
+    // sets the attribute pointers of the bound VAO and GL_ARRAY_BUFFER
+    void apply() const {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)12);
+        glEnableVertexAttribArray(2);
+        if (flags & VERTEX_WIDE_UV) {
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)uintptr_t(uvOffset));
+        } else {
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)uintptr_t(uvOffset));
+        }
+        if (flags & VERTEX_SKINNED) {
+            glEnableVertexAttribArray(3);
+            glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, stride, (void*)uintptr_t(boneOffset));
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)uintptr_t(weightOffset));
+        }
+    }
+};
+
+/*!
+ * Vertex and index data of one mesh, exactly as it is uploaded. The index buffer holds every
+ * level of detail back to back, all of them index the same vertices.
+ */
+struct PackedMesh {
+    uint32_t flags = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> indices;
+    std::vector<MeshLod> lods;
+    glm::vec4 bounds = glm::vec4(0.0f); // bounding sphere, center and radius
+    glm::vec3 boxMin = glm::vec3(0.0f);  // bounding box
+    glm::vec3 boxMax = glm::vec3(0.0f);
+
+    VertexLayout layout() const { return VertexLayout(flags); }
+    GLenum indexType() const { return (flags & INDEX_16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+    size_t indexSize() const { return (flags & INDEX_16) ? sizeof(uint16_t) : sizeof(GLuint); }
+};
+
+/*!
+ * Bytes of the meshes of a model in the universal Vertex/GLuint format and packed
+ */
+struct VertexFormatStats {
+    size_t staticMeshes = 0;
+    size_t skinnedMeshes = 0;
+    size_t vertexBytesBefore = 0;
+    size_t indexBytesBefore = 0;
+    size_t vertexBytesAfter = 0;
+    size_t indexBytesAfter = 0;
+};
+
+class VertexFormat {
+public:
+    // largest uv error accepted for half floats, about a texel of a 1024 texture
+    static constexpr float UV_TOLERANCE = 1.0f / 1024.0f;
+
+    static uint32_t choose(const std::vector<Vertex>& vertices) {
+        uint32_t flags = 0;
+        if (vertices.size() <= 65536) {
+            flags |= INDEX_16;
+        }
+        for (const Vertex& vertex : vertices) {
+            if (vertex.m_Weights[0] > 0.0f) {
+                flags |= VERTEX_SKINNED;
+            }
+            glm::vec2 rounded = glm::unpackHalf2x16(glm::packHalf2x16(vertex.TexCoords));
+            if (glm::any(glm::greaterThan(glm::abs(rounded - vertex.TexCoords), glm::vec2(UV_TOLERANCE)))) {
+                flags |= VERTEX_WIDE_UV;
+            }
+        }
+        return flags;
+    }
+
+    /*!
+     * @param indices: the index lists of all levels of detail back to back
+     * @param lods: ranges of the levels in indices, empty if there is only one
+     */
+    static PackedMesh pack(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, std::vector<MeshLod> lods, VertexFormatStats& stats) {
+        PackedMesh mesh;
+        mesh.flags = choose(vertices);
+        mesh.vertexCount = uint32_t(vertices.size());
+        mesh.indexCount = uint32_t(indices.size());
+        mesh.lods = lods.empty() ? std::vector<MeshLod>{ { 0, uint32_t(indices.size()), 0.0f } } : std::move(lods);
+        mesh.bounds = boundingSphere(vertices);
+        boundingBox(vertices, mesh.boxMin, mesh.boxMax);
+        VertexLayout layout = mesh.layout();
+
+        mesh.vertices.resize(size_t(layout.stride) * vertices.size());
+        unsigned char* out = mesh.vertices.data();
+        for (const Vertex& vertex : vertices) {
+            std::memcpy(out, &vertex.Position, sizeof(glm::vec3));
+            uint32_t normal = glm::packSnorm3x10_1x2(glm::vec4(safeNormalize(vertex.Normal), 0.0f));
+            std::memcpy(out + 12, &normal, sizeof(normal));
+            if (layout.flags & VERTEX_WIDE_UV) {
+                std::memcpy(out + layout.uvOffset, &vertex.TexCoords, sizeof(glm::vec2));
+            } else {
+                uint32_t uv = glm::packHalf2x16(vertex.TexCoords);
+                std::memcpy(out + layout.uvOffset, &uv, sizeof(uv));
+            }
+            if (layout.flags & VERTEX_SKINNED) {
+                packBones(vertex, out + layout.boneOffset, out + layout.weightOffset);
+            }
+            out += layout.stride;
+        }
+
+        mesh.indices.resize(mesh.indexSize() * indices.size());
+        if (mesh.flags & INDEX_16) {
+            uint16_t* shortIndices = reinterpret_cast<uint16_t*>(mesh.indices.data());
+            for (size_t i = 0; i < indices.size(); i++) {
+                shortIndices[i] = uint16_t(indices[i]);
+            }
+        } else if (!indices.empty()) {
+            std::memcpy(mesh.indices.data(), indices.data(), mesh.indices.size());
+        }
+
+        (mesh.flags & VERTEX_SKINNED) ? stats.skinnedMeshes++ : stats.staticMeshes++;
+        stats.vertexBytesBefore += vertices.size() * sizeof(Vertex);
+        stats.indexBytesBefore += mesh.lods[0].indexCount * sizeof(GLuint);
+        stats.vertexBytesAfter += mesh.vertices.size();
+        stats.indexBytesAfter += mesh.indices.size();
+        return mesh;
+    }
+
+    static void boundingBox(const std::vector<Vertex>& vertices, glm::vec3& lower, glm::vec3& upper) {
+        lower = upper = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for (const Vertex& vertex : vertices) {
+            lower = glm::min(lower, vertex.Position);
+            upper = glm::max(upper, vertex.Position);
+        }
+    }
+
+    // sphere around the center of the bounding box, not minimal but cheap and stable
+    static glm::vec4 boundingSphere(const std::vector<Vertex>& vertices) {
+        if (vertices.empty()) {
+            return glm::vec4(0.0f);
+        }
+        glm::vec3 lower;
+        glm::vec3 upper;
+        boundingBox(vertices, lower, upper);
+        glm::vec3 center = (lower + upper) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex& vertex : vertices) {
+            radius = std::max(radius, glm::length(vertex.Position - center));
+        }
+        return glm::vec4(center, radius);
+    }
+
+private:
+    static glm::vec3 safeNormalize(const glm::vec3& normal) {
+        float length = glm::length(normal);
+        return length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    // unused influences become bone 0 with weight 0, the weights are rounded so they sum to 255
+    static void packBones(const Vertex& vertex, unsigned char* ids, unsigned char* weights) {
+        float sum = 0.0f;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+            sum += std::max(vertex.m_Weights[i], 0.0f);
+        }
+        int total = 0;
+        int largest = 0;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++) {
+            int id = vertex.m_BoneIDs[i];
+            if (id > 255) {
+                std::cout << "[VertexFormat] bone id " << id << " does not fit into 8 bits" << std::endl;
+            }
+            float weight = sum > 0.0f ? std::max(vertex.m_Weights[i], 0.0f) / sum : 0.0f;
+            ids[i] = (id < 0 || id > 255) ? 0 : (unsigned char)id;
+            weights[i] = (unsigned char)std::lround(weight * 255.0f);
+            total += weights[i];
+            if (weights[i] > weights[largest]) {
+                largest = i;
+            }
+        }
+        if (total > 0) {
+            weights[largest] = (unsigned char)(weights[largest] + 255 - total);
+        }
+    }
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include<glm/glm.hpp>
+#include <map>
+#include <string>
 
 struct BoneInfo
 {
@@ -10,4 +12,11 @@ struct BoneInfo
 
 };
 
+// bone ids and offsets shared by a model and every animation clip played on it
+struct Skeleton
+{
+	std::map<std::string, BoneInfo> boneInfoMap;
+
+	int boneCount = 0;
 
+};
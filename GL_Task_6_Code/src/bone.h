@@ -2,186 +2,107 @@
 
 /* Container for bone data */
 
-#include <vector>
-#include <assimp/scene.h>
-#include <list>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 
-
-struct KeyPosition
+// Keyframes of one animated node, stored as separate time and value streams (see ClipCache.h).
+// The pointers reference the clip blob owned by the Animation, rotations are quantized to
+// 16 bit per component.
+struct BoneTrack
 {
-	glm::vec3 position;
-	float timeStamp;
-};
+	std::string name;
 
-struct KeyRotation
-{
-	glm::quat orientation;
-	float timeStamp;
-};
+	uint32_t numPositions = 0;
+	const float* positionTimes = nullptr;
+	const glm::vec3* positions = nullptr;
 
-struct KeyScale
-{
-	glm::vec3 scale;
-	float timeStamp;
-};
+	uint32_t numRotations = 0;
+	const float* rotationTimes = nullptr;
+	const int16_t* rotations = nullptr;
 
-class Bone
-{
-public:
-	Bone(const std::string& name, int ID, const aiNodeAnim* channel)
-		:
-		m_Name(name),
-		m_ID(ID),
-		m_LocalTransform(1.0f)
-	{
-		m_NumPositions = channel->mNumPositionKeys;
-
-		for (int positionIndex = 0; positionIndex < m_NumPositions; ++positionIndex)
-		{
-			aiVector3D aiPosition = channel->mPositionKeys[positionIndex].mValue;
-			float timeStamp = channel->mPositionKeys[positionIndex].mTime;
-			KeyPosition data;
-			data.position = glm::vec3(aiPosition.x, aiPosition.y, aiPosition.z);
-			data.timeStamp = timeStamp;
-			m_Positions.push_back(data);
-		}
-
-		m_NumRotations = channel->mNumRotationKeys;
-		for (int rotationIndex = 0; rotationIndex < m_NumRotations; ++rotationIndex)
-		{
-			aiQuaternion aiOrientation = channel->mRotationKeys[rotationIndex].mValue;
-			float timeStamp = channel->mRotationKeys[rotationIndex].mTime;
-			KeyRotation data;
-			data.orientation = glm::quat(aiOrientation.w, aiOrientation.x, aiOrientation.y, aiOrientation.z);
-			data.timeStamp = timeStamp;
-			m_Rotations.push_back(data);
-		}
-
-		m_NumScalings = channel->mNumScalingKeys;
-		for (int keyIndex = 0; keyIndex < m_NumScalings; ++keyIndex)
-		{
-			aiVector3D scale = channel->mScalingKeys[keyIndex].mValue;
-			float timeStamp = channel->mScalingKeys[keyIndex].mTime;
-			KeyScale data;
-			data.scale = glm::vec3(scale.x, scale.y, scale.z);
-			data.timeStamp = timeStamp;
-			m_Scales.push_back(data);
-		}
-	}
+	uint32_t numScales = 0;
+	const float* scaleTimes = nullptr;
+	const glm::vec3* scales = nullptr;
 
-	void Update(float animationTime)
+	glm::mat4 Sample(float animationTime) const
 	{
 		glm::mat4 translation = InterpolatePosition(animationTime);
 		glm::mat4 rotation = InterpolateRotation(animationTime);
 		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		return translation * rotation * scale;
 	}
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
-	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() { return m_ID; }
-
-
 
-	int GetPositionIndex(float animationTime)
+	static int16_t QuantizeRotation(float value)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return int16_t(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
 	}
 
-	int GetRotationIndex(float animationTime)
+private:
+	// index of the key that starts the interval containing animationTime
+	static uint32_t KeyIndex(const float* times, uint32_t count, float animationTime)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		uint32_t index = uint32_t(std::upper_bound(times + 1, times + count, animationTime) - times) - 1;
+		return std::min(index, count - 2);
 	}
 
-	int GetScaleIndex(float animationTime)
+	static float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		float midWayLength = animationTime - lastTimeStamp;
+		float framesDiff = nextTimeStamp - lastTimeStamp;
+		return glm::clamp(midWayLength / framesDiff, 0.0f, 1.0f);
 	}
 
-
-private:
-
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	glm::quat Rotation(uint32_t index) const
 	{
-		float scaleFactor = 0.0f;
-		float midWayLength = animationTime - lastTimeStamp;
-		float framesDiff = nextTimeStamp - lastTimeStamp;
-		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		const int16_t* q = rotations + index * 4;
+		return glm::quat(q[0] / 32767.0f, q[1] / 32767.0f, q[2] / 32767.0f, q[3] / 32767.0f);
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	glm::mat4 InterpolatePosition(float animationTime) const
 	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
-
-		int p0Index = GetPositionIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-			, scaleFactor);
+		if (numPositions == 0)
+			return glm::mat4(1.0f);
+		if (1 == numPositions)
+			return glm::translate(glm::mat4(1.0f), positions[0]);
+
+		uint32_t p0Index = KeyIndex(positionTimes, numPositions, animationTime);
+		uint32_t p1Index = p0Index + 1;
+		float scaleFactor = GetScaleFactor(positionTimes[p0Index], positionTimes[p1Index], animationTime);
+		glm::vec3 finalPosition = glm::mix(positions[p0Index], positions[p1Index], scaleFactor);
 		return glm::translate(glm::mat4(1.0f), finalPosition);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::mat4 InterpolateRotation(float animationTime) const
 	{
-		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
-
-		int p0Index = GetRotationIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
-			, scaleFactor);
+		if (numRotations == 0)
+			return glm::mat4(1.0f);
+		if (1 == numRotations)
+			return glm::toMat4(glm::normalize(Rotation(0)));
+
+		uint32_t p0Index = KeyIndex(rotationTimes, numRotations, animationTime);
+		uint32_t p1Index = p0Index + 1;
+		float scaleFactor = GetScaleFactor(rotationTimes[p0Index], rotationTimes[p1Index], animationTime);
+		glm::quat finalRotation = glm::slerp(glm::normalize(Rotation(p0Index)), glm::normalize(Rotation(p1Index)), scaleFactor);
 		finalRotation = glm::normalize(finalRotation);
 		return glm::toMat4(finalRotation);
-
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::mat4 InterpolateScaling(float animationTime) const
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
-
-		int p0Index = GetScaleIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
-			, scaleFactor);
+		if (numScales == 0)
+			return glm::mat4(1.0f);
+		if (1 == numScales)
+			return glm::scale(glm::mat4(1.0f), scales[0]);
+
+		uint32_t p0Index = KeyIndex(scaleTimes, numScales, animationTime);
+		uint32_t p1Index = p0Index + 1;
+		float scaleFactor = GetScaleFactor(scaleTimes[p0Index], scaleTimes[p1Index], animationTime);
+		glm::vec3 finalScale = glm::mix(scales[p0Index], scales[p1Index], scaleFactor);
 		return glm::scale(glm::mat4(1.0f), finalScale);
 	}
-
-	std::vector<KeyPosition> m_Positions;
-	std::vector<KeyRotation> m_Rotations;
-	std::vector<KeyScale> m_Scales;
-	int m_NumPositions;
-	int m_NumRotations;
-	int m_NumScalings;
-
-	glm::mat4 m_LocalTransform;
-	std::string m_Name;
-	int m_ID;
 };
@@ -12,30 +12,13 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include "GLState.h"
+#include "InstanceBuffer.h"
 #include "Shader.h"
+#include "VertexFormat.h"
 
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
-struct Vertex {
-    
-    glm::vec3 Position;
-   
-    glm::vec3 Normal;
-   
-    glm::vec2 TexCoords;
-
-    glm::vec3 Tangent;
-   
-    glm::vec3 Bitangent;
-
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-   
-    float m_Weights[MAX_BONE_INFLUENCE];
-
-};
-
 struct Text{
     GLuint id;
     string type;
@@ -46,110 +29,231 @@ class Mesh
 {
 public:
     /*  Mesh Data  */
-    vector<Vertex> vertices;
-    vector<GLuint> indices;
     vector<Text> textures;
     
     /*  Functions  */
-    // Constructor
-    Mesh( vector<Vertex> vertices, vector<GLuint> indices, vector<Text> textures )
+    // Constructor, the packed data is uploaded and not kept around
+    Mesh( const PackedMesh& geometry, vector<Text> textures )
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->textures = std::move( textures );
+        this->flags = geometry.flags;
+        this->indexType = geometry.indexType( );
+        this->indexSize = GLsizei( geometry.indexSize( ) );
+        this->lods = geometry.lods;
+        this->bounds = geometry.bounds;
+        this->boxMin = geometry.boxMin;
+        this->boxMax = geometry.boxMax;
+        this->setupSamplerNames( );
         
         // Now that we have all the required data, set the vertex buffers and its attribute pointers.
-        this->setupMesh( );
+        this->setupMesh( geometry );
     }
     
-    // Render the mesh
+    // Render the mesh at full detail
     void Draw( std::shared_ptr<Shader> shader )
     {
-        // Bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint normalNr = 1;
+        this->Draw( shader, 0 );
+    }
+    
+    // Level of detail whose error is acceptable for the view
+    size_t selectLod( const LodView& view, const glm::mat4& modelMatrix ) const
+    {
+        return view.select( this->lods, this->bounds, modelMatrix );
+    }
+    
+    // Render one level of detail
+    void Draw( std::shared_ptr<Shader> shader, size_t lod )
+    {
+        this->BindTextures( *shader );
         
+        // Also set each mesh's shininess property to a default value (if you want you could extend this to another mesh property and possibly change this value)
+        //glUniform1f( glGetUniformLocation( shader->getHandle(), "material.shininess" ), 16.0f );
+        
+        // Draw mesh, the bindings stay for the next draw that needs the same ones
+        GLState::instance( ).bindVertexArray( this->VAO );
+        this->DrawElements( lod );
+    }
+    
+    // If BindTextures( ) of other binds the same textures to the same samplers
+    bool SameTextures( const Mesh& other ) const
+    {
+        if ( this == &other )
+        {
+            return true;
+        }
+        if ( this->textureSet != other.textureSet || this->textures.size( ) != other.textures.size( ) )
+        {
+            return false;
+        }
+        for( size_t i = 0; i < this->textures.size( ); i++ )
+        {
+            if ( this->textures[i].id != other.textures[i].id || this->samplerNames[i] != other.samplerNames[i] )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Binds the textures to units 0..n-1 and points the samplers of the shader (in use) at them
+    void BindTextures( Shader& shader ) const
+    {
         for( GLuint i = 0; i < this->textures.size(); i++ )
         {
-            glActiveTexture( GL_TEXTURE0 + i ); // Active proper texture unit before binding
-            // Retrieve texture number (the N in diffuse_textureN)
-            stringstream ss;
-            string number;
-            string name = this->textures[i].type;
-            
+            // Point the sampler at the texture unit, the shader caches the location by the precomputed hash
+            Uniform<int> sampler = shader.uniform<int>( UniformName( this->samplerNames[i].c_str( ), this->samplerHashes[i] ) );
+            shader.set( sampler, int( i ) );
+            // And bind the texture, skipped if the unit already has it
+            GLState::instance( ).bindTexture( i, GL_TEXTURE_2D, this->textures[i].id );
+        }
+    }
+    
+    // Unbinds the texture units first..end-1
+    static void UnbindTextures( GLuint first, GLuint end )
+    {
+        for ( GLuint i = first; i < end; i++ )
+        {
+            GLState::instance( ).bindTexture( i, GL_TEXTURE_2D, 0 );
+        }
+    }
+    
+    // Issues the draw call of one level of detail, the vertex array has to be bound
+    void DrawElements( size_t lod ) const
+    {
+        const MeshLod& level = this->Lod( lod );
+        glDrawElements( GL_TRIANGLES, level.indexCount, this->indexType, (void*)( uintptr_t( level.indexOffset ) * this->indexSize ) );
+        RenderStats::instance( ).addDraw( level.indexCount / 3, this->lods[0].indexCount / 3 );
+    }
+    
+    // Draws instances first..first+count-1 of the bound InstanceBuffer, the vertex array has to be bound
+    void DrawInstances( size_t lod, GLuint first, GLsizei count ) const
+    {
+        const MeshLod& level = this->Lod( lod );
+        glDrawElementsInstancedBaseInstance( GL_TRIANGLES, level.indexCount, this->indexType,
+                                             (void*)( uintptr_t( level.indexOffset ) * this->indexSize ), count, first );
+        RenderStats::instance( ).addDraw( level.indexCount / 3 * size_t( count ), this->lods[0].indexCount / 3 * size_t( count ) );
+    }
+    
+    // Copies the vertex and index data back from GL, in the layout of VertexFlags( )
+    void ReadBack( vector<unsigned char>& vertices, vector<unsigned char>& indices ) const
+    {
+        ReadBuffer( this->VBO, vertices );
+        ReadBuffer( this->EBO, indices );
+    }
+    
+    // Deletes the vertex array and buffers once a copy of the data lives elsewhere, like the
+    // StaticGeometry arena; the mesh can not be drawn or read back afterwards
+    void ReleaseGpuBuffers( )
+    {
+        if ( this->VAO == 0 )
+        {
+            return;
+        }
+        glDeleteBuffers( 1, &this->VBO );
+        glDeleteBuffers( 1, &this->EBO );
+        glDeleteVertexArrays( 1, &this->VAO );
+        GLState::instance( ).forgetVertexArray( this->VAO );
+        this->VAO = this->VBO = this->EBO = 0;
+    }
+    
+    // If the shader has a sampler for any of the textures
+    bool SamplesTextures( Shader& shader ) const
+    {
+        for( size_t i = 0; i < this->samplerNames.size( ); i++ )
+        {
+            if ( shader.uniform<int>( UniformName( this->samplerNames[i].c_str( ), this->samplerHashes[i] ) ).valid( ) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    const MeshLod& Lod( size_t lod ) const { return this->lods[std::min( lod, this->lods.size( ) - 1 )]; }
+    size_t LodCount( ) const { return this->lods.size( ); }
+    uint32_t VertexFlags( ) const { return this->flags; }
+    GLuint VertexArray( ) const { return this->VAO; }
+    // Hash of the texture ids for sort keys, meshes with the same textures (in the same order) share it;
+    // equal values do not guarantee equal textures, SameTextures( ) does
+    uint32_t TextureSet( ) const { return this->textureSet; }
+    size_t TextureCount( ) const { return this->textures.size( ); }
+    const glm::vec4& Bounds( ) const { return this->bounds; }
+    const glm::vec3& BoxMin( ) const { return this->boxMin; }
+    const glm::vec3& BoxMax( ) const { return this->boxMax; }
+    
+private:
+    /*  Render data  */
+    GLuint VAO, VBO, EBO;
+    uint32_t flags;
+    GLenum indexType;
+    GLsizei indexSize;
+    vector<MeshLod> lods;
+    glm::vec4 bounds;
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+    vector<string> samplerNames;
+    vector<uint32_t> samplerHashes;
+    uint32_t textureSet = 0;
+    
+    /*  Functions    */
+    // Names the sampler of each texture once (texture_diffuseN, normalMapN)
+    void setupSamplerNames( )
+    {
+        GLuint diffuseNr = 1;
+        GLuint normalNr = 1;
+        for( const Text& texture : this->textures )
+        {
+            string name = texture.type;
             if( name == "texture_diffuse" )
             {
-                ss << diffuseNr++; // Transfer GLuint to stream
+                name += to_string( diffuseNr++ );
             }
             else if( name == "normalMap" )
             {
-                ss << normalNr++; // Transfer GLuint to stream
+                name += to_string( normalNr++ );
             }
-            
-            number = ss.str( );
-            // Now set the sampler to the correct texture unit
-            glUniform1i( glGetUniformLocation( shader->getHandle(), ( name + number ).c_str( ) ), i );
-            // And finally bind the texture
-            glBindTexture( GL_TEXTURE_2D, this->textures[i].id );
+            this->samplerHashes.push_back( UniformName::hashOf( name.c_str( ), name.size( ) ) );
+            this->samplerNames.push_back( std::move( name ) );
         }
-        
-        // Also set each mesh's shininess property to a default value (if you want you could extend this to another mesh property and possibly change this value)
-        //glUniform1f( glGetUniformLocation( shader->getHandle(), "material.shininess" ), 16.0f );
-        
-        // Draw mesh
-        glBindVertexArray( this->VAO );
-        glDrawElements( GL_TRIANGLES, this->indices.size( ), GL_UNSIGNED_INT, 0 );
-        glBindVertexArray( 0 );
-        
-        // Always good practice to set everything back to defaults once configured.
-        for ( GLuint i = 0; i < this->textures.size( ); i++ )
+        // FNV-1a over the texture handles
+        this->textureSet = 2166136261u;
+        for( const Text& texture : this->textures )
         {
-            glActiveTexture( GL_TEXTURE0 + i );
-            glBindTexture( GL_TEXTURE_2D, 0 );
+            this->textureSet = ( this->textureSet ^ texture.id ) * 16777619u;
         }
     }
     
-private:
-    /*  Render data  */
-    GLuint VAO, VBO, EBO;
+    // Reads a whole buffer, the copy target leaves the element array binding of the bound vertex array alone
+    static void ReadBuffer( GLuint buffer, vector<unsigned char>& data )
+    {
+        GLint size = 0;
+        glBindBuffer( GL_COPY_READ_BUFFER, buffer );
+        glGetBufferParameteriv( GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size );
+        data.resize( size_t( size ) );
+        glGetBufferSubData( GL_COPY_READ_BUFFER, 0, size, data.data( ) );
+        glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+    }
     
-    /*  Functions    */
     // Initializes all the buffer objects/arrays
-    void setupMesh( )
+    void setupMesh( const PackedMesh& geometry )
     {
         // Create buffers/arrays
         glGenVertexArrays( 1, &this->VAO );
         glGenBuffers( 1, &this->VBO );
         glGenBuffers( 1, &this->EBO );
         
-        glBindVertexArray( this->VAO );
+        GLState::instance( ).bindVertexArray( this->VAO );
         // Load data into vertex buffers
         glBindBuffer( GL_ARRAY_BUFFER, this->VBO );
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData( GL_ARRAY_BUFFER, this->vertices.size( ) * sizeof( Vertex ), &this->vertices[0], GL_STATIC_DRAW );
+        glBufferData( GL_ARRAY_BUFFER, geometry.vertices.size( ), geometry.vertices.data( ), GL_STATIC_DRAW );
         
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, this->EBO );
-        glBufferData( GL_ELEMENT_ARRAY_BUFFER, this->indices.size( ) * sizeof( GLuint ), &this->indices[0], GL_STATIC_DRAW );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, geometry.indices.size( ), geometry.indices.data( ), GL_STATIC_DRAW );
         
-        // Set the vertex attribute pointers
-        // Vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribIPointer(3, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void*)offsetof(Vertex, m_Weights));
+        // Set the vertex attribute pointers of the layout chosen at import
+        geometry.layout( ).apply( );
+        InstanceBuffer::setupIndexAttribute( );
+        
+        GLState::instance( ).bindVertexArray( 0 );
     }
-};
\ No newline at end of file
+};
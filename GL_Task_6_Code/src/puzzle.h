@@ -8,6 +8,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "GLState.h"
 #include "Shader.h"
 
 enum Mode { MODE_2D };
@@ -82,7 +83,7 @@ public:
         glGenBuffers(1, &puzzleVbo);
         glGenBuffers(1, &puzzleEbo);
 
-        glBindVertexArray(puzzleVao);
+        GLState::instance().bindVertexArray(puzzleVao);
 
         glBindBuffer(GL_ARRAY_BUFFER, puzzleVbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -96,7 +97,7 @@ public:
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
         glEnableVertexAttribArray(1);
 
-        glBindVertexArray(0);
+        GLState::instance().bindVertexArray(0);
     }
 
 
@@ -118,9 +119,8 @@ public:
                     glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0.0f));
                     shaderProgram->setUniform("model", model);
 
-                    glBindVertexArray(puzzleVao);
+                    GLState::instance().bindVertexArray(puzzleVao);
                     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-                    glBindVertexArray(0);
                 }
             }
         }
@@ -155,7 +155,7 @@ public:
     }
 
     void initOpenGL() {
-        glEnable(GL_DEPTH_TEST);
+        GLState::instance().setEnabled(GL_DEPTH_TEST, true);
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     }
 };